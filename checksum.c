@@ -0,0 +1,508 @@
+#define _GNU_SOURCE  // O_NOFOLLOW, posix_fadvise()
+
+#include "checksum.h"
+#include "hash.h"
+#include "walk.h"
+#include "inomap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Each worker reads files through a buffer this big
+#define READ_BUF_SIZE (1u << 20)
+
+// CRC32C parts can be combined afterwards, so files this big are split
+// into parts that several workers read at once. xxHash64 and SHA-256
+// have to see the bytes in order and always run on one worker.
+#define SPLIT_MIN (64u << 20)
+#define PART_SIZE (16u << 20)
+
+// Results a worker keeps before handing them over (fewer wakeups when
+// hashing lots of small files)
+#define PUBLISH_BATCH 64
+
+// A big file hashed in parts (CRC32C). The worker that finishes the last
+// part combines the CRCs and reports the file.
+typedef struct {
+    int fd;                     // Shared by the parts (pread)
+    checksum_result_t result;   // Everything but the digest
+    uint32_t *crcs;             // One per part
+    size_t nparts;
+    atomic_size_t left;         // Parts not finished yet
+    atomic_int error;
+} big_file_t;
+
+// What a walk item is: a folder to read, a file to hash, a path given by
+// the caller (followed if it is a symlink) or a part of a big file (the
+// item's data is the big_file_t and n the part)
+enum { ITEM_DIR, ITEM_FILE, ITEM_PATH, ITEM_PART };
+
+struct checksum {
+    pthread_mutex_t lock;       // Guards the results
+    pthread_cond_t done_cond;   // checksum_collect(): results arrived or the run ended
+    walk_t *walk;
+    atomic_int cancel;
+    atomic_ulong files, errors;
+    atomic_ullong bytes;
+    checksum_result_t *results; // Done since the last checksum_collect()
+    size_t results_used, results_cap;
+
+    checksum_algo_t algo;
+    int include_hidden;
+    void (*notify)(void);
+};
+
+// Results of one worker, handed over in batches
+typedef struct {
+    checksum_result_t *arr;
+    size_t used, cap;
+} result_list_t;
+
+static const char *const algo_names[] = { "crc32c", "xxh64", "sha256" };
+
+const char *checksum_algo_name(checksum_algo_t algo) {
+    return algo_names[algo];
+}
+
+int checksum_parse_algo(const char *name, checksum_algo_t *out) {
+    for (size_t i = 0; i < sizeof(algo_names) / sizeof(algo_names[0]); i++) {
+        if (strcmp(name, algo_names[i]) == 0) {
+            *out = (checksum_algo_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int cancelled(checksum_t *c) {
+    return atomic_load_explicit(&c->cancel, memory_order_relaxed);
+}
+
+// ---- Hashing ----
+
+typedef struct {
+    checksum_algo_t algo;
+    union {
+        uint32_t crc;
+        xxh64_t xxh;
+        sha256_t sha;
+    } u;
+} hasher_t;
+
+static void hasher_init(hasher_t *h, checksum_algo_t algo) {
+    h->algo = algo;
+    switch (algo) {
+        case CHECKSUM_CRC32C: h->u.crc = 0; break;
+        case CHECKSUM_XXH64: xxh64_init(&h->u.xxh); break;
+        case CHECKSUM_SHA256: sha256_init(&h->u.sha); break;
+    }
+}
+
+static void hasher_update(hasher_t *h, const void *data, size_t n) {
+    switch (h->algo) {
+        case CHECKSUM_CRC32C: h->u.crc = crc32c_update(h->u.crc, data, n); break;
+        case CHECKSUM_XXH64: xxh64_update(&h->u.xxh, data, n); break;
+        case CHECKSUM_SHA256: sha256_update(&h->u.sha, data, n); break;
+    }
+}
+
+// The digest as the usual tools print it (crc32c and xxhsum: big-endian)
+static void hasher_hex(hasher_t *h, char *hex) {
+    switch (h->algo) {
+        case CHECKSUM_CRC32C:
+            snprintf(hex, CHECKSUM_HEX_MAX, "%08x", h->u.crc);
+            break;
+        case CHECKSUM_XXH64:
+            snprintf(hex, CHECKSUM_HEX_MAX, "%016llx", (unsigned long long)xxh64_final(&h->u.xxh));
+            break;
+        case CHECKSUM_SHA256: {
+            unsigned char digest[32];
+            sha256_final(&h->u.sha, digest);
+            for (int i = 0; i < 32; i++) {
+                snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+            }
+            break;
+        }
+    }
+}
+
+// ---- Work and results ----
+
+static void add_result(result_list_t *l, const checksum_result_t *r) {
+    if (l->used == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 16;
+        l->arr = realloc(l->arr, l->cap * sizeof(checksum_result_t));
+        if (!l->arr) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    l->arr[l->used++] = *r;
+}
+
+// Hand a batch of results to the UI
+static void publish_results(checksum_t *c, result_list_t *l) {
+    if (l->used == 0) return;
+
+    pthread_mutex_lock(&c->lock);
+    if (c->results_used + l->used > c->results_cap) {
+        size_t cap = c->results_cap ? c->results_cap : 256;
+        while (cap < c->results_used + l->used) cap *= 2;
+        checksum_result_t *results = realloc(c->results, cap * sizeof(checksum_result_t));
+        if (!results) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        c->results = results;
+        c->results_cap = cap;
+    }
+    memcpy(c->results + c->results_used, l->arr, l->used * sizeof(checksum_result_t));
+    c->results_used += l->used;
+    pthread_cond_broadcast(&c->done_cond);
+    pthread_mutex_unlock(&c->lock);
+    l->used = 0;
+    if (c->notify) c->notify();
+}
+
+// Report a file (or that it couldn't be read)
+static void file_done(checksum_t *c, checksum_result_t *r, result_list_t *done) {
+    atomic_fetch_add_explicit(r->error ? &c->errors : &c->files, 1, memory_order_relaxed);
+    add_result(done, r);
+}
+
+// Read one folder: queue its files and subfolders
+static void read_folder(checksum_t *c, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    const char *sep = path[strlen(path) - 1] == '/' ? "" : "/";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && !cancelled(c)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (!c->include_hidden || name[1] == '\0' ||
+                               (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type != DT_DIR && type != DT_REG) continue;
+
+        char child[PATH_MAX];
+        if ((size_t)snprintf(child, sizeof(child), "%s%s%s", path, sep, name) >= sizeof(child)) {
+            continue;
+        }
+        walk_push(c->walk, type == DT_DIR ? ITEM_DIR : ITEM_FILE, child, NULL, 0);
+    }
+    closedir(dir);
+}
+
+// The last part of a big file is done: combine the parts' CRCs
+static void finish_big(checksum_t *c, big_file_t *big, result_list_t *done) {
+    int error = atomic_load(&big->error);
+    close(big->fd);
+    if (error == ECANCELED) {
+        free(big->result.path);
+    } else {
+        checksum_result_t *r = &big->result;
+        r->error = error;
+        if (!error) {
+            uint32_t crc = big->crcs[0];
+            for (size_t i = 1; i < big->nparts; i++) {
+                uint64_t len = i + 1 < big->nparts ? PART_SIZE
+                                                   : (uint64_t)r->size - (uint64_t)i * PART_SIZE;
+                crc = crc32c_combine(crc, big->crcs[i], len);
+            }
+            snprintf(r->hex, sizeof(r->hex), "%08x", crc);
+        }
+        file_done(c, r, done);
+    }
+    free(big->crcs);
+    free(big);
+}
+
+// CRC32C of one part of a big file
+static void hash_part(checksum_t *c, big_file_t *big, size_t part, char *buf, result_list_t *done) {
+    off_t from = (off_t)part * PART_SIZE;
+    size_t len = (size_t)(big->result.size - from) < PART_SIZE ? (size_t)(big->result.size - from)
+                                                               : PART_SIZE;
+    uint32_t crc = 0;
+    while (len > 0 && !atomic_load_explicit(&big->error, memory_order_relaxed)) {
+        if (cancelled(c)) {
+            atomic_store(&big->error, ECANCELED);
+            break;
+        }
+        ssize_t r = pread(big->fd, buf, len < READ_BUF_SIZE ? len : READ_BUF_SIZE, from);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            atomic_store(&big->error, r < 0 ? errno : EIO);  // EIO: it shrank under us
+            break;
+        }
+        crc = crc32c_update(crc, buf, (size_t)r);
+        atomic_fetch_add_explicit(&c->bytes, (unsigned long long)r, memory_order_relaxed);
+        from += r;
+        len -= (size_t)r;
+    }
+    big->crcs[part] = crc;
+    if (atomic_fetch_sub(&big->left, 1) == 1) finish_big(c, big, done);
+}
+
+// Hash one file start to end, or split it into parts for the other workers
+static void hash_file(checksum_t *c, const char *path, int follow, char *buf, result_list_t *done) {
+    checksum_result_t r = { .path = xstrdup(path) };
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK | (follow ? 0 : O_NOFOLLOW));
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        r.error = errno;
+        if (fd >= 0) close(fd);
+        file_done(c, &r, done);
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) {  // Devices, FIFOs and sockets have no fixed contents
+        close(fd);
+        free(r.path);
+        return;
+    }
+    r.dev = st.st_dev;
+    r.ino = st.st_ino;
+    r.size = st.st_size;
+    r.mtime = st.st_mtim;
+
+    if (c->algo == CHECKSUM_CRC32C && walk_workers(c->walk) > 1 && (size_t)st.st_size >= SPLIT_MIN) {
+        big_file_t *big = calloc(1, sizeof(*big));
+        size_t nparts = ((size_t)st.st_size + PART_SIZE - 1) / PART_SIZE;
+        if (!big || !(big->crcs = calloc(nparts, sizeof(uint32_t)))) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        big->fd = fd;
+        big->result = r;
+        big->nparts = nparts;
+        atomic_init(&big->left, nparts);
+        atomic_init(&big->error, 0);
+        for (size_t i = nparts - 1; i > 0; i--) {
+            walk_push(c->walk, ITEM_PART, NULL, big, i);
+        }
+        hash_part(c, big, 0, buf, done);
+        return;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    hasher_t h;
+    hasher_init(&h, c->algo);
+    for (;;) {
+        if (cancelled(c)) {
+            close(fd);
+            free(r.path);
+            return;
+        }
+        ssize_t n = read(fd, buf, READ_BUF_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            r.error = errno;
+            break;
+        }
+        if (n == 0) break;
+        hasher_update(&h, buf, (size_t)n);
+        atomic_fetch_add_explicit(&c->bytes, (unsigned long long)n, memory_order_relaxed);
+    }
+    close(fd);
+    if (!r.error) hasher_hex(&h, r.hex);
+    file_done(c, &r, done);
+}
+
+// Per-worker state: a read buffer and the results not handed over yet
+typedef struct {
+    char *buf;
+    result_list_t done;
+} checksum_worker_t;
+
+static void *checksum_worker_init(void *ctx) {
+    (void)ctx;
+    checksum_worker_t *cw = calloc(1, sizeof(*cw));
+    if (!cw) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    cw->buf = malloc(READ_BUF_SIZE);
+    return cw;
+}
+
+static void checksum_visit(void *ctx, void *state, const walk_item_t *item) {
+    checksum_t *c = ctx;
+    checksum_worker_t *cw = state;
+    if (item->kind == ITEM_PART) {
+        // Even when cancelled, so the last part frees the file
+        big_file_t *big = item->data;
+        if (cw->buf) hash_part(c, big, item->n, cw->buf, &cw->done);
+        else if (atomic_fetch_sub(&big->left, 1) == 1) finish_big(c, big, &cw->done);
+    } else if (cw->buf && !cancelled(c)) {
+        if (item->kind == ITEM_DIR) {
+            read_folder(c, item->path);
+        } else {
+            hash_file(c, item->path, item->kind == ITEM_PATH, cw->buf, &cw->done);
+        }
+    }
+    if (cw->done.used >= PUBLISH_BATCH) publish_results(c, &cw->done);
+}
+
+// Results go out in batches, and whenever the worker is about to wait
+static void checksum_idle(void *ctx, void *state) {
+    checksum_worker_t *cw = state;
+    publish_results(ctx, &cw->done);
+}
+
+static void checksum_worker_done(void *ctx, void *state) {
+    checksum_worker_t *cw = state;
+    publish_results(ctx, &cw->done);
+    free(cw->done.arr);
+    free(cw->buf);
+    free(cw);
+}
+
+// The run is over: wake a waiting checksum_collect() and the UI
+static void checksum_finished(void *ctx) {
+    checksum_t *c = ctx;
+    pthread_mutex_lock(&c->lock);
+    pthread_cond_broadcast(&c->done_cond);
+    pthread_mutex_unlock(&c->lock);
+    if (c->notify) c->notify();
+}
+
+static const walk_ops_t checksum_ops = {
+    .worker_init = checksum_worker_init,
+    .visit = checksum_visit,
+    .idle = checksum_idle,
+    .worker_done = checksum_worker_done,
+    .finished = checksum_finished,
+};
+
+// Start hashing 'paths'
+checksum_t *checksum_start(char *const *paths, size_t count, checksum_algo_t algo,
+                           int include_hidden, void (*notify)(void), char *err, size_t errsz) {
+    checksum_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        snprintf(err, errsz, "out of memory");
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->done_cond, NULL);
+    c->algo = algo;
+    c->include_hidden = include_hidden;
+    c->notify = notify;
+
+    // Paths given to us are followed if they are symlinks, like the tools do
+    c->walk = walk_create(walk_threads(), &checksum_ops, c);
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        int is_dir = stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode);
+        walk_push(c->walk, is_dir ? ITEM_DIR : ITEM_PATH, paths[i], NULL, 0);
+    }
+    if (walk_start(c->walk) != 0) {
+        snprintf(err, errsz, "can't start checksum threads");
+        checksum_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+// Take the results done since the last call (NULL if none). With 'wait'
+// set, blocks until there are some or the run is over. The caller owns
+// the array and frees each result with checksum_result_free().
+checksum_result_t *checksum_collect(checksum_t *c, size_t *count, int wait) {
+    pthread_mutex_lock(&c->lock);
+    while (wait && c->results_used == 0 && walk_running(c->walk)) {
+        pthread_cond_wait(&c->done_cond, &c->lock);
+    }
+    checksum_result_t *results = c->results;
+    *count = c->results_used;
+    c->results = NULL;
+    c->results_used = c->results_cap = 0;
+    pthread_mutex_unlock(&c->lock);
+    return results;
+}
+
+void checksum_result_free(checksum_result_t *r) {
+    free(r->path);
+}
+
+// Is the run still going?
+int checksum_running(checksum_t *c) {
+    return walk_running(c->walk);
+}
+
+// Totals so far (for progress)
+void checksum_get_progress(checksum_t *c, checksum_progress_t *out) {
+    out->files = atomic_load_explicit(&c->files, memory_order_relaxed);
+    out->errors = atomic_load_explicit(&c->errors, memory_order_relaxed);
+    out->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+}
+
+// Stop the run; results so far can still be collected
+void checksum_cancel(checksum_t *c) {
+    atomic_store(&c->cancel, 1);
+}
+
+// Stop the run, wait for the workers and free everything. The workers
+// empty the stack before they finish (parts of big files included).
+void checksum_free(checksum_t *c) {
+    if (!c) return;
+    checksum_cancel(c);
+    walk_free(c->walk);
+    for (size_t i = 0; i < c->results_used; i++) {
+        checksum_result_free(&c->results[i]);
+    }
+    free(c->results);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->done_cond);
+    free(c);
+}
+
+// ---- Cache (UI thread) ----
+
+typedef struct {
+    off_t size;
+    struct timespec mtime;
+    checksum_algo_t algo;
+    char hex[CHECKSUM_HEX_MAX];
+} cache_slot_t;
+
+static inomap_t cache = INOMAP_INIT(sizeof(cache_slot_t));  // By (dev, ino)
+
+// Remember a file's digest (the latest one wins if several algorithms were used)
+void checksum_cache_put(const checksum_result_t *r, checksum_algo_t algo) {
+    if (r->error) return;
+    cache_slot_t *s = inomap_get(&cache, r->dev, r->ino, NULL);
+    s->size = r->size;
+    s->mtime = r->mtime;
+    s->algo = algo;
+    memcpy(s->hex, r->hex, sizeof(s->hex));
+}
+
+// Digest of file 'st' if one is cached and the file hasn't changed since
+// (same size and mtime), else NULL
+const char *checksum_cache_get(const struct stat *st, checksum_algo_t *algo) {
+    cache_slot_t *s = inomap_find(&cache, st->st_dev, st->st_ino);
+    if (!s || s->size != st->st_size || s->mtime.tv_sec != st->st_mtim.tv_sec ||
+        s->mtime.tv_nsec != st->st_mtim.tv_nsec) {
+        return NULL;
+    }
+    *algo = s->algo;
+    return s->hex;
+}
+
+void checksum_cache_clear(void) {
+    inomap_free(&cache);
+}
@@ -0,0 +1,61 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+
+typedef enum {
+    CHECKSUM_CRC32C,
+    CHECKSUM_XXH64,
+    CHECKSUM_SHA256
+} checksum_algo_t;
+
+// Longest digest in hex (SHA-256), plus the NUL
+#define CHECKSUM_HEX_MAX 65
+
+const char *checksum_algo_name(checksum_algo_t algo);
+int checksum_parse_algo(const char *name, checksum_algo_t *out);
+
+// One file's digest
+typedef struct {
+    char *path;
+    char hex[CHECKSUM_HEX_MAX];     // "" when the file couldn't be read
+    int error;                      // errno of the failure, else 0
+    dev_t dev;                      // The file as it was when hashed,
+    ino_t ino;                      // for the cache
+    off_t size;
+    struct timespec mtime;
+} checksum_result_t;
+
+// Running totals
+typedef struct {
+    unsigned long files;            // Files hashed
+    unsigned long errors;           // Files that couldn't be read
+    unsigned long long bytes;       // Bytes hashed
+} checksum_progress_t;
+
+typedef struct checksum checksum_t;
+
+// Hash the given files, and every file below the given folders, with
+// several worker threads. Symlinks below a folder are not followed.
+// Results stream out through checksum_collect() as they are done, in no
+// particular order; 'notify' (e.g. events_wakeup, or NULL) is called from
+// a worker when new results or the end of the run are ready. Returns NULL
+// with a message in 'err' if no thread could be started.
+checksum_t *checksum_start(char *const *paths, size_t count, checksum_algo_t algo,
+                           int include_hidden, void (*notify)(void), char *err, size_t errsz);
+checksum_result_t *checksum_collect(checksum_t *c, size_t *count, int wait);
+void checksum_result_free(checksum_result_t *r);
+int checksum_running(checksum_t *c);
+void checksum_get_progress(checksum_t *c, checksum_progress_t *out);
+void checksum_cancel(checksum_t *c);
+void checksum_free(checksum_t *c);
+
+// Digests already worked out, keyed by the file's (dev, ino) and valid
+// while its size and mtime stay the same. UI thread only.
+void checksum_cache_put(const checksum_result_t *r, checksum_algo_t algo);
+const char *checksum_cache_get(const struct stat *st, checksum_algo_t *algo);
+void checksum_cache_clear(void);
+
+#endif
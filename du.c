@@ -0,0 +1,269 @@
+#define _GNU_SOURCE  // fdopendir(), openat() flags
+
+#include "du.h"
+#include "pool.h"
+#include "walk.h"
+#include "inomap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// One directory to size, waiting for or owned by a worker
+typedef struct du_req {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;      // Directory mtime when the request was made
+    unsigned gen;               // du_cancel_pending() generation
+    int ok;                     // Walk finished (not cancelled or failed)
+    du_size_t size;
+    struct du_req *next;
+} du_req_t;
+
+// Cache entry for one directory (UI thread only)
+typedef struct {
+    struct timespec mtime;
+    du_size_t size;
+    int done;                   // 'size' is valid for 'mtime'
+    int queued;                 // A walk for 'mtime' was requested...
+    unsigned gen;               // ...in this generation (older ones were abandoned)
+} du_slot_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    du_req_t *queue_head;       // Waiting requests (FIFO)
+    du_req_t *queue_tail;
+    du_req_t *finished;         // Results for du_collect()
+    atomic_uint gen;            // Bumped to abandon queued and running walks
+    int stopping;
+    pool_t *pool;               // Runs one du_worker() per thread while started
+    void (*notify)(void);
+    inomap_t cache;             // du_slot_t of each directory by (dev, ino)
+} du = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .cache = INOMAP_INIT(sizeof(du_slot_t)),
+};
+
+// ---- Workers ----
+
+// Add everything below the open directory 'fd' to 'size'. Only files with
+// more than one link are checked against 'seen'; the rest can't repeat.
+// Returns -1 if the walk was abandoned.
+static int du_walk(int fd, unsigned gen, inomap_t *seen, du_size_t *size) {
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return 0;  // Unreadable: count what we can, like du
+    }
+
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (atomic_load_explicit(&du.gen, memory_order_relaxed) != gen) {
+            result = -1;
+            break;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (st.st_nlink > 1 && !S_ISDIR(st.st_mode)) {
+            int added;
+            inomap_get(seen, st.st_dev, st.st_ino, &added);
+            if (!added) continue;  // Another link to it was counted already
+        }
+        size->bytes += (unsigned long long)st.st_size;
+        size->blocks += (unsigned long long)st.st_blocks;
+
+        if (S_ISDIR(st.st_mode)) {
+            int child = openat(dirfd(dir), entry->d_name,
+                               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child >= 0 && du_walk(child, gen, seen, size) != 0) {
+                result = -1;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+// Size one requested directory (the directory itself included)
+static void du_run(du_req_t *req) {
+    inomap_t seen = INOMAP_INIT(0);  // Inodes counted so far (hard links)
+    struct stat st;
+    int fd = open(req->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    req->ok = 0;
+    if (fd < 0) {
+        // Unreadable: report the directory's own size, as du does
+        if (lstat(req->path, &st) == 0) {
+            req->size.bytes = (unsigned long long)st.st_size;
+            req->size.blocks = (unsigned long long)st.st_blocks;
+            req->ok = 1;
+        }
+        return;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+    req->size.bytes = (unsigned long long)st.st_size;
+    req->size.blocks = (unsigned long long)st.st_blocks;
+    req->ok = du_walk(fd, req->gen, &seen, &req->size) == 0;
+    inomap_free(&seen);
+}
+
+static void du_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&du.lock);
+    for (;;) {
+        while (!du.queue_head && !du.stopping) {
+            pthread_cond_wait(&du.cond, &du.lock);
+        }
+        if (du.stopping) break;
+
+        du_req_t *req = du.queue_head;
+        du.queue_head = req->next;
+        if (!du.queue_head) du.queue_tail = NULL;
+        pthread_mutex_unlock(&du.lock);
+
+        du_run(req);
+
+        pthread_mutex_lock(&du.lock);
+        req->next = du.finished;
+        du.finished = req;
+        if (du.notify) du.notify();
+    }
+    pthread_mutex_unlock(&du.lock);
+}
+
+// Start the worker threads (idempotent)
+int du_start(void (*notify)(void)) {
+    if (du.pool) return 0;
+    du.notify = notify;
+    du.stopping = 0;
+
+    int n = walk_threads();
+    if (!(du.pool = pool_create(n, (size_t)n))) return -1;
+    for (int i = pool_threads(du.pool); i > 0; i--) {
+        pool_submit(du.pool, du_worker, NULL);  // Never waits: one task per thread
+    }
+    return 0;
+}
+
+static void free_reqs(du_req_t *r) {
+    while (r) {
+        du_req_t *next = r->next;
+        free(r->path);
+        free(r);
+        r = next;
+    }
+}
+
+// Abandon all work, join the workers and drop the cache
+void du_stop(void) {
+    if (!du.pool) return;
+
+    pthread_mutex_lock(&du.lock);
+    du.stopping = 1;
+    atomic_fetch_add(&du.gen, 1);
+    pthread_cond_broadcast(&du.cond);
+    pthread_mutex_unlock(&du.lock);
+    pool_destroy(du.pool);
+    du.pool = NULL;
+
+    free_reqs(du.queue_head);
+    free_reqs(du.finished);
+    du.queue_head = du.queue_tail = du.finished = NULL;
+    inomap_free(&du.cache);
+}
+
+// ---- Cache (UI thread) ----
+
+static int same_time(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Cached size of directory 'st', if there is one and the directory
+// hasn't changed since (same mtime). Returns 1 on a hit.
+int du_lookup(const struct stat *st, du_size_t *out) {
+    du_slot_t *s = inomap_find(&du.cache, st->st_dev, st->st_ino);
+    if (!s || !s->done || !same_time(s->mtime, st->st_mtim)) return 0;
+    *out = s->size;
+    return 1;
+}
+
+// Ask for the size of directory 'path' unless it is cached or queued
+void du_request(const char *path, const struct stat *st) {
+    du_slot_t *s = inomap_get(&du.cache, st->st_dev, st->st_ino, NULL);
+    unsigned gen = atomic_load(&du.gen);
+    if (same_time(s->mtime, st->st_mtim) && (s->done || (s->queued && s->gen == gen))) {
+        return;
+    }
+
+    du_req_t *req = calloc(1, sizeof(*req));
+    if (!req || !(req->path = strdup(path))) {
+        free(req);
+        return;
+    }
+    req->dev = st->st_dev;
+    req->ino = st->st_ino;
+    req->mtime = st->st_mtim;
+    req->gen = gen;
+    s->mtime = st->st_mtim;
+    s->done = 0;
+    s->queued = 1;
+    s->gen = gen;
+
+    pthread_mutex_lock(&du.lock);
+    if (du.queue_tail) du.queue_tail->next = req;
+    else du.queue_head = req;
+    du.queue_tail = req;
+    pthread_cond_signal(&du.cond);
+    pthread_mutex_unlock(&du.lock);
+}
+
+// Drop queued requests and stop running walks (e.g. after leaving the
+// folder). Sizes already finished stay cached; bumping the generation
+// lets the abandoned directories be requested again.
+void du_cancel_pending(void) {
+    pthread_mutex_lock(&du.lock);
+    atomic_fetch_add(&du.gen, 1);
+    du_req_t *queued = du.queue_head;
+    du.queue_head = du.queue_tail = NULL;
+    pthread_mutex_unlock(&du.lock);
+    free_reqs(queued);
+}
+
+// Move finished sizes into the cache. Returns how many arrived.
+int du_collect(void) {
+    pthread_mutex_lock(&du.lock);
+    du_req_t *list = du.finished;
+    du.finished = NULL;
+    pthread_mutex_unlock(&du.lock);
+
+    int n = 0;
+    for (du_req_t *r = list; r; r = r->next) {
+        du_slot_t *s = inomap_get(&du.cache, r->dev, r->ino, NULL);
+        if (!same_time(s->mtime, r->mtime)) continue;  // Directory changed since
+        if (s->gen == r->gen) s->queued = 0;
+        if (r->ok) {
+            s->size = r->size;
+            s->done = 1;
+            n++;
+        }
+    }
+    free_reqs(list);
+    return n;
+}
@@ -0,0 +1,23 @@
+#ifndef DU_H
+#define DU_H
+
+#include <sys/stat.h>
+
+// Recursive size of a directory (like du -s), hard links counted once
+typedef struct {
+    unsigned long long bytes;   // Apparent size: sum of st_size
+    unsigned long long blocks;  // Space used: sum of st_blocks (512-byte units)
+} du_size_t;
+
+// Sizes are computed by background threads and kept in a cache keyed by
+// the directory's (dev, ino) and validated by its mtime. Everything but
+// the workers runs on the UI thread; 'notify' (e.g. events_wakeup) is
+// called from a worker whenever results are ready for du_collect().
+int du_start(void (*notify)(void));
+void du_stop(void);
+int du_lookup(const struct stat *st, du_size_t *out);
+void du_request(const char *path, const struct stat *st);
+void du_cancel_pending(void);
+int du_collect(void);
+
+#endif
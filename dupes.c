@@ -0,0 +1,505 @@
+#define _GNU_SOURCE  // O_NOFOLLOW, posix_fadvise()
+
+#include "dupes.h"
+#include "hash.h"
+#include "walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+// Bytes hashed at each end of a file before deciding to read all of it.
+// Files no bigger than both ends together are hashed whole right away.
+#define EDGE_SIZE 4096u
+
+// Full hashes read through a buffer this big, and drop files at least
+// this big from the page cache afterwards (a scan of a big tree
+// shouldn't push out everything else)
+#define READ_BUF_SIZE (1u << 20)
+#define DROP_CACHE_MIN (64u << 20)
+
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    uint64_t partial;           // xxHash64 of the first and last EDGE_SIZE bytes
+    unsigned char full[32];     // SHA-256 of the whole file
+    int have_full;
+    int failed;                 // Unreadable, or changed while we looked
+} dupes_file_t;
+
+typedef struct {
+    dupes_file_t *arr;
+    size_t used, cap;
+} file_list_t;
+
+// What a walk item is: a folder to read, or a turn at the current hashing
+// phase (each worker gets one)
+enum { ITEM_DIR, ITEM_HASH };
+
+struct dupes {
+    pthread_mutex_t lock;       // Guards 'files' during the walk
+    pthread_cond_t done_cond;   // dupes_wait(): the run ended
+    walk_t *walk;
+    atomic_int cancel;
+    atomic_int phase;
+    atomic_ulong dirs, found, candidates, hashed;
+    atomic_ullong bytes;
+
+    file_list_t files;          // Every file found, then the ones still in the race
+    atomic_size_t next;         // Hashing phases: next file to take
+    dupes_group_t *groups;
+    size_t ngroups;
+
+    int include_hidden;
+    void (*notify)(void);
+};
+
+static int cancelled(dupes_t *d) {
+    return atomic_load_explicit(&d->cancel, memory_order_relaxed);
+}
+
+static void add_file(file_list_t *l, const dupes_file_t *f) {
+    if (l->used == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 256;
+        l->arr = realloc(l->arr, l->cap * sizeof(dupes_file_t));
+        if (!l->arr) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    l->arr[l->used++] = *f;
+}
+
+// ---- Walk ----
+
+// Read one folder: note its files and sizes, queue its subfolders
+static void read_folder(dupes_t *d, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    file_list_t found = { NULL, 0, 0 };
+    const char *sep = path[strlen(path) - 1] == '/' ? "" : "/";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && !cancelled(d)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (!d->include_hidden || name[1] == '\0' ||
+                               (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (entry->d_type != DT_DIR && entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+
+        // Files need their size anyway, so there is a stat() per file;
+        // d_type spares it for folders
+        struct stat st;
+        int is_dir = entry->d_type == DT_DIR;
+        if (!is_dir) {
+            if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+            if (!is_dir && (!S_ISREG(st.st_mode) || st.st_size == 0)) continue;
+        }
+
+        char child[PATH_MAX];
+        if ((size_t)snprintf(child, sizeof(child), "%s%s%s", path, sep, name) >= sizeof(child)) {
+            continue;
+        }
+        if (is_dir) {
+            walk_push(d->walk, ITEM_DIR, child, NULL, 0);
+            continue;
+        }
+        dupes_file_t f = { .path = xstrdup(child), .dev = st.st_dev, .ino = st.st_ino,
+                           .size = st.st_size };
+        add_file(&found, &f);
+        atomic_fetch_add_explicit(&d->found, 1, memory_order_relaxed);
+    }
+    closedir(dir);
+    atomic_fetch_add_explicit(&d->dirs, 1, memory_order_relaxed);
+
+    // The folder's files join the others in one go
+    if (found.used > 0) {
+        pthread_mutex_lock(&d->lock);
+        for (size_t i = 0; i < found.used; i++) {
+            add_file(&d->files, &found.arr[i]);
+        }
+        pthread_mutex_unlock(&d->lock);
+    }
+    free(found.arr);
+}
+
+// ---- Picking candidates (one thread, between phases) ----
+
+static int cmp_inode(const void *a, const void *b) {
+    const dupes_file_t *x = a, *y = b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+static int cmp_size(const void *a, const void *b) {
+    const dupes_file_t *x = a, *y = b;
+    return x->size < y->size ? -1 : x->size > y->size;
+}
+
+static int cmp_partial(const void *a, const void *b) {
+    const dupes_file_t *x = a, *y = b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    return x->partial < y->partial ? -1 : x->partial > y->partial;
+}
+
+static int cmp_full(const void *a, const void *b) {
+    const dupes_file_t *x = a, *y = b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    return memcmp(x->full, y->full, sizeof(x->full));
+}
+
+// Keep the files that are equal, by 'cmp', to a neighbour in the sorted
+// list (and haven't failed); free the rest
+static void keep_runs(file_list_t *l, int (*cmp)(const void *, const void *)) {
+    size_t kept = 0;
+    for (size_t i = 0; i < l->used; i++) {
+        dupes_file_t *f = &l->arr[i];
+        int twin = !f->failed &&
+                   ((i > 0 && !l->arr[i - 1].failed && cmp(&l->arr[i - 1], f) == 0) ||
+                    (i + 1 < l->used && !l->arr[i + 1].failed && cmp(f, &l->arr[i + 1]) == 0));
+        if (twin) {
+            l->arr[kept++] = *f;
+        } else {
+            free(f->path);
+        }
+    }
+    l->used = kept;
+}
+
+// After the walk: one name per inode (hard links aren't duplicates, they
+// are the same file), then only sizes that occur more than once
+static void pick_by_size(dupes_t *d) {
+    file_list_t *l = &d->files;
+    qsort(l->arr, l->used, sizeof(dupes_file_t), cmp_inode);
+    size_t kept = 0;
+    for (size_t i = 0; i < l->used; i++) {
+        if (kept > 0 && l->arr[kept - 1].dev == l->arr[i].dev && l->arr[kept - 1].ino == l->arr[i].ino) {
+            free(l->arr[i].path);
+            continue;
+        }
+        l->arr[kept++] = l->arr[i];
+    }
+    l->used = kept;
+
+    qsort(l->arr, l->used, sizeof(dupes_file_t), cmp_size);
+    keep_runs(l, cmp_size);
+}
+
+// Files sorted by 'cmp' into groups of two or more; the biggest waste first
+static int cmp_group(const void *a, const void *b) {
+    const dupes_group_t *x = a, *y = b;
+    unsigned long long wx = x->size * (x->count - 1), wy = y->size * (y->count - 1);
+    if (wx != wy) return wx > wy ? -1 : 1;
+    return strcmp(x->paths[0], y->paths[0]);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void build_groups(dupes_t *d) {
+    file_list_t *l = &d->files;
+    qsort(l->arr, l->used, sizeof(dupes_file_t), cmp_full);
+    keep_runs(l, cmp_full);
+
+    size_t cap = 0;
+    for (size_t i = 0; i < l->used;) {
+        size_t j = i + 1;
+        while (j < l->used && cmp_full(&l->arr[i], &l->arr[j]) == 0) j++;
+        if (d->ngroups == cap) {
+            cap = cap ? cap * 2 : 64;
+            d->groups = realloc(d->groups, cap * sizeof(dupes_group_t));
+            if (!d->groups) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        dupes_group_t *g = &d->groups[d->ngroups++];
+        g->size = (unsigned long long)l->arr[i].size;
+        g->count = j - i;
+        g->paths = malloc(g->count * sizeof(char *));
+        if (!g->paths) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t k = i; k < j; k++) {
+            g->paths[k - i] = l->arr[k].path;  // Still owned by the file list
+        }
+        qsort(g->paths, g->count, sizeof(char *), cmp_str);
+        i = j;
+    }
+    qsort(d->groups, d->ngroups, sizeof(dupes_group_t), cmp_group);
+}
+
+// ---- Hashing ----
+
+// Read exactly 'n' bytes at 'off'. Returns -1 on errors and short reads.
+static int read_at(int fd, void *buf, size_t n, off_t off) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = pread(fd, (char *)buf + got, n - got, off + (off_t)got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        got += (size_t)r;
+    }
+    return 0;
+}
+
+// Open a file found by the walk, if it is still that file at that size
+static int open_same(dupes_file_t *f) {
+    int fd = open(f->path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    struct stat st;
+    if (fd >= 0 && (fstat(fd, &st) != 0 || st.st_dev != f->dev || st.st_ino != f->ino ||
+                    st.st_size != f->size)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Phase 2: hash both ends of the file. Small files are read whole, which
+// settles them right here.
+static void hash_edges(dupes_t *d, dupes_file_t *f, unsigned char *buf) {
+    int fd = open_same(f);
+    if (fd < 0) {
+        f->failed = 1;
+        return;
+    }
+    size_t size = (size_t)f->size;
+    size_t n = size <= 2 * EDGE_SIZE ? size : 2 * EDGE_SIZE;
+    if (size <= 2 * EDGE_SIZE) {
+        f->failed = read_at(fd, buf, size, 0) != 0;
+    } else {
+        f->failed = read_at(fd, buf, EDGE_SIZE, 0) != 0 ||
+                    read_at(fd, buf + EDGE_SIZE, EDGE_SIZE, f->size - EDGE_SIZE) != 0;
+    }
+    close(fd);
+    if (f->failed) return;
+    atomic_fetch_add_explicit(&d->bytes, n, memory_order_relaxed);
+
+    xxh64_t x;
+    xxh64_init(&x);
+    xxh64_update(&x, buf, n);
+    f->partial = xxh64_final(&x);
+    if (size <= 2 * EDGE_SIZE) {
+        sha256_t s;
+        sha256_init(&s);
+        sha256_update(&s, buf, n);
+        sha256_final(&s, f->full);
+        f->have_full = 1;
+    }
+}
+
+// Phase 3: hash the whole file
+static void hash_full(dupes_t *d, dupes_file_t *f, unsigned char *buf) {
+    int fd = open_same(f);
+    if (fd < 0) {
+        f->failed = 1;
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    sha256_t s;
+    sha256_init(&s);
+    off_t total = 0;
+    while (!cancelled(d)) {
+        ssize_t r = read(fd, buf, READ_BUF_SIZE);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        sha256_update(&s, buf, (size_t)r);
+        total += r;
+        atomic_fetch_add_explicit(&d->bytes, (unsigned long long)r, memory_order_relaxed);
+    }
+    if (f->size >= (off_t)DROP_CACHE_MIN) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    if (total != f->size) {  // Error, cancelled, or the file changed
+        f->failed = 1;
+        return;
+    }
+    sha256_final(&s, f->full);
+    f->have_full = 1;
+}
+
+// Share out the files of a hashing phase one at a time
+static void hash_phase(dupes_t *d, int full, unsigned char *buf) {
+    size_t i;
+    while (!cancelled(d) && (i = atomic_fetch_add(&d->next, 1)) < d->files.used) {
+        dupes_file_t *f = &d->files.arr[i];
+        if (full) {
+            if (f->have_full) continue;
+            hash_full(d, f, buf);
+        } else {
+            hash_edges(d, f, buf);
+        }
+        atomic_fetch_add_explicit(&d->hashed, 1, memory_order_relaxed);
+    }
+}
+
+// Set up the next hashing phase (one thread)
+static void start_phase(dupes_t *d, dupes_phase_t phase) {
+    unsigned long n = 0;
+    for (size_t i = 0; i < d->files.used; i++) {
+        n += (phase == DUPES_PARTIAL || !d->files.arr[i].have_full);
+    }
+    atomic_store(&d->candidates, n);
+    atomic_store(&d->hashed, 0);
+    atomic_store(&d->next, 0);
+    atomic_store(&d->phase, phase);
+}
+
+static void *dupes_worker_init(void *ctx) {
+    (void)ctx;
+    unsigned char *buf = malloc(READ_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return buf;
+}
+
+static void dupes_visit(void *ctx, void *state, const walk_item_t *item) {
+    dupes_t *d = ctx;
+    if (item->kind == ITEM_HASH) {
+        hash_phase(d, atomic_load(&d->phase) == DUPES_FULL, state);
+    } else if (!cancelled(d)) {
+        read_folder(d, item->path);
+    }
+}
+
+static void dupes_worker_done(void *ctx, void *state) {
+    (void)ctx;
+    free(state);
+}
+
+// Every worker is done with a phase (one thread): narrow the list down
+// and give each worker a turn at the next phase
+static void dupes_drained(void *ctx) {
+    dupes_t *d = ctx;
+    switch ((dupes_phase_t)atomic_load(&d->phase)) {
+        case DUPES_WALKING:
+            pick_by_size(d);
+            start_phase(d, DUPES_PARTIAL);
+            break;
+        case DUPES_PARTIAL:
+            qsort(d->files.arr, d->files.used, sizeof(dupes_file_t), cmp_partial);
+            keep_runs(&d->files, cmp_partial);
+            start_phase(d, DUPES_FULL);
+            break;
+        default:
+            if (!cancelled(d)) build_groups(d);
+            return;  // That was the last phase
+    }
+    for (int i = walk_workers(d->walk); i > 0; i--) {
+        walk_push(d->walk, ITEM_HASH, NULL, NULL, 0);
+    }
+}
+
+// The run is over: wake dupes_wait() and the UI
+static void dupes_finished(void *ctx) {
+    dupes_t *d = ctx;
+    pthread_mutex_lock(&d->lock);
+    atomic_store(&d->phase, DUPES_DONE);
+    pthread_cond_broadcast(&d->done_cond);
+    pthread_mutex_unlock(&d->lock);
+    if (d->notify) d->notify();
+}
+
+static const walk_ops_t dupes_ops = {
+    .worker_init = dupes_worker_init,
+    .visit = dupes_visit,
+    .worker_done = dupes_worker_done,
+    .drained = dupes_drained,
+    .finished = dupes_finished,
+};
+
+// Start looking for duplicates below 'root'
+dupes_t *dupes_start(const char *root, int include_hidden, void (*notify)(void),
+                     char *err, size_t errsz) {
+    dupes_t *d = calloc(1, sizeof(*d));
+    if (!d) {
+        snprintf(err, errsz, "out of memory");
+        return NULL;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->done_cond, NULL);
+    d->include_hidden = include_hidden;
+    d->notify = notify;
+    d->walk = walk_create(walk_threads(), &dupes_ops, d);
+    walk_push(d->walk, ITEM_DIR, root, NULL, 0);
+    if (walk_start(d->walk) != 0) {
+        snprintf(err, errsz, "can't start duplicate finder threads");
+        dupes_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+// Is the run still going?
+int dupes_running(dupes_t *d) {
+    return walk_running(d->walk);
+}
+
+// Block until the run is over
+void dupes_wait(dupes_t *d) {
+    pthread_mutex_lock(&d->lock);
+    while (walk_running(d->walk)) {
+        pthread_cond_wait(&d->done_cond, &d->lock);
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Totals so far (for progress)
+void dupes_get_progress(dupes_t *d, dupes_progress_t *out) {
+    out->phase = (dupes_phase_t)atomic_load(&d->phase);
+    out->dirs = atomic_load_explicit(&d->dirs, memory_order_relaxed);
+    out->files = atomic_load_explicit(&d->found, memory_order_relaxed);
+    out->candidates = atomic_load_explicit(&d->candidates, memory_order_relaxed);
+    out->hashed = atomic_load_explicit(&d->hashed, memory_order_relaxed);
+    out->bytes = atomic_load_explicit(&d->bytes, memory_order_relaxed);
+}
+
+const dupes_group_t *dupes_groups(dupes_t *d, size_t *count) {
+    if (dupes_running(d)) {
+        *count = 0;
+        return NULL;
+    }
+    *count = d->ngroups;
+    return d->groups;
+}
+
+// Stop the run; no groups are reported for a stopped run
+void dupes_cancel(dupes_t *d) {
+    atomic_store(&d->cancel, 1);
+}
+
+// Stop the run, wait for the workers and free everything
+void dupes_free(dupes_t *d) {
+    if (!d) return;
+    dupes_cancel(d);
+    walk_free(d->walk);
+    for (size_t i = 0; i < d->files.used; i++) {
+        free(d->files.arr[i].path);
+    }
+    free(d->files.arr);
+    for (size_t i = 0; i < d->ngroups; i++) {
+        free(d->groups[i].paths);
+    }
+    free(d->groups);
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->done_cond);
+    free(d);
+}
@@ -0,0 +1,52 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include <stddef.h>
+
+// A set of files with the same contents
+typedef struct {
+    unsigned long long size;    // Of each file
+    size_t count;
+    char **paths;               // Sorted
+} dupes_group_t;
+
+// What a run is doing
+typedef enum {
+    DUPES_WALKING,              // Listing files and their sizes
+    DUPES_PARTIAL,              // Hashing the first and last 4 KiB of same-size files
+    DUPES_FULL,                 // Hashing whole files that still look alike
+    DUPES_DONE
+} dupes_phase_t;
+
+// Running totals
+typedef struct {
+    dupes_phase_t phase;
+    unsigned long dirs;             // Folders read
+    unsigned long files;            // Files found
+    unsigned long candidates;       // Files the current phase hashes...
+    unsigned long hashed;           // ...and how many of them are done
+    unsigned long long bytes;       // Bytes read for hashing
+} dupes_progress_t;
+
+typedef struct dupes dupes_t;
+
+// Find files with identical contents below 'root' with several worker
+// threads. Only files whose size matches another file's are read, and of
+// those only the ones whose first and last 4 KiB match are read in full,
+// so most of a tree is never opened. Names of one file (hard links) count
+// once; empty files, symlinks and other non-regular files are left out.
+// 'notify' (e.g. events_wakeup, or NULL) is called from a worker when the
+// run is over. Returns NULL with a message in 'err' if no thread could be
+// started.
+dupes_t *dupes_start(const char *root, int include_hidden, void (*notify)(void),
+                     char *err, size_t errsz);
+int dupes_running(dupes_t *d);
+void dupes_get_progress(dupes_t *d, dupes_progress_t *out);
+void dupes_wait(dupes_t *d);
+// The groups found, most space wasted first. Empty until the run is over
+// (and after a cancelled run). Owned by the run.
+const dupes_group_t *dupes_groups(dupes_t *d, size_t *count);
+void dupes_cancel(dupes_t *d);
+void dupes_free(dupes_t *d);
+
+#endif
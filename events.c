@@ -0,0 +1,147 @@
+#define _GNU_SOURCE  // epoll, signalfd, timerfd, eventfd and inotify are Linux APIs
+
+#include "events.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+// One epoll set holding every source the UI reacts to
+typedef struct {
+    int epfd;       // epoll instance
+    int sigfd;      // signalfd for SIGWINCH
+    int timerfd;    // Periodic work (progress updates etc.)
+    int wakefd;     // eventfd workers write to when they finish something
+    int inotifyfd;  // Watches the file being followed, and its folder
+    int file_wd, dir_wd;
+    sigset_t old_mask;
+} events_t;
+
+static events_t ev = { -1, -1, -1, -1, -1, -1, -1, {{0}} };
+
+// Register one fd with epoll, tagging it with its event bit
+static int watch_fd(int fd, event_mask_t tag) {
+    struct epoll_event e = { .events = EPOLLIN, .data.u32 = tag };
+    return epoll_ctl(ev.epfd, EPOLL_CTL_ADD, fd, &e);
+}
+
+// Set up the epoll set. SIGWINCH is blocked and read through a signalfd
+// instead of a handler, so a resize wakes the loop like any other event.
+int events_init(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    if (sigprocmask(SIG_BLOCK, &mask, &ev.old_mask) != 0) {
+        perror("sigprocmask");
+        return -1;
+    }
+
+    ev.epfd = epoll_create1(EPOLL_CLOEXEC);
+    ev.sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    ev.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ev.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ev.epfd < 0 || ev.sigfd < 0 || ev.timerfd < 0 || ev.wakefd < 0 || ev.inotifyfd < 0) {
+        perror("events_init");
+        events_free();
+        return -1;
+    }
+
+    if (watch_fd(STDIN_FILENO, EV_INPUT) != 0 ||
+        watch_fd(ev.sigfd, EV_RESIZE) != 0 ||
+        watch_fd(ev.timerfd, EV_TIMER) != 0 ||
+        watch_fd(ev.wakefd, EV_WAKEUP) != 0 ||
+        watch_fd(ev.inotifyfd, EV_FILE) != 0) {
+        perror("epoll_ctl");
+        events_free();
+        return -1;
+    }
+    return 0;
+}
+
+// Close everything and restore the signal mask
+void events_free(void) {
+    int *fds[] = { &ev.epfd, &ev.sigfd, &ev.timerfd, &ev.wakefd, &ev.inotifyfd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) close(*fds[i]);
+        *fds[i] = -1;
+    }
+    ev.file_wd = ev.dir_wd = -1;
+    sigprocmask(SIG_SETMASK, &ev.old_mask, NULL);
+}
+
+// Drain an fd (signalfd, timerfd, eventfd, inotify) so it stops polling
+// ready. The buffer must hold a whole inotify event with its name.
+static void drain_fd(int fd) {
+    char buf[4096] __attribute__((aligned(8)));
+    while (read(fd, buf, sizeof(buf)) > 0) { }
+}
+
+// Block until something happens (or timeout_ms passes, -1 = forever).
+// Returns a mask of event_mask_t bits; stdin is left for the caller to read.
+int events_wait(int timeout_ms) {
+    struct epoll_event events[8];
+    int n;
+    do {
+        n = epoll_wait(ev.epfd, events, 8, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+
+    int mask = 0;
+    for (int i = 0; i < n; i++) {
+        mask |= (int)events[i].data.u32;
+    }
+    if (mask & EV_RESIZE) drain_fd(ev.sigfd);
+    if (mask & EV_TIMER)  drain_fd(ev.timerfd);
+    if (mask & EV_WAKEUP) drain_fd(ev.wakefd);
+    if (mask & EV_FILE)   drain_fd(ev.inotifyfd);
+    return mask;
+}
+
+// Fire EV_TIMER every interval_ms milliseconds (0 turns the timer off)
+void events_set_timer(int interval_ms) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(ev.timerfd, 0, &its, NULL);
+}
+
+// Wake the main loop from any thread (async-signal-safe, just a write)
+void events_wakeup(void) {
+    uint64_t one = 1;
+    if (ev.wakefd >= 0) {
+        ssize_t r = write(ev.wakefd, &one, sizeof(one));
+        (void)r;  // Counter already non-zero is fine - the loop wakes anyway
+    }
+}
+
+// Report EV_FILE when 'path' is written to, truncated or moved away, or
+// when a file appears in its folder (a rotated log being recreated).
+// Replaces any earlier watch. Returns -1 with errno set on failure.
+int events_watch_file(const char *path) {
+    events_unwatch_file();
+    ev.file_wd = inotify_add_watch(ev.inotifyfd, path,
+                                   IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    if (ev.file_wd < 0) return -1;
+
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+    snprintf(dir, sizeof(dir), "%.*s", slash && slash > path ? (int)(slash - path) : 1,
+             slash ? path : ".");
+    ev.dir_wd = inotify_add_watch(ev.inotifyfd, dir, IN_CREATE | IN_MOVED_TO);
+    return 0;  // Without the folder watch we still see writes and truncation
+}
+
+void events_unwatch_file(void) {
+    if (ev.file_wd >= 0) inotify_rm_watch(ev.inotifyfd, ev.file_wd);
+    if (ev.dir_wd >= 0) inotify_rm_watch(ev.inotifyfd, ev.dir_wd);
+    ev.file_wd = ev.dir_wd = -1;
+}
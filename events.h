@@ -0,0 +1,21 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+// Event sources the main loop waits on (bit mask returned by events_wait)
+typedef enum {
+    EV_INPUT  = 1 << 0,  // stdin has bytes
+    EV_RESIZE = 1 << 1,  // SIGWINCH arrived (via signalfd)
+    EV_TIMER  = 1 << 2,  // Periodic timer fired
+    EV_WAKEUP = 1 << 3,  // A background worker posted a completion
+    EV_FILE   = 1 << 4   // The watched file (or its folder) changed (via inotify)
+} event_mask_t;
+
+int events_init(void);
+void events_free(void);
+int events_wait(int timeout_ms);
+void events_set_timer(int interval_ms);
+void events_wakeup(void);
+int events_watch_file(const char *path);
+void events_unwatch_file(void);
+
+#endif
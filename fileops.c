@@ -0,0 +1,1130 @@
+#define _GNU_SOURCE  // copy_file_range() and sendfile() are Linux APIs
+
+#include "fileops.h"
+#include "pool.h"
+#include "walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/fs.h>  // FICLONE
+
+// Has the UI asked us to stop? Sets errno so callers can report it.
+static int cancelled(fileop_progress_t *p) {
+    if (p && atomic_load_explicit(&p->cancel, memory_order_relaxed)) {
+        errno = ECANCELED;
+        return 1;
+    }
+    return 0;
+}
+
+// Start all counters at zero
+void fileop_progress_init(fileop_progress_t *p) {
+    atomic_init(&p->bytes_done, 0);
+    atomic_init(&p->bytes_total, 0);
+    atomic_init(&p->bytes_alloc, 0);
+    atomic_init(&p->files_done, 0);
+    atomic_init(&p->files_total, 0);
+    atomic_init(&p->cancel, 0);
+    atomic_init(&p->errors, 0);
+    pthread_mutex_init(&p->err_lock, NULL);
+    p->err_head = p->err_tail = NULL;
+}
+
+// Free the error list
+void fileop_progress_destroy(fileop_progress_t *p) {
+    fileop_error_t *e = p->err_head;
+    while (e) {
+        fileop_error_t *next = e->next;
+        free(e->path);
+        free(e);
+        e = next;
+    }
+    p->err_head = p->err_tail = NULL;
+    pthread_mutex_destroy(&p->err_lock);
+}
+
+// Note a failed entry and carry on with the rest (thread-safe)
+void fileop_record_error(fileop_progress_t *p, const char *path, int err) {
+    unsigned long n = atomic_fetch_add(&p->errors, 1);
+    if (n >= FILEOP_MAX_ERRORS) return;  // Count it, but don't keep it
+
+    fileop_error_t *e = malloc(sizeof(*e));
+    if (!e) return;
+    e->path = strdup(path);
+    if (!e->path) {
+        free(e);
+        return;
+    }
+    e->err = err;
+    e->next = NULL;
+
+    pthread_mutex_lock(&p->err_lock);
+    if (p->err_tail) p->err_tail->next = e;
+    else p->err_head = e;
+    p->err_tail = e;
+    pthread_mutex_unlock(&p->err_lock);
+}
+
+// A scan: its walk over the directories, and the totals it adds to
+typedef struct {
+    walk_t *walk;
+    fileop_progress_t *p;
+} scan_t;
+
+// Read one directory: count its files and bytes, queue its subdirectories.
+// Totals are added once per directory to keep the counters uncontended.
+static void scan_one_dir(scan_t *q, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    unsigned long files = 0;
+    unsigned long long bytes = 0, alloc = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && !cancelled(q->p)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        // d_type spares a stat() for directories and special files;
+        // regular files still need one for their size
+        int type = entry->d_type;
+        struct stat st;
+        if (type == DT_REG || type == DT_UNKNOWN) {
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR) {
+            char child[PATH_MAX];
+            if ((size_t)snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) < sizeof(child)) {
+                walk_push(q->walk, 0, child, NULL, 0);
+            }
+            continue;
+        }
+        files++;
+        if (type == DT_REG) {
+            bytes += (unsigned long long)st.st_size;
+            alloc += (unsigned long long)st.st_blocks * 512;
+        }
+    }
+    closedir(dir);
+
+    atomic_fetch_add_explicit(&q->p->files_total, files, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->p->bytes_total, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->p->bytes_alloc, alloc, memory_order_relaxed);
+}
+
+static void scan_visit(void *ctx, void *state, const walk_item_t *item) {
+    scan_t *q = ctx;
+    (void)state;
+    if (!cancelled(q->p)) scan_one_dir(q, item->path);
+}
+
+static const walk_ops_t scan_ops = { .visit = scan_visit };
+
+// Add the files and bytes under each of 'paths' to the progress totals.
+// Directories are read by several threads at once: on big trees the
+// scan is bound by metadata latency, not CPU, so parallel reads help.
+void fileop_scan(char *const *paths, size_t count, fileop_progress_t *p) {
+    scan_t q = { NULL, p };
+
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        if (lstat(paths[i], &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (!q.walk) q.walk = walk_create(pool_default_threads(), &scan_ops, &q);
+            walk_push(q.walk, 0, paths[i], NULL, 0);
+        } else {
+            atomic_fetch_add_explicit(&p->files_total, 1, memory_order_relaxed);
+            if (S_ISREG(st.st_mode)) {
+                atomic_fetch_add_explicit(&p->bytes_total, (unsigned long long)st.st_size,
+                                          memory_order_relaxed);
+                atomic_fetch_add_explicit(&p->bytes_alloc, (unsigned long long)st.st_blocks * 512,
+                                          memory_order_relaxed);
+            }
+        }
+    }
+    if (!q.walk) return;
+
+    walk_run(q.walk);
+    walk_free(q.walk);
+}
+
+// Result of a copy strategy that may not be available for this pair of files
+#define COPY_UNSUPPORTED 1
+
+// Biggest chunk handed to the kernel per call, so progress and cancel
+// stay responsive even when whole files are copied in-kernel
+#define KERNEL_CHUNK (8u << 20)
+
+// Fallback read/write buffer size
+#define RW_BUFFER_SIZE (1u << 20)
+
+// Streaming mode: chunk size and the alignment O_DIRECT buffers need
+#define STREAM_CHUNK (8u << 20)
+#define DIRECT_ALIGN 4096
+
+// Default: stream big files through the page cache
+static fileop_config_t config = { FILEOP_STREAM_THRESHOLD, 0 };
+
+// Set the copy engine tunables (call before starting any copies)
+void fileop_configure(const fileop_config_t *cfg) {
+    config = *cfg;
+}
+
+// Did a copy syscall fail because it can't handle these files (as
+// opposed to a real I/O error)? Only meaningful before any data moved.
+static int not_supported(int err) {
+    return err == EXDEV || err == EINVAL || err == ENOSYS ||
+           err == EOPNOTSUPP || err == ENOTSUP || err == EBADF;
+}
+
+// Count copied bytes and check for cancellation between chunks
+static int chunk_done(fileop_progress_t *p, size_t n) {
+    if (p) {
+        atomic_fetch_add_explicit(&p->bytes_done, n, memory_order_relaxed);
+    }
+    return cancelled(p) ? -1 : 0;
+}
+
+// In-kernel copy: no data crosses into user space, and filesystems that
+// support it (NFS 4.2, SMB, btrfs, XFS) can copy server-side or share extents
+static int copy_range(int in, int out, fileop_progress_t *p) {
+    off_t copied = 0;
+    for (;;) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, KERNEL_CHUNK, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (copied == 0 && not_supported(errno)) ? COPY_UNSUPPORTED : -1;
+        }
+        if (n == 0) return 0;
+        copied += n;
+        if (chunk_done(p, (size_t)n) != 0) return -1;
+    }
+}
+
+// sendfile(): still in-kernel (page cache to page cache), works across
+// filesystems where copy_file_range() refuses
+static int copy_sendfile(int in, int out, fileop_progress_t *p) {
+    off_t copied = 0;
+    for (;;) {
+        ssize_t n = sendfile(out, in, NULL, KERNEL_CHUNK);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (copied == 0 && not_supported(errno)) ? COPY_UNSUPPORTED : -1;
+        }
+        if (n == 0) return 0;
+        copied += n;
+        if (chunk_done(p, (size_t)n) != 0) return -1;
+    }
+}
+
+// Last resort: plain read()/write() through a large buffer
+static int copy_rw(int in, int out, fileop_progress_t *p) {
+    char *buffer = malloc(RW_BUFFER_SIZE);
+    if (!buffer) return -1;
+
+    int result = 0;
+    for (;;) {
+        ssize_t n = read(in, buffer, RW_BUFFER_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (n == 0) break;
+
+        // write() may take less than we asked for
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buffer + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                result = -1;
+                break;
+            }
+            off += w;
+        }
+        if (result != 0 || chunk_done(p, (size_t)n) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+// Copy 'len' bytes at offset 'off' from 'in' to the same offset in 'out'.
+// Positioned I/O only, so the file offsets don't matter.
+static int copy_segment(int in, int out, off_t off, off_t len, fileop_progress_t *p) {
+    off_t in_off = off, out_off = off, end = off + len;
+    int use_range = 1;
+    char *buffer = NULL;
+    int result = 0;
+
+    while (in_off < end) {
+        size_t want = (size_t)(end - in_off) < KERNEL_CHUNK ? (size_t)(end - in_off) : KERNEL_CHUNK;
+        ssize_t n;
+        if (use_range) {
+            n = copy_file_range(in, &in_off, out, &out_off, want, 0);
+            if (n < 0 && errno != EINTR && not_supported(errno)) {
+                use_range = 0;  // Fall back to pread()/pwrite() for this file
+                continue;
+            }
+        } else {
+            if (!buffer && !(buffer = malloc(RW_BUFFER_SIZE))) {
+                result = -1;
+                break;
+            }
+            if (want > RW_BUFFER_SIZE) want = RW_BUFFER_SIZE;
+            n = pread(in, buffer, want, in_off);
+            for (ssize_t done = 0; n > 0 && done < n; ) {
+                ssize_t w = pwrite(out, buffer + done, (size_t)(n - done), out_off + done);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    n = -1;
+                    break;
+                }
+                done += w;
+            }
+            if (n > 0) {
+                in_off += n;
+                out_off += n;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (n == 0) break;  // File shrank under us
+        if (chunk_done(p, (size_t)n) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+// Copy only the data extents of a sparse file, found with
+// SEEK_DATA/SEEK_HOLE. The destination is sized up front with
+// ftruncate(), so every range we skip stays a hole on disk.
+static int copy_sparse(int in, int out, const struct stat *st, fileop_progress_t *p) {
+    off_t size = st->st_size;
+    off_t off = 0;
+
+    off_t data = lseek(in, 0, SEEK_DATA);
+    if (data < 0 && errno != ENXIO) {
+        return COPY_UNSUPPORTED;  // Filesystem can't report holes
+    }
+    if (ftruncate(out, size) != 0) return -1;
+
+    while (off < size) {
+        data = lseek(in, off, SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) data = size;  // Only a hole is left
+            else return -1;
+        }
+        if (data > size) data = size;
+        if (chunk_done(p, (size_t)(data - off)) != 0) return -1;  // Skipped hole
+        if (data >= size) break;
+
+        off_t hole = lseek(in, data, SEEK_HOLE);
+        if (hole < 0 || hole > size) hole = size;
+        if (copy_segment(in, out, data, hole - data, p) != 0) return -1;
+        off = hole;
+    }
+    return 0;
+}
+
+// Try to switch an open fd to O_DIRECT (fails on tmpfs and friends)
+static int set_direct(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return -1;
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags);
+}
+
+// Copy one chunk at 'off' through an aligned buffer. With O_DIRECT on
+// 'out', an unaligned tail is written after switching O_DIRECT off.
+static ssize_t stream_chunk_rw(int in, int out, char *buf, off_t off, int *direct) {
+    ssize_t n;
+    do {
+        n = pread(in, buf, STREAM_CHUNK, off);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return n;
+
+    if (*direct && n % DIRECT_ALIGN != 0) {
+        set_direct(out, 0);
+        *direct = 0;
+    }
+    for (ssize_t done = 0; done < n; ) {
+        ssize_t w = pwrite(out, buf + done, (size_t)(n - done), off + done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += w;
+    }
+    return n;
+}
+
+// Streaming copy for big files: read-ahead hint on the source, and as
+// each chunk is written its writeback is started, the previous chunk is
+// waited for, and both sides are dropped from the page cache. Dirty
+// pages stay bounded to about two chunks and the copy doesn't evict the
+// rest of the system's working set.
+static int copy_streaming(int in, int out, const struct stat *st, fileop_progress_t *p) {
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int direct = 0;
+    if (config.direct_io && set_direct(in, 1) == 0) {
+        if (set_direct(out, 1) == 0) direct = 1;
+        else set_direct(in, 0);
+    }
+
+    char *buf = NULL;
+    int use_range = !direct;  // In-kernel copy unless O_DIRECT needs our buffer
+    off_t off = 0, prev_off = 0;
+    size_t prev_len = 0;
+    int result = 0;
+
+    while (off < st->st_size) {
+        ssize_t n = -1;
+        if (use_range) {
+            off_t in_off = off, out_off = off;
+            n = copy_file_range(in, &in_off, out, &out_off, STREAM_CHUNK, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && off == 0 && not_supported(errno)) {
+                use_range = 0;
+                continue;
+            }
+        } else {
+            if (!buf && posix_memalign((void **)&buf, DIRECT_ALIGN, STREAM_CHUNK) != 0) {
+                buf = NULL;
+                errno = ENOMEM;
+                result = -1;
+                break;
+            }
+            n = stream_chunk_rw(in, out, buf, off, &direct);
+        }
+        if (n < 0) {
+            result = -1;
+            break;
+        }
+        if (n == 0) break;  // File shrank under us
+
+        // Kick off writeback of this chunk, finish the previous one and
+        // let the cache forget both sides of it
+        sync_file_range(out, off, n, SYNC_FILE_RANGE_WRITE);
+        if (prev_len > 0) {
+            sync_file_range(out, prev_off, prev_len, SYNC_FILE_RANGE_WAIT_BEFORE |
+                            SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(out, prev_off, prev_len, POSIX_FADV_DONTNEED);
+        }
+        posix_fadvise(in, off, n, POSIX_FADV_DONTNEED);
+        prev_off = off;
+        prev_len = (size_t)n;
+        off += n;
+
+        if (chunk_done(p, (size_t)n) != 0) {
+            result = -1;
+            break;
+        }
+    }
+
+    // Last chunk: flush and drop it too
+    if (prev_len > 0) {
+        int saved = errno;
+        sync_file_range(out, prev_off, prev_len, SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(out, prev_off, prev_len, POSIX_FADV_DONTNEED);
+        errno = saved;
+    }
+    if (direct) set_direct(out, 0);
+    free(buf);
+    return result;
+}
+
+// Copy the contents of 'in' to 'out' using the fastest method that works:
+// reflink, hole-preserving extent copy for sparse files, streaming for
+// big files, copy_file_range(), sendfile(), then read()/write()
+static int copy_data(int in, int out, const struct stat *st, fileop_progress_t *p) {
+#ifdef FICLONE
+    // Reflink (btrfs, XFS, ...): the copy shares the source's extents
+    if (ioctl(out, FICLONE, in) == 0) {
+        return chunk_done(p, (size_t)st->st_size);
+    }
+#endif
+
+    // Fewer blocks allocated than the size needs: there are holes to keep
+    if (S_ISREG(st->st_mode) && st->st_size > 0 &&
+        (off_t)st->st_blocks * 512 < st->st_size) {
+        int r = copy_sparse(in, out, st, p);
+        if (r != COPY_UNSUPPORTED) return r;
+    }
+
+    // Big dense files: stream without polluting the page cache
+    if (S_ISREG(st->st_mode) && config.stream_threshold > 0 &&
+        st->st_size >= config.stream_threshold) {
+        return copy_streaming(in, out, st, p);
+    }
+
+    // Files like those in /proc report size 0 but still have data;
+    // only the read()/write() loop copies them correctly
+    if (st->st_size > 0) {
+        int r = copy_range(in, out, p);
+        if (r != COPY_UNSUPPORTED) return r;
+        r = copy_sendfile(in, out, p);
+        if (r != COPY_UNSUPPORTED) return r;
+    }
+    return copy_rw(in, out, p);
+}
+
+// Copy one file, keeping its permission bits
+int copy_file(const char *src, const char *dst, fileop_progress_t *p) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        int saved = errno;
+        close(in);
+        errno = saved;
+        return -1;
+    }
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+    if (out < 0) {
+        int saved = errno;
+        close(in);
+        errno = saved;
+        return -1;
+    }
+
+    int success = copy_data(in, out, &st, p);
+
+    int saved = errno;  // close() must not hide why the copy failed
+    close(in);
+    if (close(out) != 0 && success == 0) {
+        saved = errno;
+        success = -1;  // Delayed write error (e.g. NFS, full disk)
+    }
+    errno = saved;
+    if (success == 0 && p) {
+        atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+    }
+    return success;
+}
+
+// Tasks the directory walker may queue ahead of the copy workers
+#define TREE_QUEUE_DEPTH 1024
+
+// One file for a worker to copy (paths live in the same allocation)
+typedef struct {
+    fileop_progress_t *p;
+    char *src;
+    char *dst;
+} copy_task_t;
+
+// Pool task: copy one file and record (not propagate) any failure
+static void copy_task_run(void *arg) {
+    copy_task_t *t = arg;
+    if (!cancelled(t->p) && copy_file(t->src, t->dst, t->p) != 0 && errno != ECANCELED) {
+        fileop_record_error(t->p, t->src, errno);
+    }
+    free(t);
+}
+
+// Build "dir/name" into buf (caller checked it fits in PATH_MAX)
+static void join_path(char *buf, const char *dir, const char *name) {
+    size_t dl = strlen(dir), nl = strlen(name);
+    memcpy(buf, dir, dl);
+    buf[dl] = '/';
+    memcpy(buf + dl + 1, name, nl + 1);
+}
+
+// Note a failed entry of 'dir' by its full path, or by 'dir' and "/…"
+// when the two don't fit in a path together
+static void record_entry_error(fileop_progress_t *p, const char *dir, const char *name, int err) {
+    char path[PATH_MAX];
+    if (strlen(dir) + strlen(name) + 2 <= PATH_MAX) {
+        join_path(path, dir, name);
+    } else {
+        snprintf(path, sizeof(path), "%s/…", dir);
+    }
+    fileop_record_error(p, path, err);
+}
+
+// Recreate a symlink instead of copying what it points to
+int copy_symlink(const char *src, const char *dst) {
+    char target[PATH_MAX];
+    ssize_t n = readlink(src, target, sizeof(target) - 1);
+    if (n < 0) return -1;
+    target[n] = '\0';
+    return symlink(target, dst);
+}
+
+// A copied directory whose mode is put back once the files are in it
+typedef struct copy_dir {
+    struct copy_dir *next;
+    mode_t mode;
+    char path[];
+} copy_dir_t;
+
+// Remember 'path' for its mode; newest first, so children come before
+// the parents they may be unable to reach once those are restored
+static void copy_dir_push(copy_dir_t **dirs, const char *path, mode_t mode, fileop_progress_t *p) {
+    size_t len = strlen(path) + 1;
+    copy_dir_t *d = malloc(sizeof(*d) + len);
+    if (!d) {
+        fileop_record_error(p, path, ENOMEM);  // It would keep the wrong mode
+        return;
+    }
+    d->mode = mode & 07777;
+    memcpy(d->path, path, len);
+    d->next = *dirs;
+    *dirs = d;
+}
+
+// Give every copied directory its source's mode and free the list
+static void copy_dirs_restore(copy_dir_t *dirs) {
+    while (dirs) {
+        copy_dir_t *next = dirs->next;
+        chmod(dirs->path, dirs->mode);
+        free(dirs);
+        dirs = next;
+    }
+}
+
+// Walk one directory: create subdirectories here, in order, before
+// anything is copied into them, and hand regular files to the pool
+static void copy_tree_walk(pool_t *pool, const char *src, const char *dst, fileop_progress_t *p,
+                           copy_dir_t **dirs) {
+    DIR *dir = opendir(src);
+    if (!dir) {
+        fileop_record_error(p, src, errno);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && !cancelled(p)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        size_t src_len = strlen(src) + strlen(entry->d_name) + 2;
+        size_t dst_len = strlen(dst) + strlen(entry->d_name) + 2;
+        if (src_len > PATH_MAX || dst_len > PATH_MAX) {
+            record_entry_error(p, src, entry->d_name, ENAMETOOLONG);
+            continue;
+        }
+        char src_path[PATH_MAX];
+        char dst_path[PATH_MAX];
+        join_path(src_path, src, entry->d_name);
+        join_path(dst_path, dst, entry->d_name);
+
+        struct stat st;
+        if (lstat(src_path, &st) != 0) {
+            fileop_record_error(p, src_path, errno);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            // Keep the owner able to write into it while we fill it
+            if (mkdir(dst_path, (st.st_mode & 0777) | S_IRWXU) != 0) {
+                fileop_record_error(p, src_path, errno);
+                continue;  // Skip the subtree, carry on with siblings
+            }
+            copy_dir_push(dirs, dst_path, st.st_mode, p);
+            copy_tree_walk(pool, src_path, dst_path, p, dirs);
+        } else if (S_ISLNK(st.st_mode)) {
+            if (copy_symlink(src_path, dst_path) != 0) {
+                fileop_record_error(p, src_path, errno);
+            } else {
+                atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            copy_task_t *t = malloc(sizeof(*t) + src_len + dst_len);
+            if (!t) {
+                fileop_record_error(p, src_path, ENOMEM);
+                continue;
+            }
+            t->p = p;
+            t->src = (char *)(t + 1);
+            t->dst = t->src + src_len;
+            memcpy(t->src, src_path, src_len);
+            memcpy(t->dst, dst_path, dst_len);
+            if (pool_submit(pool, copy_task_run, t) != 0) {
+                free(t);
+            }
+        } else {
+            // FIFOs and devices: opening them could block or read forever
+            fileop_record_error(p, src_path, ENOTSUP);
+        }
+    }
+    closedir(dir);
+}
+
+// Copy a directory tree. One thread walks the tree and creates the
+// directories; regular files are copied by a pool of workers fed from a
+// bounded queue. Failures are recorded per entry in 'p' and the copy
+// carries on; returns -1 (errno = first failure) if anything failed.
+int copy_directory(const char *src, const char *dst, fileop_progress_t *p) {
+    struct stat st;
+    if (stat(src, &st) != 0) return -1;
+    if (mkdir(dst, (st.st_mode & 0777) | S_IRWXU) != 0) return -1;
+
+    // Callers without progress reporting still need somewhere to keep errors
+    fileop_progress_t local;
+    if (!p) {
+        fileop_progress_init(&local);
+        p = &local;
+    }
+    unsigned long errors_before = atomic_load(&p->errors);
+
+    pool_t *pool = pool_create(pool_default_threads(), TREE_QUEUE_DEPTH);
+    if (!pool) {
+        if (p == &local) fileop_progress_destroy(&local);
+        errno = ENOMEM;
+        return -1;
+    }
+    // The workers may still be filling any folder until the pool is done,
+    // so the source modes go back on only then
+    copy_dir_t *dirs = NULL;
+    copy_dir_push(&dirs, dst, st.st_mode, p);
+    copy_tree_walk(pool, src, dst, p, &dirs);
+    pool_wait(pool);
+    pool_destroy(pool);
+    copy_dirs_restore(dirs);
+
+    int result = 0;
+    if (cancelled(p)) {
+        result = -1;
+    } else if (atomic_load(&p->errors) != errors_before) {
+        pthread_mutex_lock(&p->err_lock);
+        errno = p->err_head ? p->err_head->err : EIO;
+        pthread_mutex_unlock(&p->err_lock);
+        result = -1;
+    }
+    if (p == &local) {
+        int saved = errno;
+        fileop_progress_destroy(&local);
+        errno = saved;
+    }
+    return result;
+}
+
+// Give the copy the source's timestamps, as rename() would have kept them
+static void copy_times(const char *dst, const struct stat *st) {
+    struct timespec times[2] = { st->st_atim, st->st_mtim };
+    utimensat(AT_FDCWD, dst, times, AT_SYMLINK_NOFOLLOW);
+}
+
+// Move one non-directory: copy it, check the copy is complete, then
+// unlink the source. The source is only removed once the copy is known good.
+static int move_one(const char *src, const char *dst, fileop_progress_t *p) {
+    struct stat st, dst_st;
+    if (lstat(src, &st) != 0) return -1;
+
+    if (S_ISLNK(st.st_mode)) {
+        if (copy_symlink(src, dst) != 0) return -1;
+        if (p) atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+    } else if (S_ISREG(st.st_mode)) {
+        if (copy_file(src, dst, p) != 0) return -1;
+        if (lstat(dst, &dst_st) != 0) return -1;
+        if (dst_st.st_size != st.st_size) {
+            errno = EIO;  // Source changed or the copy came up short
+            return -1;
+        }
+    } else {
+        errno = ENOTSUP;  // FIFOs and devices are left where they are
+        return -1;
+    }
+    copy_times(dst, &st);
+    return unlink(src);
+}
+
+// Bookkeeping for one directory of a move or delete: its file tasks
+// still in flight and whether anything in it failed
+typedef struct {
+    int pending;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} tree_dir_t;
+
+// A task for this directory is about to be queued
+static void tree_dir_add(tree_dir_t *dir) {
+    pthread_mutex_lock(&dir->lock);
+    dir->pending++;
+    pthread_mutex_unlock(&dir->lock);
+}
+
+// A task for this directory finished, with 'failed' entries left behind
+static void tree_dir_finish(tree_dir_t *dir, int failed) {
+    pthread_mutex_lock(&dir->lock);
+    dir->failed += failed;
+    if (--dir->pending == 0) pthread_cond_signal(&dir->done);
+    pthread_mutex_unlock(&dir->lock);
+}
+
+// Wait for the directory's tasks and return how many entries failed
+static int tree_dir_wait(tree_dir_t *dir) {
+    pthread_mutex_lock(&dir->lock);
+    while (dir->pending > 0) {
+        pthread_cond_wait(&dir->done, &dir->lock);
+    }
+    int failed = dir->failed;
+    pthread_mutex_unlock(&dir->lock);
+    pthread_mutex_destroy(&dir->lock);
+    pthread_cond_destroy(&dir->done);
+    return failed;
+}
+
+// One file for a worker to move
+typedef struct {
+    fileop_progress_t *p;
+    tree_dir_t *dir;
+    char *src;
+    char *dst;
+} move_task_t;
+
+// Pool task: move one file and report back to its directory
+static void move_task_run(void *arg) {
+    move_task_t *t = arg;
+    int failed = 0;
+    if (cancelled(t->p)) {
+        failed = 1;
+    } else if (move_one(t->src, t->dst, t->p) != 0) {
+        if (errno != ECANCELED) fileop_record_error(t->p, t->src, errno);
+        failed = 1;
+    }
+
+    tree_dir_finish(t->dir, failed);
+    free(t);
+}
+
+// Move the contents of directory 'src' into the existing directory 'dst'.
+// Subdirectories are finished (and removed) before their siblings are
+// started, so the extra space in use is bounded by the subtree in
+// progress, not the whole tree. Returns the number of entries that
+// stayed behind.
+static int move_tree_walk(pool_t *pool, const char *src, const char *dst, fileop_progress_t *p) {
+    DIR *d = opendir(src);
+    if (!d) {
+        fileop_record_error(p, src, errno);
+        return 1;
+    }
+
+    tree_dir_t dir = { 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    int failed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (cancelled(p)) {
+            failed++;
+            break;
+        }
+
+        size_t src_len = strlen(src) + strlen(entry->d_name) + 2;
+        size_t dst_len = strlen(dst) + strlen(entry->d_name) + 2;
+        if (src_len > PATH_MAX || dst_len > PATH_MAX) {
+            record_entry_error(p, src, entry->d_name, ENAMETOOLONG);
+            failed++;
+            continue;
+        }
+        char src_path[PATH_MAX];
+        char dst_path[PATH_MAX];
+        join_path(src_path, src, entry->d_name);
+        join_path(dst_path, dst, entry->d_name);
+
+        struct stat st;
+        if (lstat(src_path, &st) != 0) {
+            fileop_record_error(p, src_path, errno);
+            failed++;
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (mkdir(dst_path, (st.st_mode & 0777) | S_IRWXU) != 0) {
+                fileop_record_error(p, src_path, errno);
+                failed++;
+                continue;
+            }
+            failed += move_tree_walk(pool, src_path, dst_path, p);
+            continue;
+        }
+
+        move_task_t *t = malloc(sizeof(*t) + src_len + dst_len);
+        if (!t) {
+            fileop_record_error(p, src_path, ENOMEM);
+            failed++;
+            continue;
+        }
+        t->p = p;
+        t->dir = &dir;
+        t->src = (char *)(t + 1);
+        t->dst = t->src + src_len;
+        memcpy(t->src, src_path, src_len);
+        memcpy(t->dst, dst_path, dst_len);
+
+        tree_dir_add(&dir);
+        if (pool_submit(pool, move_task_run, t) != 0) {
+            tree_dir_finish(&dir, 1);
+            free(t);
+        }
+    }
+    closedir(d);
+
+    // Wait for this directory's files before deciding whether it can go
+    failed += tree_dir_wait(&dir);
+
+    if (failed == 0) {
+        struct stat st;
+        if (lstat(src, &st) == 0) {
+            chmod(dst, st.st_mode & 07777);
+            copy_times(dst, &st);
+        }
+        if (rmdir(src) != 0) {
+            fileop_record_error(p, src, errno);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+// Move 'src' to 'dst' on another filesystem, where rename() fails with
+// EXDEV: copy with the normal copy engine, then delete each source entry
+// as soon as its copy is complete. Returns -1 if anything stayed behind.
+int move_across_devices(const char *src, const char *dst, fileop_progress_t *p) {
+    struct stat st;
+    if (lstat(src, &st) != 0) return -1;
+    if (!S_ISDIR(st.st_mode)) return move_one(src, dst, p);
+
+    if (mkdir(dst, (st.st_mode & 0777) | S_IRWXU) != 0) return -1;
+
+    // Callers without progress reporting still need somewhere to keep errors
+    fileop_progress_t local;
+    if (!p) {
+        fileop_progress_init(&local);
+        p = &local;
+    }
+
+    int failed = 1;
+    pool_t *pool = pool_create(pool_default_threads(), TREE_QUEUE_DEPTH);
+    if (pool) {
+        failed = move_tree_walk(pool, src, dst, p);
+        pool_destroy(pool);
+    } else {
+        errno = ENOMEM;
+    }
+
+    if (failed != 0 && pool && !cancelled(p)) {
+        pthread_mutex_lock(&p->err_lock);
+        errno = p->err_head ? p->err_head->err : EIO;
+        pthread_mutex_unlock(&p->err_lock);
+    }
+    if (p == &local) {
+        int saved = errno;
+        fileop_progress_destroy(&local);
+        errno = saved;
+    }
+    return failed == 0 ? 0 : -1;
+}
+
+// Unlinking is cheap, so names are handed to the workers in batches
+// rather than one task per file
+#define DELETE_BATCH 64
+#define DELETE_NAMES_BYTES 4096
+
+// A batch of non-directories to unlink from one open directory
+typedef struct {
+    fileop_progress_t *p;
+    tree_dir_t *dir;
+    int dirfd;                      // Stays open until the batch is done
+    const char *dir_path;           // For error messages only
+    int count;
+    size_t used;
+    char names[DELETE_NAMES_BYTES]; // NUL-separated entry names
+} delete_task_t;
+
+// Pool task: unlink every name in the batch relative to its directory fd
+static void delete_task_run(void *arg) {
+    delete_task_t *t = arg;
+    int failed = 0;
+    const char *name = t->names;
+    for (int i = 0; i < t->count; i++, name += strlen(name) + 1) {
+        if (cancelled(t->p)) {
+            failed += t->count - i;
+            break;
+        }
+        if (unlinkat(t->dirfd, name, 0) == 0) {
+            atomic_fetch_add_explicit(&t->p->files_done, 1, memory_order_relaxed);
+            continue;
+        }
+        record_entry_error(t->p, t->dir_path, name, errno);
+        failed++;
+    }
+    tree_dir_finish(t->dir, failed);
+    free(t);
+}
+
+// Queue a batch (if it has anything in it)
+static void delete_submit(pool_t *pool, tree_dir_t *dir, delete_task_t *t) {
+    if (!t) return;
+    tree_dir_add(dir);
+    if (pool_submit(pool, delete_task_run, t) != 0) {
+        tree_dir_finish(dir, t->count);
+        free(t);
+    }
+}
+
+// Empty and remove directory 'name' (relative to 'parent_fd'). Everything
+// is reached through openat()/unlinkat() on directory fds, so no path is
+// resolved twice and only one fd per level of the tree is open at a time.
+// 'path' is the same directory spelled out, for messages. Returns the
+// number of entries that could not be removed.
+static int delete_tree_walk(pool_t *pool, int parent_fd, const char *name,
+                            const char *path, fileop_progress_t *p) {
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+        fileop_record_error(p, path, errno);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    tree_dir_t dir = { 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    delete_task_t *batch = NULL;
+    int failed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (cancelled(p)) {
+            failed++;
+            break;
+        }
+        // Deletes aren't pre-scanned: the total grows as the walk finds entries
+        atomic_fetch_add_explicit(&p->files_total, 1, memory_order_relaxed);
+
+        // d_type saves a stat() per entry on filesystems that fill it in
+        int is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                record_entry_error(p, path, entry->d_name, errno);
+                failed++;
+                continue;
+            }
+            is_dir = S_ISDIR(st.st_mode);
+        }
+
+        if (is_dir) {
+            char child[PATH_MAX];
+            if (strlen(path) + strlen(entry->d_name) + 2 > PATH_MAX) {
+                record_entry_error(p, path, entry->d_name, ENAMETOOLONG);
+                failed++;
+                continue;
+            }
+            join_path(child, path, entry->d_name);
+            failed += delete_tree_walk(pool, fd, entry->d_name, child, p);
+            continue;
+        }
+
+        size_t len = strlen(entry->d_name) + 1;
+        if (batch && (batch->count == DELETE_BATCH || batch->used + len > DELETE_NAMES_BYTES)) {
+            delete_submit(pool, &dir, batch);
+            batch = NULL;
+        }
+        if (!batch) {
+            batch = malloc(sizeof(*batch));
+            if (!batch) {
+                record_entry_error(p, path, entry->d_name, ENOMEM);
+                failed++;
+                continue;
+            }
+            batch->p = p;
+            batch->dir = &dir;
+            batch->dirfd = fd;
+            batch->dir_path = path;
+            batch->count = 0;
+            batch->used = 0;
+        }
+        memcpy(batch->names + batch->used, entry->d_name, len);
+        batch->used += len;
+        batch->count++;
+    }
+    delete_submit(pool, &dir, batch);
+
+    // The workers use our fd, so it stays open until they are done
+    failed += tree_dir_wait(&dir);
+    closedir(d);
+
+    if (failed == 0) {
+        if (unlinkat(parent_fd, name, AT_REMOVEDIR) == 0) {
+            atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+        } else {
+            fileop_record_error(p, path, errno);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+// Delete 'path' and, if it is a directory, everything below it (rm -rf).
+// One thread walks the tree; files are unlinked by a pool of workers and
+// each directory is removed once its children are gone. Progress counts
+// entries removed against entries found so far. Returns -1 (errno = first
+// failure) if anything could not be removed.
+int delete_tree(const char *path, fileop_progress_t *p) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return -1;
+    if (!S_ISDIR(st.st_mode)) {
+        if (unlink(path) != 0) return -1;
+        if (p) atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    // Callers without progress reporting still need somewhere to keep errors
+    fileop_progress_t local;
+    if (!p) {
+        fileop_progress_init(&local);
+        p = &local;
+    }
+    atomic_fetch_add_explicit(&p->files_total, 1, memory_order_relaxed);
+
+    int failed = 1;
+    pool_t *pool = pool_create(pool_default_threads(), TREE_QUEUE_DEPTH);
+    if (pool) {
+        failed = delete_tree_walk(pool, AT_FDCWD, path, path, p);
+        pool_destroy(pool);
+    } else {
+        errno = ENOMEM;
+    }
+
+    if (failed != 0 && pool && !cancelled(p)) {
+        pthread_mutex_lock(&p->err_lock);
+        errno = p->err_head ? p->err_head->err : EIO;
+        pthread_mutex_unlock(&p->err_lock);
+    }
+    if (p == &local) {
+        int saved = errno;
+        fileop_progress_destroy(&local);
+        errno = saved;
+    }
+    return failed == 0 ? 0 : -1;
+}
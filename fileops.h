@@ -0,0 +1,53 @@
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Failures are kept per entry so one bad file doesn't abort a whole tree
+#define FILEOP_MAX_ERRORS 100
+
+// One entry that could not be processed
+typedef struct fileop_error {
+    char *path;                 // Source path that failed
+    int err;                    // errno
+    struct fileop_error *next;
+} fileop_error_t;
+
+// Counters shared between a worker doing a file operation and the UI
+// showing its progress. Totals come from a scan done before the work.
+typedef struct {
+    atomic_ullong bytes_done;   // File data copied so far
+    atomic_ullong bytes_total;  // File data to copy
+    atomic_ullong bytes_alloc;  // Disk space it takes (holes don't count)
+    atomic_ulong files_done;    // Files finished
+    atomic_ulong files_total;   // Files to process
+    atomic_int cancel;          // Set by the UI to stop the operation
+    atomic_ulong errors;        // Entries that failed
+    pthread_mutex_t err_lock;   // Guards the error list
+    fileop_error_t *err_head;   // First FILEOP_MAX_ERRORS failures, in order
+    fileop_error_t *err_tail;
+} fileop_progress_t;
+
+// Files of 64 MiB and up are streamed by default
+#define FILEOP_STREAM_THRESHOLD (64LL << 20)
+
+// Copy engine tunables
+typedef struct {
+    long long stream_threshold; // Files at least this big are streamed
+    int direct_io;              // Streaming mode uses O_DIRECT when possible
+} fileop_config_t;
+
+void fileop_configure(const fileop_config_t *cfg);
+void fileop_progress_init(fileop_progress_t *p);
+void fileop_progress_destroy(fileop_progress_t *p);
+void fileop_record_error(fileop_progress_t *p, const char *path, int err);
+void fileop_scan(char *const *paths, size_t count, fileop_progress_t *p);
+int copy_file(const char *src, const char *dst, fileop_progress_t *p);
+int copy_symlink(const char *src, const char *dst);
+int copy_directory(const char *src, const char *dst, fileop_progress_t *p);
+int move_across_devices(const char *src, const char *dst, fileop_progress_t *p);
+int delete_tree(const char *path, fileop_progress_t *p);
+
+#endif
@@ -0,0 +1,153 @@
+#include "filter.h"
+#include "memscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Zero bytes kept after the last name so 16-byte loads never run off the end
+#define PACK_PADDING 16
+
+void name_pack_init(name_pack_t *np) {
+    memset(np, 0, sizeof(*np));
+}
+
+void name_pack_free(name_pack_t *np) {
+    free(np->buf);
+    free(np->lower);
+    free(np->off);
+    name_pack_init(np);
+}
+
+// Start a new packing (keeps the allocations)
+void name_pack_reset(name_pack_t *np) {
+    np->count = 0;
+    np->used = 0;
+}
+
+static void *grow_or_die(void *p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// Append one name (names are matched by their position in the pack)
+void name_pack_add(name_pack_t *np, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (np->used + len + PACK_PADDING > np->cap) {
+        size_t cap = np->cap ? np->cap : 4096;
+        while (np->used + len + PACK_PADDING > cap) cap *= 2;
+        np->buf = grow_or_die(np->buf, cap);
+        np->cap = cap;
+    }
+    if (np->count + 2 > np->off_cap) {
+        np->off_cap = np->off_cap ? np->off_cap * 2 : 1024;
+        np->off = grow_or_die(np->off, np->off_cap * sizeof(uint32_t));
+    }
+    np->off[np->count++] = (uint32_t)np->used;
+    memcpy(np->buf + np->used, name, len);
+    np->used += len;
+}
+
+// Close the pack: end offset, padding and the lower-cased copy
+void name_pack_finish(name_pack_t *np) {
+    // An empty listing still needs the end offset and the padding
+    if (np->used + PACK_PADDING > np->cap) {
+        np->cap = np->used + PACK_PADDING;
+        np->buf = grow_or_die(np->buf, np->cap);
+    }
+    if (np->count + 1 > np->off_cap) {
+        np->off_cap = np->count + 1;
+        np->off = grow_or_die(np->off, np->off_cap * sizeof(uint32_t));
+    }
+    np->off[np->count] = (uint32_t)np->used;
+    memset(np->buf + np->used, 0, PACK_PADDING);
+
+    np->lower = grow_or_die(np->lower, np->cap);
+    for (size_t i = 0; i < np->used + PACK_PADDING; i++) {
+        np->lower[i] = (char)tolower((unsigned char)np->buf[i]);
+    }
+}
+
+#ifdef __SSE2__
+// First 'c' in s[0..n), or NULL. Inline rather than memchr(): on names
+// this short the call and alignment prologue would cost more than the scan.
+static inline const char *scan_byte(const char *s, size_t n, char c) {
+    const __m128i v = _mm_set1_epi8(c);
+    for (size_t i = 0; i < n; i += 16) {
+        // Reads up to 15 bytes past the name: the next names or the padding
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), v));
+        if (n - i < 16) mask &= (1u << (n - i)) - 1;
+        if (mask) return s + i + __builtin_ctz(mask);
+    }
+    return NULL;
+}
+#else
+#define scan_byte(s, n, c) ((const char *)memchr((s), (c), (n)))
+#endif
+
+// Do the pattern's bytes appear in order?
+static int fuzzy(const char *s, size_t n, const char *pat, size_t m) {
+    const char *end = s + n;
+    for (size_t i = 0; i < m; i++) {
+        const char *hit = scan_byte(s, (size_t)(end - s), pat[i]);
+        if (!hit) return 0;
+        s = hit + 1;
+    }
+    return 1;
+}
+
+// Substring search over every name: one pass through the packed buffer
+// rather than one search per name. Patterns never contain NUL, so a hit
+// can't straddle two names; after a hit the scan skips to the next name.
+static size_t find_in_all(const name_pack_t *np, const char *base, const char *pat, size_t m,
+                          uint32_t *out) {
+    size_t kept = 0, idx = 0;
+    const char *p = base, *end = base + np->used;
+    while (idx < np->count) {
+        const char *hit = mem_find(p, (size_t)(end - p), pat, m, 0);
+        if (!hit) break;
+        size_t pos = (size_t)(hit - base);
+        while (np->off[idx + 1] <= pos) idx++;  // Name the hit is in
+        out[kept++] = (uint32_t)idx;
+        p = base + np->off[++idx];
+    }
+    return kept;
+}
+
+// Keep the names among in[0..n) that match 'pattern', writing their
+// indices to 'out' (which may be 'in': narrowing in place is how each
+// keystroke only searches the previous results). 'in' must be in
+// ascending order, as narrowing keeps it. Smart case: a pattern with no
+// capitals matches case-insensitively. Returns the number kept.
+size_t filter_narrow(const name_pack_t *np, const char *pattern, match_mode_t mode,
+                     const uint32_t *in, size_t n, uint32_t *out) {
+    size_t m = strlen(pattern);
+    int ignore_case = 1;
+    for (size_t i = 0; i < m; i++) {
+        if (isupper((unsigned char)pattern[i])) ignore_case = 0;
+    }
+    const char *base = ignore_case ? np->lower : np->buf;
+    if (m > 0 && mode == MATCH_SUBSTRING && n == np->count) {
+        return find_in_all(np, base, pattern, m, out);  // Whole listing
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t idx = in[i];
+        const char *name = base + np->off[idx];
+        size_t len = np->off[idx + 1] - np->off[idx] - 1;
+        int hit = m == 0 ? 1
+                : mode == MATCH_FUZZY ? fuzzy(name, len, pattern, m)
+                : mem_find(name, len, pattern, m, 0) != NULL;
+        if (hit) out[kept++] = idx;
+    }
+    return kept;
+}
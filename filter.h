@@ -0,0 +1,34 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// All names of a listing packed back to back ("name\0name\0..."), with a
+// lower-cased twin for case-insensitive matching. Keeping the bytes
+// contiguous lets the matcher stream through them with vector loads
+// instead of chasing one heap pointer per entry.
+typedef struct {
+    char *buf;          // Names as listed
+    char *lower;        // Same bytes, ASCII lower-cased
+    uint32_t *off;      // off[i] = start of name i; off[count] = end
+    size_t count;       // Names packed
+    size_t used, cap;   // Bytes in buf / allocated
+    size_t off_cap;
+} name_pack_t;
+
+// How the pattern is matched against a name
+typedef enum {
+    MATCH_SUBSTRING,    // Pattern appears as-is
+    MATCH_FUZZY         // Pattern's characters appear in order (e.g. "mxc" ~ "mexplorer.c")
+} match_mode_t;
+
+void name_pack_init(name_pack_t *np);
+void name_pack_free(name_pack_t *np);
+void name_pack_reset(name_pack_t *np);
+void name_pack_add(name_pack_t *np, const char *name);
+void name_pack_finish(name_pack_t *np);
+size_t filter_narrow(const name_pack_t *np, const char *pattern, match_mode_t mode,
+                     const uint32_t *in, size_t n, uint32_t *out);
+
+#endif
@@ -0,0 +1,351 @@
+#include "hash.h"
+#include <string.h>
+#include <pthread.h>
+#if defined(__SSE4_2__) || (defined(__SHA__) && defined(__SSE4_1__))
+#include <immintrin.h>
+#endif
+
+// All multi-byte loads below assume a little-endian host (x86, as the
+// SIMD code elsewhere does)
+static inline uint64_t load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t load32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// ---- CRC32C ----
+
+#define CRC32C_POLY 0x82F63B78u  // Castagnoli, bit-reversed
+
+#ifndef __SSE4_2__
+// Slice-by-8 tables, built once
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1)));
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xff];
+        }
+    }
+}
+#endif
+
+// With SSE4.2 the CPU's crc32 instruction does 8 bytes per step
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t n) {
+    const unsigned char *p = data;
+    uint64_t c = ~crc;
+#ifdef __SSE4_2__
+    for (; n >= 8; p += 8, n -= 8) {
+        c = _mm_crc32_u64(c, load64(p));
+    }
+    for (; n > 0; p++, n--) {
+        c = _mm_crc32_u8((uint32_t)c, *p);
+    }
+#else
+    pthread_once(&crc_once, crc_init_tables);
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v = load64(p) ^ c;
+        c = crc_table[7][v & 0xff] ^ crc_table[6][(v >> 8) & 0xff] ^
+            crc_table[5][(v >> 16) & 0xff] ^ crc_table[4][(v >> 24) & 0xff] ^
+            crc_table[3][(v >> 32) & 0xff] ^ crc_table[2][(v >> 40) & 0xff] ^
+            crc_table[1][(v >> 48) & 0xff] ^ crc_table[0][v >> 56];
+    }
+    for (; n > 0; p++, n--) {
+        c = (c >> 8) ^ crc_table[0][(c ^ *p) & 0xff];
+    }
+#endif
+    return ~(uint32_t)c;
+}
+
+// CRC arithmetic as 32x32 bit matrices over GF(2) (the zlib method):
+// appending len_b zero bytes to A is a matrix power, found by squaring
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_times(mat, mat[n]);
+    }
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    if (len_b == 0) return crc_a;
+
+    uint32_t even[32], odd[32];
+    odd[0] = CRC32C_POLY;  // The operator for one zero bit
+    for (int n = 1; n < 32; n++) {
+        odd[n] = 1u << (n - 1);
+    }
+    gf2_square(even, odd);  // Two zero bits
+    gf2_square(odd, even);  // Four
+
+    // Apply len_b zero bytes, one bit of the length at a time
+    do {
+        gf2_square(even, odd);
+        if (len_b & 1) crc_a = gf2_times(even, crc_a);
+        len_b >>= 1;
+        if (!len_b) break;
+        gf2_square(odd, even);
+        if (len_b & 1) crc_a = gf2_times(odd, crc_a);
+        len_b >>= 1;
+    } while (len_b);
+    return crc_a ^ crc_b;
+}
+
+// ---- xxHash64 ----
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+// Four independent lanes over each 32-byte stripe
+static const unsigned char *xxh_stripes(uint64_t *v, const unsigned char *p, size_t n) {
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    for (; n >= 32; p += 32, n -= 32) {
+        v0 = xxh_round(v0, load64(p));
+        v1 = xxh_round(v1, load64(p + 8));
+        v2 = xxh_round(v2, load64(p + 16));
+        v3 = xxh_round(v3, load64(p + 24));
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+    return p;
+}
+
+void xxh64_init(xxh64_t *h) {
+    memset(h, 0, sizeof(*h));
+    h->v[0] = XXH_P1 + XXH_P2;
+    h->v[1] = XXH_P2;
+    h->v[2] = 0;
+    h->v[3] = 0 - XXH_P1;
+}
+
+void xxh64_update(xxh64_t *h, const void *data, size_t n) {
+    const unsigned char *p = data;
+    h->total += n;
+    if (h->buffered + n < 32) {
+        memcpy(h->buf + h->buffered, p, n);
+        h->buffered += n;
+        return;
+    }
+    if (h->buffered) {
+        size_t fill = 32 - h->buffered;
+        memcpy(h->buf + h->buffered, p, fill);
+        xxh_stripes(h->v, h->buf, 32);
+        p += fill;
+        n -= fill;
+        h->buffered = 0;
+    }
+    const unsigned char *rest = xxh_stripes(h->v, p, n);
+    h->buffered = n - (size_t)(rest - p);
+    memcpy(h->buf, rest, h->buffered);
+}
+
+uint64_t xxh64_final(const xxh64_t *h) {
+    uint64_t acc;
+    if (h->total >= 32) {
+        acc = rotl64(h->v[0], 1) + rotl64(h->v[1], 7) + rotl64(h->v[2], 12) + rotl64(h->v[3], 18);
+        for (int i = 0; i < 4; i++) acc = xxh_merge(acc, h->v[i]);
+    } else {
+        acc = XXH_P5;  // seed + P5
+    }
+    acc += h->total;
+
+    const unsigned char *p = h->buf, *end = h->buf + h->buffered;
+    for (; end - p >= 8; p += 8) {
+        acc ^= xxh_round(0, load64(p));
+        acc = rotl64(acc, 27) * XXH_P1 + XXH_P4;
+    }
+    if (end - p >= 4) {
+        acc ^= (uint64_t)load32(p) * XXH_P1;
+        acc = rotl64(acc, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        acc ^= *p * XXH_P5;
+        acc = rotl64(acc, 11) * XXH_P1;
+    }
+
+    acc ^= acc >> 33;
+    acc *= XXH_P2;
+    acc ^= acc >> 29;
+    acc *= XXH_P3;
+    acc ^= acc >> 32;
+    return acc;
+}
+
+// ---- SHA-256 ----
+
+static const uint32_t sha_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#if defined(__SHA__) && defined(__SSE4_1__)
+// SHA extensions: the CPU runs two rounds per sha256rnds2 and builds the
+// message schedule with sha256msg1/msg2. The state is kept as the
+// ABEF/CDGH register pair those instructions expect.
+static void sha256_blocks(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);  // CDAB
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);   // EFGH
+    __m128i s0 = _mm_alignr_epi8(tmp, s1, 8);       // ABEF
+    s1 = _mm_blend_epi16(s1, tmp, 0xF0);            // CDGH
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abef = s0, cdgh = s1;
+        __m128i w[4];
+        for (int g = 0; g < 16; g++) {  // Four rounds per step
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * g)), byteswap);
+            } else {
+                __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]),
+                                          _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+                w[g & 3] = _mm_sha256msg2_epu32(t, w[(g + 3) & 3]);
+            }
+            __m128i msg = _mm_add_epi32(w[g & 3], _mm_loadu_si128((const __m128i *)&sha_k[4 * g]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1B);              // FEBA
+    s1 = _mm_shuffle_epi32(s1, 0xB1);               // DCHG
+    s0 = _mm_blend_epi16(tmp, s1, 0xF0);            // DCBA
+    s1 = _mm_alignr_epi8(s1, tmp, 8);               // HGFE
+    _mm_storeu_si128((__m128i *)&state[0], s0);
+    _mm_storeu_si128((__m128i *)&state[4], s1);
+}
+#else
+static inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static inline uint32_t load_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void sha256_blocks(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = load_be32(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) +
+                          ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+#endif
+
+void sha256_init(sha256_t *h) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(h->state, iv, sizeof(iv));
+    h->total = 0;
+    h->buffered = 0;
+}
+
+void sha256_update(sha256_t *h, const void *data, size_t n) {
+    const unsigned char *p = data;
+    h->total += n;
+    if (h->buffered) {
+        size_t fill = 64 - h->buffered < n ? 64 - h->buffered : n;
+        memcpy(h->buf + h->buffered, p, fill);
+        h->buffered += fill;
+        p += fill;
+        n -= fill;
+        if (h->buffered < 64) return;
+        sha256_blocks(h->state, h->buf, 1);
+        h->buffered = 0;
+    }
+    sha256_blocks(h->state, p, n / 64);  // Whole blocks straight from the input
+    p += n / 64 * 64;
+    h->buffered = n % 64;
+    memcpy(h->buf, p, h->buffered);
+}
+
+void sha256_final(sha256_t *h, unsigned char out[32]) {
+    uint64_t bits = h->total * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t padlen = (h->buffered < 56 ? 56 : 120) - h->buffered;
+    for (int i = 0; i < 8; i++) {
+        pad[padlen + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_update(h, pad, padlen + 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(h->state[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h->state[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h->state[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h->state[i];
+    }
+}
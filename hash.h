@@ -0,0 +1,40 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checksums over a stream of bytes, fed in pieces of any size.
+
+// CRC32C (Castagnoli, as in iSCSI, ext4 and btrfs). Start from 0 and pass
+// the previous result back in. crc32c_combine() gives the CRC of A+B from
+// the CRCs of A and B and the length of B, so separate parts of a file
+// can be summed in parallel.
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t n);
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+// xxHash64, seed 0 (the value xxhsum prints)
+typedef struct {
+    uint64_t total;
+    uint64_t v[4];
+    unsigned char buf[32];
+    size_t buffered;
+} xxh64_t;
+
+void xxh64_init(xxh64_t *h);
+void xxh64_update(xxh64_t *h, const void *data, size_t n);
+uint64_t xxh64_final(const xxh64_t *h);
+
+// SHA-256
+typedef struct {
+    uint32_t state[8];
+    uint64_t total;
+    unsigned char buf[64];
+    size_t buffered;
+} sha256_t;
+
+void sha256_init(sha256_t *h);
+void sha256_update(sha256_t *h, const void *data, size_t n);
+void sha256_final(sha256_t *h, unsigned char out[32]);
+
+#endif
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE  // O_CLOEXEC, madvise()
+
+#include "hexview.h"
+#include "memscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BYTES_PER_ROW 16
+
+// Bytes mapped around the view; moving outside it maps a new window
+#define HEX_WINDOW (1u << 20)
+
+// Bytes searched per mapping; each is unmapped before the next, so a
+// search through a huge file keeps nothing resident
+#define SEARCH_CHUNK (64u << 20)
+
+struct hexview {
+    char *path;
+    int fd;                         // Kept open to map new windows
+    unsigned long long size;
+    unsigned long long top;         // Offset of the first row shown
+    int rows_shown;                 // Rows drawn last time
+    int digits;                     // Width of the offset column
+    const unsigned char *win;       // Mapped window (NULL if none)
+    unsigned long long win_off;
+    size_t win_len;
+    char *pat;                      // Last search
+    size_t pat_len;
+    unsigned long long match;       // Where it was last found...
+    int have_match;                 // ...if it was
+};
+
+static size_t page_size(void) {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Open 'path' for a hex dump. Returns NULL with a message in 'err' on failure.
+hexview_t *hexview_open(const char *path, char *err, size_t errsz) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        snprintf(err, errsz, "%s", strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        snprintf(err, errsz, "%s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        snprintf(err, errsz, "not a regular file");
+        close(fd);
+        return NULL;
+    }
+
+    hexview_t *h = calloc(1, sizeof(*h));
+    if (!h || !(h->path = strdup(path))) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    h->fd = fd;
+    h->size = (unsigned long long)st.st_size;
+    h->digits = 8;
+    while (h->digits < 16 && (h->size >> (4 * h->digits)) != 0) {
+        h->digits++;
+    }
+    return h;
+}
+
+void hexview_close(hexview_t *h) {
+    if (!h) return;
+    if (h->win) munmap((void *)h->win, h->win_len);
+    close(h->fd);
+    free(h->pat);
+    free(h->path);
+    free(h);
+}
+
+const char *hexview_path(const hexview_t *h) {
+    return h->path;
+}
+
+unsigned long long hexview_offset(const hexview_t *h) {
+    return h->top;
+}
+
+// Bytes [off, off + len) (len already cut to the file), mapping a new
+// window around them if the current one doesn't hold them. NULL if the
+// mapping fails.
+static const unsigned char *window(hexview_t *h, unsigned long long off, size_t len) {
+    if (h->win && off >= h->win_off && off + len <= h->win_off + h->win_len) {
+        return h->win + (off - h->win_off);
+    }
+    if (h->win) munmap((void *)h->win, h->win_len);
+    h->win = NULL;
+
+    // Centre the window on the view so scrolling either way stays inside it
+    size_t page = page_size();
+    unsigned long long start = off > HEX_WINDOW / 2 ? (off - HEX_WINDOW / 2) / page * page : 0;
+    unsigned long long end = start + HEX_WINDOW;
+    if (end < off + len) end = off + len;
+    if (end > h->size) end = h->size;
+
+    void *map = mmap(NULL, (size_t)(end - start), PROT_READ, MAP_PRIVATE, h->fd, (off_t)start);
+    if (map == MAP_FAILED) return NULL;
+    h->win = map;
+    h->win_off = start;
+    h->win_len = (size_t)(end - start);
+    return h->win + (off - start);
+}
+
+// Offset of the last row
+static unsigned long long last_row(const hexview_t *h) {
+    return h->size > 0 ? (h->size - 1) / BYTES_PER_ROW * BYTES_PER_ROW : 0;
+}
+
+void hexview_scroll(hexview_t *h, long rows) {
+    unsigned long long delta = (unsigned long long)(rows < 0 ? -rows : rows) * BYTES_PER_ROW;
+    if (rows < 0) {
+        h->top = h->top > delta ? h->top - delta : 0;
+    } else {
+        h->top = h->top + delta < last_row(h) ? h->top + delta : last_row(h);
+    }
+}
+
+// Show the row holding 'offset' at the top
+void hexview_goto(hexview_t *h, unsigned long long offset) {
+    h->top = offset / BYTES_PER_ROW * BYTES_PER_ROW;
+    if (h->top > last_row(h)) h->top = last_row(h);
+}
+
+void hexview_goto_percent(hexview_t *h, unsigned percent) {
+    if (percent > 100) percent = 100;
+    hexview_goto(h, h->size / 100 * percent + h->size % 100 * percent / 100);
+}
+
+void hexview_bottom(hexview_t *h, int rows) {
+    unsigned long long back = (unsigned long long)(rows > 1 ? rows - 1 : 0) * BYTES_PER_ROW;
+    h->top = last_row(h) > back ? last_row(h) - back : 0;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Turn what was typed into bytes. Returns the length, or -1 if the hex
+// is malformed or too long.
+int hexview_parse_pattern(const char *text, char *out, size_t outsz) {
+    size_t n = 0;
+    if (text[0] == '"') {
+        for (const char *c = text + 1; *c && !(*c == '"' && c[1] == '\0'); c++) {
+            if (n == outsz) return -1;
+            out[n++] = *c;
+        }
+        return (int)n;
+    }
+    for (const char *c = text; *c; ) {
+        if (*c == ' ') {
+            c++;
+            continue;
+        }
+        int hi = hex_digit(c[0]), lo = hi >= 0 ? hex_digit(c[1]) : -1;
+        if (lo < 0 || n == outsz) return -1;
+        out[n++] = (char)(hi << 4 | lo);
+        c += 2;
+    }
+    return (int)n;
+}
+
+// First match at or after 'from'. Returns 1 and sets *at if found.
+static int find_forward(hexview_t *h, unsigned long long from, unsigned long long *at) {
+    size_t page = page_size();
+    while (from < h->size) {
+        unsigned long long start = from / page * page;  // mmap() wants page-aligned offsets
+        unsigned long long end = from + SEARCH_CHUNK;
+        if (end > h->size) end = h->size;
+        unsigned long long span = end + h->pat_len - 1;  // Matches may run into the next chunk
+        if (span > h->size) span = h->size;
+
+        char *map = mmap(NULL, (size_t)(span - start), PROT_READ, MAP_PRIVATE, h->fd, (off_t)start);
+        if (map == MAP_FAILED) return 0;
+        madvise(map, (size_t)(span - start), MADV_SEQUENTIAL);
+        const char *hit = mem_find(map + (from - start), (size_t)(span - from), h->pat, h->pat_len, 0);
+        if (hit) *at = start + (unsigned long long)(hit - map);
+        munmap(map, (size_t)(span - start));
+        if (hit) return 1;
+        from = end;
+    }
+    return 0;
+}
+
+// Last match that starts before 'before'. Returns 1 and sets *at if found.
+static int find_backward(hexview_t *h, unsigned long long before, unsigned long long *at) {
+    size_t page = page_size();
+    unsigned long long end = before;
+    while (end > 0) {
+        unsigned long long from = end > SEARCH_CHUNK ? end - SEARCH_CHUNK : 0;
+        unsigned long long start = from / page * page;
+        unsigned long long span = end + h->pat_len - 1;
+        if (span > h->size) span = h->size;
+
+        char *map = mmap(NULL, (size_t)(span - start), PROT_READ, MAP_PRIVATE, h->fd, (off_t)start);
+        if (map == MAP_FAILED) return 0;
+        const char *last = NULL, *p = map + (from - start);
+        while ((p = mem_find(p, (size_t)(map + (span - start) - p), h->pat, h->pat_len, 0)) != NULL &&
+               p < map + (end - start)) {
+            last = p++;
+        }
+        if (last) *at = start + (unsigned long long)(last - map);
+        munmap(map, (size_t)(span - start));
+        if (last) return 1;
+        end = from;
+    }
+    return 0;
+}
+
+// Show a match, if there is one
+static int show_match(hexview_t *h, int found, unsigned long long at) {
+    if (!found) return 0;
+    h->match = at;
+    h->have_match = 1;
+    hexview_goto(h, at);
+    return 1;
+}
+
+// Look for a byte pattern from the top of the view (or before it,
+// backward). Returns 1 and shows the match if there is one.
+int hexview_search(hexview_t *h, const char *pattern, size_t len, int backward) {
+    free(h->pat);
+    h->pat = NULL;
+    h->have_match = 0;
+    if (len == 0) return 0;
+    if (!(h->pat = malloc(len))) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(h->pat, pattern, len);
+    h->pat_len = len;
+
+    unsigned long long at = 0;
+    int found = backward ? find_backward(h, h->top, &at) : find_forward(h, h->top, &at);
+    return show_match(h, found, at);
+}
+
+// Repeat the last search. It goes on from the last match while that is
+// on screen, otherwise from the view.
+int hexview_search_next(hexview_t *h, int backward) {
+    if (!h->pat) return 0;
+    unsigned long long shown_end = h->top + (unsigned long long)h->rows_shown * BYTES_PER_ROW;
+    int on_screen = h->have_match && h->match >= h->top && h->match < shown_end;
+
+    unsigned long long at = 0;
+    int found;
+    if (backward) {
+        found = find_backward(h, on_screen ? h->match : h->top, &at);
+    } else {
+        found = find_forward(h, on_screen ? h->match + 1 : h->top, &at);
+    }
+    return show_match(h, found, at);
+}
+
+// Is byte 'off' part of the last match?
+static int in_match(const hexview_t *h, unsigned long long off) {
+    return h->have_match && off >= h->match && off - h->match < h->pat_len;
+}
+
+// One row: offset, 16 bytes in hex (split in two groups of 8), then as text
+static void draw_row(hexview_t *h, outbuf_t *ob, unsigned long long off,
+                     const unsigned char *p, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    ob_printf(ob, "\033[2m%0*llx\033[22m  ", h->digits, off);
+
+    int lit = 0;  // Reverse video on
+    for (size_t i = 0; i < BYTES_PER_ROW; i++) {
+        if (i == BYTES_PER_ROW / 2) ob_append(ob, " ", 1);
+        if (i >= n) {
+            ob_append(ob, "   ", 3);
+            continue;
+        }
+        int want = in_match(h, off + i);
+        if (want != lit) ob_puts(ob, want ? "\033[7m" : "\033[27m");
+        lit = want;
+        char cell[2] = { hex[p[i] >> 4], hex[p[i] & 15] };
+        ob_append(ob, cell, 2);
+        // Keep the gap after the last matched byte unhighlighted
+        if (lit && !in_match(h, off + i + 1)) {
+            ob_puts(ob, "\033[27m");
+            lit = 0;
+        }
+        ob_append(ob, " ", 1);
+    }
+    if (lit) ob_puts(ob, "\033[27m");
+
+    ob_puts(ob, " |");
+    lit = 0;
+    for (size_t i = 0; i < n; i++) {
+        int want = in_match(h, off + i);
+        if (want != lit) ob_puts(ob, want ? "\033[7m" : "\033[27m");
+        lit = want;
+        char c = (p[i] >= 32 && p[i] < 127) ? (char)p[i] : '.';
+        ob_append(ob, &c, 1);
+    }
+    if (lit) ob_puts(ob, "\033[27m");
+    ob_puts(ob, "|");
+}
+
+// Draw 'rows' rows of the dump from screen row 'first_row'
+void hexview_draw(hexview_t *h, int first_row, int rows) {
+    h->rows_shown = rows;
+    unsigned long long bytes = (unsigned long long)rows * BYTES_PER_ROW;
+    if (h->top + bytes > h->size) bytes = h->size - h->top;
+    const unsigned char *p = bytes > 0 ? window(h, h->top, (size_t)bytes) : NULL;
+
+    for (int r = 0; r < rows; r++) {
+        outbuf_t *ob = screen_row(first_row + r);
+        unsigned long long off = h->top + (unsigned long long)r * BYTES_PER_ROW;
+        if (off >= h->size) {
+            ob_puts(ob, "~");
+        } else if (!p) {
+            ob_printf(ob, "Can't map the file here: %s", strerror(errno));
+            break;
+        } else {
+            size_t n = h->size - off < BYTES_PER_ROW ? (size_t)(h->size - off) : BYTES_PER_ROW;
+            draw_row(h, ob, off, p + (off - h->top), n);
+        }
+    }
+}
+
+void hexview_status(hexview_t *h, outbuf_t *ob) {
+    unsigned percent = h->size ? (unsigned)(h->top * 100.0 / h->size) : 100;
+    ob_printf(ob, "offset 0x%llx (%llu) of %llu bytes (%u%%)", h->top, h->top, h->size, percent);
+    if (h->have_match && h->pat) ob_printf(ob, ", match at 0x%llx", h->match);
+}
@@ -0,0 +1,31 @@
+#ifndef HEXVIEW_H
+#define HEXVIEW_H
+
+#include "term.h"
+#include <stddef.h>
+
+// Hex/ASCII dump of a file of any size. Only a small window of the file
+// is mapped at a time, so jumping to any offset is O(1) and memory stays
+// the same whether the file is 4 KiB or 40 GiB.
+typedef struct hexview hexview_t;
+
+hexview_t *hexview_open(const char *path, char *err, size_t errsz);
+void hexview_close(hexview_t *h);
+const char *hexview_path(const hexview_t *h);
+unsigned long long hexview_offset(const hexview_t *h);
+
+void hexview_scroll(hexview_t *h, long rows);
+void hexview_goto(hexview_t *h, unsigned long long offset);
+void hexview_goto_percent(hexview_t *h, unsigned percent);
+void hexview_bottom(hexview_t *h, int rows);
+
+// Byte patterns are written as hex ("7f 45 4c 46", spaces optional) or,
+// in double quotes, as text ("ELF")
+int hexview_parse_pattern(const char *text, char *out, size_t outsz);
+int hexview_search(hexview_t *h, const char *pattern, size_t len, int backward);
+int hexview_search_next(hexview_t *h, int backward);
+
+void hexview_draw(hexview_t *h, int first_row, int rows);
+void hexview_status(hexview_t *h, outbuf_t *ob);
+
+#endif
@@ -0,0 +1,81 @@
+#include "inomap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Start of every slot; the value follows
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    int used;
+} slot_key_t;
+
+// Values start aligned for anything they may hold
+#define SLOT_ALIGN _Alignof(max_align_t)
+#define ROUND_UP(n) (((n) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1))
+#define VALUE_OFFSET ROUND_UP(sizeof(slot_key_t))
+
+static size_t slot_size(const inomap_t *m) {
+    return ROUND_UP(VALUE_OFFSET + m->value_size);
+}
+
+static slot_key_t *slot_at(const inomap_t *m, size_t i) {
+    return (slot_key_t *)(m->slots + i * slot_size(m));
+}
+
+// Slot for (dev, ino), or the empty slot where it would go
+static slot_key_t *find_slot(const inomap_t *m, dev_t dev, ino_t ino) {
+    uint64_t k = ((uint64_t)dev << 40) ^ (uint64_t)ino;
+    size_t i = (size_t)(k * 0x9E3779B97F4A7C15ULL) & (m->cap - 1);
+    slot_key_t *s = slot_at(m, i);
+    while (s->used && (s->dev != dev || s->ino != ino)) {
+        i = (i + 1) & (m->cap - 1);
+        s = slot_at(m, i);
+    }
+    return s;
+}
+
+// Double the table (kept at most half full) and rehash into it
+static void grow(inomap_t *m) {
+    size_t old_cap = m->cap, size = slot_size(m);
+    unsigned char *old = m->slots;
+    m->cap = old_cap ? old_cap * 2 : 256;
+    m->slots = calloc(m->cap, size);
+    if (!m->slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        slot_key_t *s = (slot_key_t *)(old + i * size);
+        if (s->used) memcpy(find_slot(m, s->dev, s->ino), s, size);
+    }
+    free(old);
+}
+
+void *inomap_find(const inomap_t *m, dev_t dev, ino_t ino) {
+    if (m->cap == 0) return NULL;
+    slot_key_t *s = find_slot(m, dev, ino);
+    return s->used ? (unsigned char *)s + VALUE_OFFSET : NULL;
+}
+
+void *inomap_get(inomap_t *m, dev_t dev, ino_t ino, int *added) {
+    if ((m->count + 1) * 2 > m->cap) grow(m);
+    slot_key_t *s = find_slot(m, dev, ino);
+    int is_new = !s->used;
+    if (is_new) {
+        // Slots are only ever filled, so the value is still zero from calloc()
+        s->used = 1;
+        s->dev = dev;
+        s->ino = ino;
+        m->count++;
+    }
+    if (added) *added = is_new;
+    return (unsigned char *)s + VALUE_OFFSET;
+}
+
+void inomap_free(inomap_t *m) {
+    free(m->slots);
+    m->slots = NULL;
+    m->cap = m->count = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef INOMAP_H
+#define INOMAP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Hash map keyed by a file's identity (dev, ino), with a fixed-size value
+// per file kept inline (open addressing, linear probing). Entries are
+// never removed one by one, only all together with inomap_free().
+typedef struct {
+    unsigned char *slots;
+    size_t value_size;
+    size_t cap, count;
+} inomap_t;
+
+#define INOMAP_INIT(value_size) { NULL, (value_size), 0, 0 }
+
+// Value of (dev, ino), or NULL if it isn't in the map
+void *inomap_find(const inomap_t *m, dev_t dev, ino_t ino);
+
+// Value of (dev, ino), added zero-filled if it wasn't there (then '*added',
+// if given, is set to 1). Values may move when the map grows.
+void *inomap_get(inomap_t *m, dev_t dev, ino_t ino, int *added);
+
+// Drop every entry (the map can be used again)
+void inomap_free(inomap_t *m);
+
+#endif
@@ -0,0 +1,398 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "jobs.h"
+#include "selection.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>  // BTRFS_SUPER_MAGIC, XFS_SUPER_MAGIC
+
+// Background worker with a FIFO of pending jobs and a list of finished ones
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    job_t *queue_head;      // Waiting jobs (FIFO)
+    job_t *queue_tail;
+    job_t *active;          // Job the worker is running now
+    job_t *finished;        // Done/failed/cancelled, waiting for jobs_reap()
+    unsigned next_id;
+    int running;            // Worker thread started
+    int stopping;           // Shutdown requested
+    void (*notify)(void);   // Wakes the UI when a job finishes
+} job_runner_t;
+
+static job_runner_t runner = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .next_id = 1,
+};
+
+// Build the destination of 'src' inside folder 'dir'
+static int dst_path(char *buf, size_t n, const char *dir, const char *src) {
+    const char *name = strrchr(src, '/');
+    name = name ? name + 1 : src;
+    if ((size_t)snprintf(buf, n, "%s/%s", dir, name) >= n) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// Move one source into place: a rename when it stays on the same
+// filesystem, otherwise copy + delete
+static int move_item(const char *src, const char *dst, fileop_progress_t *p) {
+    if (rename(src, dst) == 0) {
+        atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+        return 0;
+    }
+    if (errno != EXDEV) return -1;
+    return move_across_devices(src, dst, p);
+}
+
+// Run one source of a job
+static int run_item(job_t *job, const char *src) {
+    fileop_progress_t *p = &job->progress;
+    if (job->kind == JOB_DELETE) return delete_tree(src, p);
+
+    char dst[PATH_MAX];
+    struct stat st;
+    if (dst_path(dst, sizeof(dst), job->dst, src) != 0) return -1;
+    if (job->kind == JOB_MOVE) return move_item(src, dst, p);
+    if (lstat(src, &st) != 0) return -1;
+    if (S_ISDIR(st.st_mode)) return copy_directory(src, dst, p);
+    if (S_ISLNK(st.st_mode)) {
+        // Paste the link itself, as a copied tree does, not what it points to
+        if (copy_symlink(src, dst) != 0) return -1;
+        atomic_fetch_add_explicit(&p->files_done, 1, memory_order_relaxed);
+        return 0;
+    }
+    return copy_file(src, dst, p);
+}
+
+// Make sure nothing would be overwritten. The names being pasted go
+// into a set and the destination folder is read once, in a single pass,
+// so the check costs one directory read however many sources there are.
+static int plan_conflicts(job_t *job) {
+    fileop_progress_t *p = &job->progress;
+    selection_t names;
+    selection_init(&names);
+    int conflicts = 0;
+
+    for (size_t i = 0; i < job->count; i++) {
+        const char *src = job->src[i];
+        size_t len = strlen(src);
+        if (strncmp(job->dst, src, len) == 0 && (job->dst[len] == '\0' || job->dst[len] == '/')) {
+            fileop_record_error(p, src, EINVAL);  // A folder can't go inside itself
+            conflicts++;
+            continue;
+        }
+        const char *name = strrchr(src, '/');
+        if (!selection_add(&names, name ? name + 1 : src)) {
+            fileop_record_error(p, src, EEXIST);  // Two sources with the same name
+            conflicts++;
+        }
+    }
+
+    DIR *dir = opendir(job->dst);
+    if (!dir) {
+        int err = errno;
+        selection_free(&names);
+        errno = err;
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (selection_contains(&names, entry->d_name)) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", job->dst, entry->d_name);
+            fileop_record_error(p, path, EEXIST);
+            conflicts++;
+        }
+    }
+    closedir(dir);
+    selection_free(&names);
+
+    if (conflicts > 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return 0;
+}
+
+// Count the work with the parallel pre-scan. Moves that are a plain
+// rename count as one entry; only cross-filesystem moves are scanned.
+static void plan_scan(job_t *job) {
+    fileop_progress_t *p = &job->progress;
+    if (job->kind != JOB_MOVE) {
+        fileop_scan(job->src, job->count, p);
+        return;
+    }
+
+    struct stat dst_st, st;
+    int have_dst = stat(job->dst, &dst_st) == 0;
+    char **cross = malloc(job->count * sizeof(char *));
+    size_t n = 0;
+    if (!cross) return;  // Progress only; the move itself doesn't need it
+    for (size_t i = 0; i < job->count; i++) {
+        if (have_dst && lstat(job->src[i], &st) == 0 && st.st_dev == dst_st.st_dev) {
+            atomic_fetch_add_explicit(&p->files_total, 1, memory_order_relaxed);
+        } else {
+            cross[n++] = job->src[i];
+        }
+    }
+    fileop_scan(cross, n, p);
+    free(cross);
+}
+
+// Could the copy share extents with its sources (FICLONE) rather than
+// write the data? Only if every source is on the destination's
+// filesystem and that is one with reflinks.
+static int reflink_possible(const job_t *job) {
+    struct statfs fs;
+    struct stat dst_st, st;
+    if (job->kind != JOB_COPY) return 0;
+    if (statfs(job->dst, &fs) != 0 || stat(job->dst, &dst_st) != 0) return 0;
+    if (fs.f_type != BTRFS_SUPER_MAGIC && fs.f_type != XFS_SUPER_MAGIC) return 0;
+    for (size_t i = 0; i < job->count; i++) {
+        if (lstat(job->src[i], &st) != 0 || st.st_dev != dst_st.st_dev) return 0;
+    }
+    return 1;
+}
+
+// Will the data fit? What counts is the space the sources take on disk,
+// not their apparent size: holes are kept by the copy. Space taken by
+// renames isn't counted, since they don't write any data, and a copy
+// that may be done with reflinks is let through to find out.
+static int plan_space(job_t *job) {
+    struct statvfs vfs;
+    if (statvfs(job->dst, &vfs) != 0) return 0;  // Can't tell: let the copy find out
+
+    job->space_needed = atomic_load(&job->progress.bytes_alloc);
+    job->space_free = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+    if (job->space_needed > job->space_free && !reflink_possible(job)) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+// Planning for copies and moves: conflicts, pre-scan, free space. Nothing
+// is written unless all of it passes.
+static int plan_job(job_t *job) {
+    if (plan_conflicts(job) != 0) return -1;
+    plan_scan(job);
+    if (atomic_load(&job->progress.cancel)) {
+        errno = ECANCELED;
+        return -1;
+    }
+    return plan_space(job);
+}
+
+// Do the actual work of one job (called without the lock held). Each
+// source is attempted even if an earlier one failed.
+static void run_job(job_t *job) {
+    fileop_progress_t *p = &job->progress;
+    int result = 0;
+
+    // Deletes count entries as they go: a separate scan of a huge tree
+    // would cost about as much as the delete itself
+    if (job->kind != JOB_DELETE) {
+        atomic_store(&job->state, JOB_PLANNING);
+        if (plan_job(job) != 0) {
+            job->error = errno;
+            atomic_store(&job->state, errno == ECANCELED ? JOB_CANCELLED : JOB_FAILED);
+            return;
+        }
+    }
+    job->planned = 1;
+
+    // The start time goes out with the state: the UI reads it once it
+    // sees JOB_RUNNING
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    atomic_store_explicit(&job->state, JOB_RUNNING, memory_order_release);
+
+    size_t i;
+    for (i = 0; i < job->count && !atomic_load(&p->cancel); i++) {
+        unsigned long errors_before = atomic_load(&p->errors);
+        if (run_item(job, job->src[i]) == 0) continue;
+
+        if (result == 0) job->error = errno;
+        result = -1;
+        // Batches report per source; tree operations have already
+        // recorded their own failures
+        if (job->count > 1 && errno != ECANCELED &&
+            atomic_load(&p->errors) == errors_before) {
+            fileop_record_error(p, job->src[i], errno);
+        }
+    }
+
+    if (i < job->count) {
+        atomic_store(&job->state, JOB_CANCELLED);  // Stopped between sources
+    } else if (result == 0) {
+        atomic_store(&job->state, JOB_DONE);
+    } else {
+        atomic_store(&job->state, atomic_load(&p->cancel) ? JOB_CANCELLED : JOB_FAILED);
+    }
+}
+
+// Worker thread: take jobs off the queue until asked to stop
+static void *worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&runner.lock);
+    for (;;) {
+        while (!runner.queue_head && !runner.stopping) {
+            pthread_cond_wait(&runner.cond, &runner.lock);
+        }
+        if (runner.stopping) break;
+
+        job_t *job = runner.queue_head;
+        runner.queue_head = job->next;
+        if (!runner.queue_head) runner.queue_tail = NULL;
+        job->next = NULL;
+        runner.active = job;
+        pthread_mutex_unlock(&runner.lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&runner.lock);
+        runner.active = NULL;
+        job->next = runner.finished;
+        runner.finished = job;
+        if (runner.notify) runner.notify();
+    }
+    pthread_mutex_unlock(&runner.lock);
+    return NULL;
+}
+
+// Start the worker thread. 'notify' is called from the worker after
+// each job finishes, so it must be thread-safe (e.g. events_wakeup).
+int jobs_start(void (*notify)(void)) {
+    if (runner.running) return 0;
+    runner.notify = notify;
+    runner.stopping = 0;
+    if (pthread_create(&runner.thread, NULL, worker_main, NULL) != 0) {
+        return -1;
+    }
+    runner.running = 1;
+    return 0;
+}
+
+// Cancel everything, wait for the worker to exit and free all jobs
+void jobs_stop(void) {
+    if (!runner.running) return;
+
+    pthread_mutex_lock(&runner.lock);
+    runner.stopping = 1;
+    if (runner.active) atomic_store(&runner.active->progress.cancel, 1);
+    pthread_cond_signal(&runner.cond);
+    pthread_mutex_unlock(&runner.lock);
+    pthread_join(runner.thread, NULL);
+    runner.running = 0;
+
+    job_t *lists[] = { runner.queue_head, runner.finished };
+    for (size_t i = 0; i < 2; i++) {
+        while (lists[i]) {
+            job_t *next = lists[i]->next;
+            job_free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    runner.queue_head = runner.queue_tail = runner.finished = NULL;
+}
+
+// Queue a job over 'count' sources. Copies and moves go into folder
+// 'dst' (NULL for deletes). Returns NULL if memory ran out.
+job_t *jobs_submit(job_kind_t kind, char *const *src, size_t count, const char *dst) {
+    job_t *job = calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->kind = kind;
+    fileop_progress_init(&job->progress);
+    job->src = calloc(count, sizeof(char *));
+    job->dst = dst ? strdup(dst) : NULL;
+    if (!job->src || (dst && !job->dst)) {
+        job_free(job);
+        return NULL;
+    }
+    for (; job->count < count; job->count++) {
+        job->src[job->count] = strdup(src[job->count]);
+        if (!job->src[job->count]) {
+            job_free(job);
+            return NULL;
+        }
+    }
+    atomic_init(&job->state, JOB_QUEUED);
+
+    pthread_mutex_lock(&runner.lock);
+    job->id = runner.next_id++;
+    if (runner.queue_tail) runner.queue_tail->next = job;
+    else runner.queue_head = job;
+    runner.queue_tail = job;
+    pthread_cond_signal(&runner.cond);
+    pthread_mutex_unlock(&runner.lock);
+    return job;
+}
+
+// The job currently being worked on, if any. Only the UI thread frees
+// jobs (after reaping), so the pointer stays valid until then.
+job_t *jobs_active(void) {
+    pthread_mutex_lock(&runner.lock);
+    job_t *job = runner.active;
+    pthread_mutex_unlock(&runner.lock);
+    return job;
+}
+
+// Is anything running or waiting?
+int jobs_busy(void) {
+    pthread_mutex_lock(&runner.lock);
+    int busy = runner.active != NULL || runner.queue_head != NULL;
+    pthread_mutex_unlock(&runner.lock);
+    return busy;
+}
+
+// Ask the running job to stop at the next opportunity
+void jobs_cancel_active(void) {
+    pthread_mutex_lock(&runner.lock);
+    if (runner.active) atomic_store(&runner.active->progress.cancel, 1);
+    pthread_mutex_unlock(&runner.lock);
+}
+
+// Take one finished job (caller frees it with job_free), or NULL
+job_t *jobs_reap(void) {
+    pthread_mutex_lock(&runner.lock);
+    job_t *job = runner.finished;
+    if (job) {
+        runner.finished = job->next;
+        job->next = NULL;
+    }
+    pthread_mutex_unlock(&runner.lock);
+    return job;
+}
+
+// Upper-case label for progress bars and messages
+const char *job_kind_name(job_kind_t kind) {
+    switch (kind) {
+        case JOB_MOVE:   return "MOVE";
+        case JOB_DELETE: return "DELETE";
+        default:         return "COPY";
+    }
+}
+
+// Release a job
+void job_free(job_t *job) {
+    if (!job) return;
+    fileop_progress_destroy(&job->progress);
+    for (size_t i = 0; i < job->count; i++) {
+        free(job->src[i]);
+    }
+    free(job->src);
+    free(job->dst);
+    free(job);
+}
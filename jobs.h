@@ -0,0 +1,52 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "fileops.h"
+#include <time.h>
+
+// Kinds of background file operations
+typedef enum {
+    JOB_COPY,   // Copy files or directory trees into a folder
+    JOB_MOVE,   // Move into a folder (rename, or copy + delete across filesystems)
+    JOB_DELETE  // Delete files or directory trees (no destination)
+} job_kind_t;
+
+// Lifecycle of a job
+typedef enum {
+    JOB_QUEUED,     // Waiting for the worker
+    JOB_PLANNING,   // Checking conflicts, counting files and bytes, checking space
+    JOB_RUNNING,    // Copying, moving or deleting
+    JOB_DONE,       // Finished successfully
+    JOB_FAILED,     // Stopped on an error (see 'error')
+    JOB_CANCELLED   // Stopped by the user
+} job_state_t;
+
+// One background operation. The worker owns it until it is handed back
+// through jobs_reap(); the UI may read 'progress' and 'state' any time.
+typedef struct job {
+    unsigned id;                // Shown in messages
+    job_kind_t kind;
+    char **src;                 // Source paths (a batch, e.g. a selection)
+    size_t count;               // Number of sources
+    char *dst;                  // Destination folder, or NULL for deletes
+    fileop_progress_t progress; // Live counters
+    atomic_int state;           // job_state_t
+    int error;                  // errno of the failure, if any
+    int planned;                // Planning passed and the work was started
+    unsigned long long space_needed; // Disk space the paste will take (from planning)
+    unsigned long long space_free;   // Bytes available on the destination
+    struct timespec started;    // When copying started (for rate/ETA)
+    struct job *next;           // Queue link
+} job_t;
+
+int jobs_start(void (*notify)(void));
+void jobs_stop(void);
+job_t *jobs_submit(job_kind_t kind, char *const *src, size_t count, const char *dst);
+job_t *jobs_active(void);
+int jobs_busy(void);
+void jobs_cancel_active(void);
+job_t *jobs_reap(void);
+const char *job_kind_name(job_kind_t kind);
+void job_free(job_t *job);
+
+#endif
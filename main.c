@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 
 // Show how to use the program when user messes up or asks for help
 static void usage(const char *prog) {
@@ -11,17 +12,28 @@ static void usage(const char *prog) {
             "Usage: %s [options] [directory]\n"
             "Interactive mode controls (once running):\n"
             "  j/k or ↓/↑ - Move selection up/down\n"
-            "  enter      - Open file/folder\n" 
+            "  enter      - Open folder, or view file (/ searches, : goes to line or %%, F follows, x=hex, q closes)\n"
+            "  i          - Show file details\n"
             "  b          - Go back to parent folder\n"
+            "  F          - Find names below this folder (hits stream in; X stops)\n"
+            "  G          - Find text in the files below this folder\n"
+            "  /          - Filter the listing as you type (Tab=fuzzy, Esc=clear)\n"
             "  a          - Toggle hidden files (show/hide dotfiles)\n"
             "  l          - Toggle detailed view\n"
             "  s          - Change sort order (name→size→time)\n"
             "  H          - Toggle human-readable sizes\n"
+            "  z          - Toggle du mode (recursive directory sizes)\n"
             "  d          - Show only directories\n" 
             "  f          - Show only files\n"
+            "  space      - Select/unselect entry (A=all, I=invert, g=pattern, u=none)\n"
             "  n          - Create new file/directory\n"
-            "  D          - Delete selected file/directory\n"
-            "  r          - Refresh view\n"
+            "  D          - Delete selected file/directory (trees in the background)\n"
+            "  c/m        - Copy/cut selected entries to clipboard\n"
+            "  p          - Paste (runs in the background)\n"
+            "  X          - Cancel the running background copy, move or delete (or checksums)\n"
+            "  C          - Checksums of the selection, folders recursively (E exports them)\n"
+            "  U          - Find duplicate files below this folder\n"
+            "  r          - Refresh view (re-reads from disk with -I)\n"
             "  q          - Quit\n"
             "  ?          - Show this help\n\n"
             
@@ -35,10 +47,42 @@ static void usage(const char *prog) {
             "  -d Start with directories only\n"
             "  -f Start with files only\n"
             "  -i Interactive mode (default)\n"
-            "  -b Batch mode (simple list and exit)\n",
+            "  -b Batch mode (simple list and exit)\n"
+            "  -D Show render statistics (bytes per frame)\n"
+            "  -O Use O_DIRECT for large file copies (bypass page cache)\n"
+            "  -z Start in du mode (recursive directory sizes)\n"
+            "  -F glob  Print the paths below the folder whose names match and exit\n"
+            "  -E regex Same with an extended regex (add -a to search hidden entries)\n"
+            "  -G text  Print file:line:text for every line below the folder containing text\n"
+            "  -x size  Content search (-G and the G key) skips files bigger than size (e.g. 10M)\n"
+            "  -C algo  Print 'digest  path' for every file below the folder (crc32c, xxh64\n"
+            "           or sha256; add -a for hidden files) and exit\n"
+            "  -u       Print the sets of duplicate files below the folder (blank line between) and exit\n"
+            "  -B file  Save the names and stat info of the tree below the folder to an index and exit\n"
+            "           (run again to update it: only folders whose mtime changed are re-read)\n"
+            "  -I file  List folders from that index while they are unchanged (checked by mtime)\n"
+            "  -L text  With -I: print the indexed paths below the folder whose names contain text\n",
             prog);
 }
 
+// Read a size such as 4096, 500K, 10M or 2G
+static int parse_size(const char *s, unsigned long long *out) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (errno || end == s) return -1;
+    
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+    }
+    if (*end != '\0') return -1;
+    *out = n << shift;
+    return 0;
+}
+
 // Main function
 int main(int argc, char **argv) {
     // Start with all flags turned off (0 means false/no)
@@ -49,7 +93,7 @@ int main(int argc, char **argv) {
     // Parse command line arguments like -a -l -S
     // getopt() is a standard Unix function for this
     int opt;
-    while ((opt = getopt(argc, argv, "arlStndfhib")) != -1) {
+    while ((opt = getopt(argc, argv, "arlStndfhibDOzuF:E:G:x:C:B:I:L:")) != -1) {
         switch (opt) {
             case 'a': flags.show_all = 1; break;           // Show hidden files
             case 'r': flags.recursive = 1; break;          // Go into subfolders
@@ -62,6 +106,29 @@ int main(int argc, char **argv) {
             case 'h': flags.human_readable = 1; break;     // Pretty sizes
             case 'i': flags.interactive = 1; break;        // UI mode
             case 'b': flags.interactive = 0; break;        // Simple list mode
+            case 'D': flags.debug_stats = 1; break;        // Render stats
+            case 'O': flags.direct_io = 1; break;          // O_DIRECT copies
+            case 'z': flags.du_mode = 1; break;            // Recursive directory sizes
+            case 'u': flags.find_dupes = 1; break;         // Duplicate files
+            case 'B': flags.index_build = optarg; break;   // Build a metadata index
+            case 'I': flags.index_file = optarg; break;    // List from a metadata index
+            case 'L': flags.locate_text = optarg; break;   // Name search in the index
+            case 'F': flags.find_pattern = optarg; flags.find_syntax = SEARCH_GLOB; break;    // Find by glob
+            case 'E': flags.find_pattern = optarg; flags.find_syntax = SEARCH_REGEX; break;   // Find by regex
+            case 'G': flags.find_pattern = optarg; flags.find_syntax = SEARCH_CONTENT; break; // Find text
+            case 'x':                                      // Content search size limit
+                if (parse_size(optarg, &flags.max_search_size) != 0) {
+                    fprintf(stderr, "Error: Bad size '%s' (try 500K, 10M or 2G).\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'C':                                      // Checksums
+                if (checksum_parse_algo(optarg, &flags.checksum_algo) != 0) {
+                    fprintf(stderr, "Error: Unknown checksum '%s' (try crc32c, xxh64 or sha256).\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                flags.checksum = 1;
+                break;
             default:
                 usage(argv[0]);  // Show help if unknown option
                 return EXIT_FAILURE;
@@ -80,6 +147,31 @@ int main(int argc, char **argv) {
         start_dir = argv[optind]; // Use folder user specified
     }
 
+    // Name search: print the hits as they are found and exit
+    if (flags.find_pattern) {
+        return find_names(start_dir, &flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Metadata index: build it and exit
+    if (flags.index_build) {
+        return build_index(start_dir, &flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Indexed name search: print the paths and exit
+    if (flags.locate_text) {
+        return locate_names(start_dir, &flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Duplicates: print the sets and exit
+    if (flags.find_dupes) {
+        return find_dupes(start_dir, &flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Checksums: print them as the files are done and exit
+    if (flags.checksum) {
+        return checksum_tree(start_dir, &flags) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Choose between fancy UI mode or simple list mode
     if (flags.interactive) {
         interactive_explorer(start_dir, &flags);
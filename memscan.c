@@ -0,0 +1,93 @@
+#include "memscan.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bytes checked for a NUL when deciding whether a file is binary (as grep and git do)
+#define BINARY_PROBE 8192
+
+static inline unsigned char ascii_lower(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26u ? (unsigned char)(c + 32) : c;
+}
+
+static inline unsigned char ascii_upper(unsigned char c) {
+    return (unsigned char)(c - 'a') < 26u ? (unsigned char)(c - 32) : c;
+}
+
+// Does s[0..m) equal pat? With ignore_case, pat is lower case.
+static inline int same_bytes(const char *s, const char *pat, size_t m, int ignore_case) {
+    if (!ignore_case) return memcmp(s, pat, m) == 0;
+    for (size_t i = 0; i < m; i++) {
+        if (ascii_lower((unsigned char)s[i]) != (unsigned char)pat[i]) return 0;
+    }
+    return 1;
+}
+
+#ifdef __SSE2__
+static inline __m128i eq_either(__m128i v, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b));
+}
+#endif
+
+// First occurrence of 'pat' (length m) in hay[0..n), or NULL. With
+// ignore_case the pattern must be lower case; ASCII letters in 'hay' then
+// match in either case. Sixteen candidate positions are tested per step
+// by comparing the pattern's first and last bytes; only positions where
+// both line up are compared in full.
+const char *mem_find(const char *hay, size_t n, const char *pat, size_t m, int ignore_case) {
+    if (m == 0) return hay;
+    if (m > n) return NULL;
+
+    unsigned char first = (unsigned char)pat[0], last = (unsigned char)pat[m - 1];
+    unsigned char first_alt = ignore_case ? ascii_upper(first) : first;
+    unsigned char last_alt = ignore_case ? ascii_upper(last) : last;
+    size_t positions = n - m + 1;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i f = _mm_set1_epi8((char)first), fa = _mm_set1_epi8((char)first_alt);
+    const __m128i l = _mm_set1_epi8((char)last), la = _mm_set1_epi8((char)last_alt);
+    // The second load ends at i + m + 14, still inside hay
+    for (; i + 16 <= positions; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(eq_either(a, f, fa),
+                                                                  eq_either(b, l, la)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (same_bytes(hay + i + bit, pat, m, ignore_case)) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < positions; i++) {
+        unsigned char c = (unsigned char)hay[i];
+        if ((c == first || c == first_alt) && same_bytes(hay + i, pat, m, ignore_case)) {
+            return hay + i;
+        }
+    }
+    return NULL;
+}
+
+// How many times 'c' occurs in p[0..n) (newlines, for line numbers)
+size_t mem_count_byte(const char *p, size_t n, char c) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    const __m128i v = _mm_set1_epi8(c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, v)));
+    }
+#endif
+    for (; i < n; i++) {
+        count += (p[i] == c);
+    }
+    return count;
+}
+
+// Binary file heuristic: a NUL byte near the start
+int mem_looks_binary(const char *p, size_t n) {
+    return memchr(p, '\0', n < BINARY_PROBE ? n : BINARY_PROBE) != NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef MEMSCAN_H
+#define MEMSCAN_H
+
+#include <stddef.h>
+
+// Byte scanning over memory that may end right at a page boundary (a
+// mapped file), so unlike the name filter nothing is read past 'n'.
+const char *mem_find(const char *hay, size_t n, const char *pat, size_t m, int ignore_case);
+size_t mem_count_byte(const char *p, size_t n, char c);
+int mem_looks_binary(const char *p, size_t n);
+
+#endif
@@ -2,9 +2,22 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "mexplorer.h"
+#include "term.h"
+#include "events.h"
+#include "jobs.h"
+#include "selection.h"
+#include "du.h"
+#include "filter.h"
+#include "search.h"
+#include "viewer.h"
+#include "hexview.h"
+#include "checksum.h"
+#include "dupes.h"
+#include "treeindex.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <dirent.h>
 #include <unistd.h>
@@ -13,10 +26,9 @@
 #include <time.h>
 #include <inttypes.h>
 #include <limits.h>
-#include <sys/ioctl.h>
 #include <termios.h>
 #include <fcntl.h>
-#include <signal.h>
+#include <fnmatch.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -34,6 +46,12 @@ typedef struct {
     size_t capacity;    // Maximum capacity of history
 } history_stack_t;
 
+// A row of the duplicate list: a group's heading (file -1) or one of its files
+typedef struct {
+    size_t group;
+    int file;
+} dupe_row_t;
+
 // All the state for the interactive UI
 typedef struct {
     char *current_path;      // Current path
@@ -44,8 +62,71 @@ typedef struct {
     int needs_refresh;       // Redraw the screen?
     int terminal_resized;    // Terminal size changed?
     explorer_flags_t flags;  // Current settings
-    char *clipboard_path;    // For copy/move operations
+    char **clipboard;        // Paths for copy/move operations
+    size_t clipboard_count;  // Number of paths on the clipboard
     int clipboard_is_move;   // 1 for move, 0 for copy
+    selection_t selection;   // Names selected in current_path
+    char *selection_dir;     // Folder the selection belongs to
+    char status_msg[256];    // One-line result of the last operation
+    int quit_armed;          // 'q' pressed once while a job was running
+    int timer_armed;         // Progress timer running
+    unsigned long listing_gen; // Bumped whenever entries are reloaded
+    // What the list area looked like when last drawn (for scroll regions)
+    unsigned long drawn_gen;
+    int drawn_scroll_offset;
+    int drawn_list_top;
+    int drawn_list_rows;
+    size_t du_waiting;       // du mode: directories in the listing still being sized
+    // The '/' filter: the rows shown are entries.arr[view[0..view_used)]
+    name_pack_t names;       // Listed names packed back to back for the matcher
+    uint32_t *view;          // Entry indices shown, ascending
+    size_t view_used, view_cap;
+    char filter[256];        // Filter text ("" shows everything)
+    int filter_len;
+    int filter_editing;      // Keys go to the filter prompt
+    match_mode_t filter_mode;
+    // Name ('F') and content ('G') search: results replace the listing while shown
+    search_t *search;        // Running or finished search (NULL if none)
+    search_hit_t *hits;      // Found so far, in the order they came in
+    size_t hits_used, hits_cap;
+    char search_pattern[256];
+    search_syntax_t search_syntax;
+    char *search_root;       // Folder the search started in
+    int search_view;         // Showing the results
+    int search_stopped;      // Cancelled with X
+    int search_reported;     // End of the walk announced
+    int hit_cursor, hit_scroll;
+    char *cursor_name;       // Entry to put the cursor on after the next load
+    // Built-in viewer: shown instead of everything else while open
+    viewer_t *viewer;
+    hexview_t *hexview;      // Or the hex dump (binary files, or 'x' in the viewer)
+    int viewer_follow;       // Following the file as it grows (F)
+    int viewer_prompt;       // '/', '?' or ':' while typing a search or line, else 0
+    char viewer_input[256];
+    int viewer_input_len;
+    // Checksums ('C'): digests show in the long view and can be exported ('E')
+    checksum_t *checksum;    // Running or finished run (NULL if none)
+    checksum_result_t *sums; // Done so far, in the order they came in
+    size_t sums_used, sums_cap;
+    checksum_algo_t checksum_algo;
+    char *checksum_root;     // Folder the run started in (exported paths are relative to it)
+    struct timespec checksum_started;
+    int checksum_stopped;    // Cancelled with X
+    int checksum_reported;   // End of the run announced
+    // Duplicate finder ('U'): the groups replace the listing while shown
+    dupes_t *dupes;          // Running or finished run (NULL if none)
+    char *dupes_root;        // Folder the run started in
+    int dupes_view;          // Showing the groups
+    int dupes_stopped;       // Cancelled with X
+    int dupes_reported;      // End of the run announced
+    dupe_row_t *dupe_rows;   // Filled in once the run is over
+    size_t dupe_rows_used;
+    unsigned long dupe_files;          // Files in all groups...
+    unsigned long long dupe_wasted;    // ...and the space all but one of each take
+    int dupe_cursor, dupe_scroll;
+    // Metadata index (-I)
+    int from_index;          // The listing came from the index
+    int index_bypass;        // Read the next listing from disk ('r')
 } interactive_state_t;
 
 // Thread-local buffers for formatting to avoid repeated stack allocations
@@ -53,9 +134,6 @@ static __thread char human_buf[32];
 static __thread char mode_buf[16];
 static __thread char time_buf[32];
 
-// Global state for signal handling
-static interactive_state_t *global_state = NULL;
-
 // Helper function declarations - these are "private" to this file
 static void list_init(entry_list_t *l);
 static void list_free(entry_list_t *l);
@@ -70,22 +148,20 @@ static void print_mode(mode_t mode, char *buf, size_t bufsz);
 static void format_mtime(time_t epoch, char *buf, size_t bufsz);
 static int include_entry(const file_entry_t *e, const explorer_flags_t *f);
 static void read_dir(const char *dirpath, entry_list_t *out, const explorer_flags_t *flags);
-static void print_entry(const file_entry_t *e, const explorer_flags_t *flags, int is_cursor);
-static int get_terminal_height(void);
-static int get_terminal_width(void);
-static int get_terminal_height_cached(void);
+static void format_entry(outbuf_t *ob, const file_entry_t *e, const explorer_flags_t *flags);
+static void print_entry(const file_entry_t *e, const explorer_flags_t *flags);
 static void clear_screen(void);
+static void set_status(interactive_state_t *state, int ok, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
 static void setup_terminal(int enable_raw);
-static char read_single_char_optimized(void);
+static int handle_key(interactive_state_t *state, int key);
 static void restore_terminal_and_exit(interactive_state_t *state);
-static void handle_terminal_resize(int sig);
 static void create_new_file_or_dir(interactive_state_t *state);
 static void delete_selected_entry(interactive_state_t *state);
 static void copy_selected_entry(interactive_state_t *state);
 static void move_selected_entry(interactive_state_t *state);
 static void paste_from_clipboard(interactive_state_t *state);
-static int copy_file(const char *src, const char *dst);
-static int copy_directory(const char *src, const char *dst);
+static void reap_jobs(interactive_state_t *state);
 
 // Compare functions for sorting - used by qsort()
 static int cmp_name(const void *a, const void *b) {
@@ -103,6 +179,21 @@ static int cmp_size(const void *a, const void *b) {
     return cmp_name(a, b);  // Fallback to name sort if file info missing
 }
 
+// Size sort for du mode: directories by their recursive size
+static unsigned long long entry_total_size(const file_entry_t *e) {
+    return e->du_state == DU_DONE ? e->du_bytes : (unsigned long long)e->st.st_size;
+}
+
+static int cmp_du_size(const void *a, const void *b) {
+    const file_entry_t *x = a, *y = b;
+    if (x->st_valid && y->st_valid) {
+        unsigned long long xs = entry_total_size(x), ys = entry_total_size(y);
+        if (xs == ys) return strcmp(x->name, y->name);
+        return ys > xs ? 1 : -1;  // Biggest first
+    }
+    return cmp_name(a, b);
+}
+
 static int cmp_time(const void *a, const void *b) {
     const file_entry_t *x = a, *y = b;
     if (x->st_valid && y->st_valid) {
@@ -274,42 +365,22 @@ static int include_entry(const file_entry_t *e, const explorer_flags_t *f) {
     return 1;  // Passed all filters
 }
 
-// Get terminal height 
-static int get_terminal_height(void) {
-    struct winsize w;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0) {
-        return w.ws_row;  // Return number of rows terminal has
-    }
-    return 24; // Safe default if we can't detect
-}
-
-// Get terminal width
-static int get_terminal_width(void) {
-    struct winsize w;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0) {
-        return w.ws_col;
-    }
-    return 80; // Safe default
-}
-
-// Cached version to reduce frequent ioctl calls
-static int get_terminal_height_cached(void) {
-    static int cached_height = 0;
-    static time_t last_check = 0;
-    time_t now = time(NULL);
-    
-    // Only check every 500ms to reduce system calls
-    if (cached_height == 0 || now - last_check > 0.5) {
-        cached_height = get_terminal_height();
-        last_check = now;
-    }
-    return cached_height;
-}
-
 // Clear screen using ANSI escape codes (works on most terminals)
 static void clear_screen(void) {
     printf("\033[2J\033[H");  // \033[2J = clear, \033[H = move to top-left
     fflush(stdout);
+    screen_invalidate();      // Shadow frame no longer matches the terminal
+}
+
+// Remember a colored result message for the status line of the next frame
+static void set_status(interactive_state_t *state, int ok, const char *fmt, ...) {
+    char msg[sizeof(state->status_msg) - 32];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    snprintf(state->status_msg, sizeof(state->status_msg), "%s%s\033[0m",
+             ok ? "\033[1;32m✓ " : "\033[1;31m✗ ", msg);
 }
 
 // Put terminal in "raw mode" to read single keypresses
@@ -331,92 +402,72 @@ static void setup_terminal(int enable_raw) {
     }
 }
 
-// Signal handler for terminal resize
-static void handle_terminal_resize(int sig) {
-    (void)sig;  // Mark parameter as unused to avoid warning
-    if (global_state) {
-        global_state->terminal_resized = 1;
-        global_state->needs_refresh = 1;
+// Format one file entry (ls -l style) into an output buffer
+static void format_entry(outbuf_t *ob, const file_entry_t *e, const explorer_flags_t *flags) {
+    // Show error placeholders if we couldn't read file info
+    if (!e->st_valid) {
+        ob_printf(ob, "??????????\t? ? ? ?????????? ?????????????????? %s", e->name);
+        return;
     }
-}
 
-// Read exactly one character (no waiting for Enter key) 
-static char read_single_char_optimized(void) {
-    char buf[8];
-    ssize_t bytes_read = read(STDIN_FILENO, buf, sizeof(buf));
-    
-    if (bytes_read <= 0) return 0;
-    
-    // Handle escape sequences in one read
-    if (buf[0] == '\033' && bytes_read >= 3 && buf[1] == '[') {
-        switch(buf[2]) {
-            case 'A': return 'k';  // Up arrow
-            case 'B': return 'j';  // Down arrow
-            case 'C': return 'l';  // Right arrow  
-            case 'D': return 'h';  // Left arrow
-        }
-    }
-    
-    return buf[0];  // Return first character
-}
+    // Use thread-local buffers to avoid repeated stack allocations
+    print_mode(e->st.st_mode, mode_buf, sizeof(mode_buf));
+    format_mtime(e->st.st_mtime, time_buf, sizeof(time_buf));
 
-// Print one file entry, with optional highlighting for selected item
-static void print_entry(const file_entry_t *e, const explorer_flags_t *flags, int is_cursor) {
-    // Highlight selected item with reverse video
-    if (is_cursor) {
-        printf("\033[7m");  // Start reverse video
-    }
-    
-    // Show error placeholders if we couldn't read file info
-    if (!e->st_valid) {
-        printf("??????????\t? ? ? ?????????? ?????????????????? %s", e->name);
+    // Convert user/group IDs to names
+    struct passwd *pw = getpwuid(e->st.st_uid);
+    struct group *gr = getgrgid(e->st.st_gid);
+    
+    // Format file size (pretty or raw bytes). In du mode directories show
+    // their recursive size, or "..." while it is being worked out.
+    intmax_t size = e->du_state == DU_DONE ? (intmax_t)e->du_bytes : (intmax_t)e->st.st_size;
+    if (e->du_state == DU_PENDING) {
+        snprintf(human_buf, sizeof(human_buf), "...");
+    } else if (flags->human_readable) {
+        human_size((off_t)size, human_buf, sizeof(human_buf));
     } else {
-        // Use thread-local buffers to avoid repeated stack allocations
-        print_mode(e->st.st_mode, mode_buf, sizeof(mode_buf));
-        format_mtime(e->st.st_mtime, time_buf, sizeof(time_buf));
-
-        // Convert user/group IDs to names
-        struct passwd *pw = getpwuid(e->st.st_uid);
-        struct group *gr = getgrgid(e->st.st_gid);
-        
-        // Format file size (pretty or raw bytes)
-        if (flags->human_readable) {
-            human_size(e->st.st_size, human_buf, sizeof(human_buf));
-            printf("%s %2ju %-8s %-8s %8s %s %s",
-                   mode_buf,                       // File type and permissions
-                   (uintmax_t)e->st.st_nlink,      // Number of hard links
-                   pw ? pw->pw_name : "-",         // Owner name
-                   gr ? gr->gr_name : "-",         // Group name  
-                   human_buf,                      // File size
-                   time_buf,                       // Modification time
-                   e->name);                       // Filename
-        } else {
-            printf("%s %2ju %-8s %-8s %8" PRIdMAX " %s %s",
-                   mode_buf,                       // File type and permissions
-                   (uintmax_t)e->st.st_nlink,      // Number of hard links
-                   pw ? pw->pw_name : "-",         // Owner name
-                   gr ? gr->gr_name : "-",         // Group name  
-                   (intmax_t)e->st.st_size,        // File size in bytes
-                   time_buf,                       // Modification time
-                   e->name);                       // Filename
-        }
-               
-        // If it's a symlink, show where it points
-        if (S_ISLNK(e->st.st_mode)) {
-            char link_buf[PATH_MAX];
-            ssize_t r = readlink(e->path, link_buf, sizeof(link_buf) - 1);
-            if (r > 0) {
-                link_buf[r] = '\0';
-                printf(" -> %s", link_buf);
-            }
-        }
+        snprintf(human_buf, sizeof(human_buf), "%" PRIdMAX, size);
+    }
+    ob_printf(ob, "%s %2ju %-8s %-8s %8s %s %s",
+              mode_buf,                       // File type and permissions
+              (uintmax_t)e->st.st_nlink,      // Number of hard links
+              pw ? pw->pw_name : "-",         // Owner name
+              gr ? gr->gr_name : "-",         // Group name  
+              human_buf,                      // File size
+              time_buf,                       // Modification time
+              e->name);                       // Filename
+    
+    // Space actually used can differ a lot (sparse files, hard links, small files)
+    if (e->du_state == DU_DONE) {
+        human_size((off_t)(e->du_blocks * 512), human_buf, sizeof(human_buf));
+        ob_printf(ob, " \033[2m(%s on disk)\033[22m", human_buf);
     }
     
-    // Turn off highlighting 
-    if (is_cursor) {
-        printf("\033[0m");  // Reset text attributes
+    // Digest from a checksum run ('C'), as long as the file is unchanged
+    checksum_algo_t algo;
+    const char *digest = S_ISREG(e->st.st_mode) ? checksum_cache_get(&e->st, &algo) : NULL;
+    if (digest) {
+        ob_printf(ob, " \033[2m%s:%s\033[22m", checksum_algo_name(algo), digest);
+    }
+           
+    // If it's a symlink, show where it points
+    if (S_ISLNK(e->st.st_mode)) {
+        char link_buf[PATH_MAX];
+        ssize_t r = readlink(e->path, link_buf, sizeof(link_buf) - 1);
+        if (r > 0) {
+            link_buf[r] = '\0';
+            ob_printf(ob, " -> %s", link_buf);
+        }
     }
-    printf("\n");
+}
+
+// Print one file entry on its own line (batch mode)
+static void print_entry(const file_entry_t *e, const explorer_flags_t *flags) {
+    static __thread outbuf_t line;
+    ob_reset(&line);
+    format_entry(&line, e, flags);
+    ob_puts(&line, "\n");
+    fwrite(line.data, 1, line.len, stdout);
 }
 
 // Read all files in a directory into our list 
@@ -467,31 +518,430 @@ static void read_dir(const char *path, entry_list_t *out, const explorer_flags_t
     closedir(d);
 }
 
-// Load or reload current directory contents
-static void load_directory(interactive_state_t *state) {
-    list_free(&state->entries);  // Clear old entries
-    list_init(&state->entries);
-    read_dir(state->current_path, &state->entries, &state->flags);
+// Metadata index (-I): folders that haven't changed since it was built are
+// listed from it, without reading the folder or stat()ing its entries
+static tindex_t *tree_index;
+
+static int open_tree_index(const explorer_flags_t *flags) {
+    if (!flags->index_file || tree_index) return 0;
+    char err[256];
+    tree_index = tindex_open(flags->index_file, err, sizeof(err));
+    if (!tree_index) {
+        fprintf(stderr, "Can't use the index: %s\n", err);
+        return -1;
+    }
+    return 0;
+}
+
+// List a folder from the index. Returns 0 (having added nothing) if it
+// isn't indexed or its mtime says entries came or went since; the caller
+// then reads it from disk. Sizes and times of files changed in place
+// since the build aren't noticed ('r' re-reads from disk).
+static int read_dir_indexed(const char *path, entry_list_t *out, const explorer_flags_t *f) {
+    tindex_dir_t dir;
+    struct stat live;
+    if (!tree_index || !tindex_find(tree_index, path, &dir) ||
+        stat(path, &live) != 0 || !tindex_dir_current(&dir, &live)) {
+        return 0;
+    }
     
-    // Sort based on current sort mode
+    size_t path_len = strlen(path);
+    for (size_t i = dir.first; i < dir.first + dir.count; i++) {
+        const char *name = tindex_name(tree_index, i);
+        if (!*name) continue;
+        size_t total_len = path_len + strlen(name) + 2;
+        char *full_path = malloc(total_len);
+        if (!full_path) {
+            perror("malloc");
+            continue;
+        }
+        snprintf(full_path, total_len, "%s/%s", path, name);
+
+        file_entry_t fe = {0};
+        fe.path = full_path;
+        fe.name = full_path + path_len + 1;
+        tindex_stat(tree_index, i, &fe.st);
+        fe.st_valid = fe.st.st_mode != 0;  // Couldn't be stat()ed when indexed
+        
+        if (include_entry(&fe, f)) {
+            list_push(out, &fe);
+        } else {
+            free(full_path);
+        }
+    }
+    return 1;
+}
+
+// du mode: fill in the directory sizes that are cached and ask the
+// background walkers for the rest
+static void du_fill(interactive_state_t *state) {
+    state->du_waiting = 0;
+    for (size_t i = 0; i < state->entries.used; i++) {
+        file_entry_t *e = &state->entries.arr[i];
+        e->du_state = DU_NONE;
+        if (!state->flags.du_mode || !e->st_valid || !S_ISDIR(e->st.st_mode)) continue;
+        
+        du_size_t size;
+        if (du_lookup(&e->st, &size)) {
+            e->du_state = DU_DONE;
+            e->du_bytes = size.bytes;
+            e->du_blocks = size.blocks;
+        } else {
+            du_request(e->path, &e->st);
+            e->du_state = DU_PENDING;
+            state->du_waiting++;
+        }
+    }
+}
+
+// Sort the listing by the current sort mode. Recursive sizes are only
+// used once all of them are in, so the order doesn't jump around.
+static void sort_entries(interactive_state_t *state) {
     if (state->flags.sort_mode == SORT_NAME) {
         qsort(state->entries.arr, state->entries.used, sizeof(file_entry_t), cmp_name);
     } else if (state->flags.sort_mode == SORT_SIZE) {
-        qsort(state->entries.arr, state->entries.used, sizeof(file_entry_t), cmp_size);
+        int by_total = state->flags.du_mode && state->du_waiting == 0;
+        qsort(state->entries.arr, state->entries.used, sizeof(file_entry_t),
+              by_total ? cmp_du_size : cmp_size);
     } else if (state->flags.sort_mode == SORT_TIME) {
         qsort(state->entries.arr, state->entries.used, sizeof(file_entry_t), cmp_time);
     }
+}
+
+// The i-th row shown (the listing as seen through the filter)
+static file_entry_t *view_entry(interactive_state_t *state, size_t i) {
+    return &state->entries.arr[state->view[i]];
+}
+
+// Entry under the cursor, or NULL when nothing is shown
+static file_entry_t *cursor_entry(interactive_state_t *state) {
+    if (state->view_used == 0) return NULL;
+    return view_entry(state, (size_t)state->cursor_pos);
+}
+
+// Put the cursor on entry 'idx' if it is shown, else on the first row
+static void place_cursor(interactive_state_t *state, size_t idx) {
+    size_t lo = 0, hi = state->view_used;  // The view is ascending
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (state->view[mid] < idx) lo = mid + 1; else hi = mid;
+    }
+    state->cursor_pos = (lo < state->view_used && state->view[lo] == idx) ? (int)lo : 0;
+}
+
+// Match the filter against the listing. With 'narrow' set only the rows
+// already shown are searched - typing one more character can only drop
+// rows - otherwise the search starts over from every entry.
+static void apply_filter(interactive_state_t *state, int narrow) {
+    size_t keep = state->view_used > 0 ? state->view[state->cursor_pos] : 0;
+    
+    if (!narrow) {
+        for (size_t i = 0; i < state->entries.used; i++) state->view[i] = (uint32_t)i;
+        state->view_used = state->entries.used;
+    }
+    if (state->filter_len > 0) {
+        state->view_used = filter_narrow(&state->names, state->filter, state->filter_mode,
+                                         state->view, state->view_used, state->view);
+    }
+    place_cursor(state, keep);
+    state->scroll_offset = 0;  // The display scrolls back to the cursor
+    state->listing_gen++;
+}
+
+// Pack the names of a freshly read or re-sorted listing and filter it again
+static void refresh_view(interactive_state_t *state) {
+    name_pack_reset(&state->names);
+    for (size_t i = 0; i < state->entries.used; i++) {
+        name_pack_add(&state->names, state->entries.arr[i].name);
+    }
+    name_pack_finish(&state->names);
+    
+    if (state->entries.used > state->view_cap) {
+        uint32_t *view = realloc(state->view, state->entries.used * sizeof(uint32_t));
+        if (!view) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        state->view = view;
+        state->view_cap = state->entries.used;
+    }
+    state->view_used = 0;
+    apply_filter(state, 0);
+}
+
+// Put the cursor back on the entry called 'name'. Returns 0 if it isn't shown.
+static int find_cursor(interactive_state_t *state, const char *name) {
+    for (size_t i = 0; name && i < state->view_used; i++) {
+        if (strcmp(view_entry(state, i)->name, name) == 0) {
+            state->cursor_pos = (int)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Load or reload current directory contents
+static void load_directory(interactive_state_t *state) {
+    list_free(&state->entries);  // Clear old entries
+    list_init(&state->entries);
+    state->from_index = !state->index_bypass &&
+                        read_dir_indexed(state->current_path, &state->entries, &state->flags);
+    if (!state->from_index) {
+        read_dir(state->current_path, &state->entries, &state->flags);
+    }
+    state->index_bypass = 0;
+    
+    // The selection, filter and pending size walks belong to one folder
+    if (!state->selection_dir || strcmp(state->selection_dir, state->current_path) != 0) {
+        selection_clear(&state->selection);
+        du_cancel_pending();
+        state->filter[0] = '\0';
+        state->filter_len = 0;
+        state->filter_editing = 0;
+        free(state->selection_dir);
+        state->selection_dir = strdup(state->current_path);
+    }
+    
+    du_fill(state);
+    sort_entries(state);
+    
+    // Re-mark what the selection covers so it survives reloads and sort changes
+    for (size_t i = 0; i < state->entries.used; i++) {
+        file_entry_t *e = &state->entries.arr[i];
+        e->is_selected = selection_contains(&state->selection, e->name);
+    }
     
     // Reset UI state
+    state->view_used = 0;
+    refresh_view(state);
     state->cursor_pos = 0;
     state->scroll_offset = 0;
+    
+    // Opened a search hit: land on it
+    if (state->cursor_name) {
+        find_cursor(state, state->cursor_name);
+        free(state->cursor_name);
+        state->cursor_name = NULL;
+    }
+}
+
+// Re-sort in place, keeping the cursor on the same entry
+static void resort_keep_cursor(interactive_state_t *state) {
+    if (state->entries.used == 0) return;
+    file_entry_t *cur = cursor_entry(state);
+    char *keep = cur ? strdup(cur->name) : NULL;
+    sort_entries(state);
+    refresh_view(state);  // Rows moved: this also repaints instead of scrolling
+    find_cursor(state, keep);
+    free(keep);
+}
+
+// du mode: pick up sizes the walkers finished since last time
+static void du_update(interactive_state_t *state) {
+    if (du_collect() == 0 || state->du_waiting == 0) return;
+    
+    state->du_waiting = 0;
+    for (size_t i = 0; i < state->entries.used; i++) {
+        file_entry_t *e = &state->entries.arr[i];
+        if (e->du_state != DU_PENDING) continue;
+        
+        du_size_t size;
+        if (du_lookup(&e->st, &size)) {
+            e->du_state = DU_DONE;
+            e->du_bytes = size.bytes;
+            e->du_blocks = size.blocks;
+        } else {
+            state->du_waiting++;
+        }
+    }
+    
+    // All in: a size sort can now use the real totals
+    if (state->du_waiting == 0 && state->flags.sort_mode == SORT_SIZE) {
+        resort_keep_cursor(state);
+        set_status(state, 1, "Directory sizes complete - sorted by total size");
+    }
+}
+
+// Select or unselect one listed entry
+static void set_selected(interactive_state_t *state, file_entry_t *e, int on) {
+    if (on) {
+        selection_add(&state->selection, e->name);
+    } else {
+        selection_remove(&state->selection, e->name);
+    }
+    e->is_selected = on;
+}
+
+// Number of listed entries that are selected (hidden ones don't count)
+static size_t count_selected(const interactive_state_t *state) {
+    size_t n = 0;
+    if (state->selection.count == 0) return 0;
+    for (size_t i = 0; i < state->view_used; i++) {
+        n += state->entries.arr[state->view[i]].is_selected != 0;
+    }
+    return n;
+}
+
+// The paths an operation applies to: every selected entry that is
+// listed, or the one under the cursor when nothing is. The array points
+// into the listing (valid until the next reload); caller frees it.
+static size_t collect_targets(interactive_state_t *state, char ***out) {
+    size_t n = count_selected(state);
+    int use_cursor = (n == 0);
+    if (use_cursor) n = state->view_used > 0 ? 1 : 0;
+
+    *out = NULL;
+    if (n == 0) return 0;
+    char **paths = malloc(n * sizeof(char *));
+    if (!paths) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (use_cursor) {
+        paths[0] = cursor_entry(state)->path;
+    } else {
+        size_t k = 0;
+        for (size_t i = 0; i < state->view_used; i++) {
+            file_entry_t *e = view_entry(state, i);
+            if (e->is_selected) paths[k++] = e->path;
+        }
+    }
+    *out = paths;
+    return n;
+}
+
+// Short description of a set of paths for messages: 'name' or 'N items'
+static void describe_paths(char *const *paths, size_t n, char *buf, size_t bufsz) {
+    if (n == 1) {
+        const char *name = strrchr(paths[0], '/');
+        snprintf(buf, bufsz, "'%s'", name ? name + 1 : paths[0]);
+    } else {
+        snprintf(buf, bufsz, "%zu items", n);
+    }
+}
+
+// What one key did to a line being edited
+enum { LINE_EDITING, LINE_CHANGED, LINE_DONE, LINE_CANCEL };
+
+// Apply one key to the line in buf (length *len). Used by the blocking
+// prompts below and by the '/' filter, which edits while the event loop runs.
+static int line_edit(char *buf, size_t bufsz, int *len, int c) {
+    switch (c) {
+        case '\n':  // Enter - finish input
+            return LINE_DONE;
+            
+        case 127:   // Backspace
+        case '\b':  // Sometimes backspace sends \b
+            if (*len > 0) {
+                buf[--*len] = '\0';
+                return LINE_CHANGED;
+            }
+            return LINE_EDITING;
+            
+        case KEY_ESC:  // Escape - cancel
+        case KEY_NONE: // Input closed
+            return LINE_CANCEL;
+            
+        default:
+            // Only accept printable characters and don't overflow buffer
+            if (c >= 32 && c <= 126 && *len < (int)bufsz - 1) {
+                buf[(*len)++] = c;
+                buf[*len] = '\0';
+                return LINE_CHANGED;
+            }
+            return LINE_EDITING;
+    }
+}
+
+// Line input in raw mode, echoed after the prompt already on screen.
+// Returns the length typed, or 0 if the user cancelled with Escape.
+static int read_line(char *buf, size_t bufsz) {
+    int pos = 0;
+    buf[0] = '\0';
+    for (;;) {
+        int old = pos;
+        switch (line_edit(buf, bufsz, &pos, read_key())) {
+            case LINE_DONE:
+                return pos;
+                
+            case LINE_CANCEL:
+                buf[0] = '\0';
+                return 0;
+                
+            case LINE_CHANGED:
+                if (pos < old) {
+                    printf("\b \b");  // Erase character from display
+                } else {
+                    putchar(buf[pos - 1]);
+                }
+                fflush(stdout);
+                break;
+        }
+    }
+}
+
+// Select every listed entry whose name matches a shell glob
+static void select_by_glob(interactive_state_t *state) {
+    char pattern[256];
+    
+    clear_screen();
+    printf("\033[1;36m=== SELECT BY PATTERN ===\033[0m\n\n");
+    printf("Current directory: %s\n\n", state->current_path);
+    printf("Enter a shell pattern such as *.log or build-?? (empty to cancel):\n");
+    printf("> ");
+    fflush(stdout);
+    
+    if (read_line(pattern, sizeof(pattern)) == 0) return;
+    
+    size_t added = 0;
+    for (size_t i = 0; i < state->view_used; i++) {
+        file_entry_t *e = view_entry(state, i);
+        if (!e->is_selected && fnmatch(pattern, e->name, 0) == 0) {
+            set_selected(state, e, 1);
+            added++;
+        }
+    }
+    set_status(state, added > 0, "Selected %zu more entr%s matching '%s' (%zu selected)",
+               added, added == 1 ? "y" : "ies", pattern, count_selected(state));
+}
+
+// Drop the '/' filter and show the whole listing again
+static void clear_filter(interactive_state_t *state) {
+    state->filter[0] = '\0';
+    state->filter_len = 0;
+    state->filter_editing = 0;
+    apply_filter(state, 0);
+}
+
+// One key typed at the '/' prompt. The listing narrows as you type.
+static void filter_key(interactive_state_t *state, int key) {
+    if (key == '\t') {  // Switch between substring and fuzzy matching
+        state->filter_mode = (state->filter_mode == MATCH_FUZZY) ? MATCH_SUBSTRING : MATCH_FUZZY;
+        apply_filter(state, 0);
+        return;
+    }
+    
+    int old_len = state->filter_len;
+    switch (line_edit(state->filter, sizeof(state->filter), &state->filter_len, key)) {
+        case LINE_DONE:    // Keep the filter and move through the matches
+            state->filter_editing = 0;
+            break;
+            
+        case LINE_CANCEL:
+            clear_filter(state);
+            break;
+            
+        case LINE_CHANGED:
+            // A longer pattern can only match fewer names, so only the rows
+            // still shown are searched; after a backspace start over
+            apply_filter(state, state->filter_len > old_len);
+            break;
+    }
 }
 
 // Create new file or directory with inline prompt
 static void create_new_file_or_dir(interactive_state_t *state) {
-    char name_buf[512] = {0};
-    int pos = 0;
-    int creating = 1;
+    char name_buf[512];
     
     // Show creation prompt
     clear_screen();
@@ -501,42 +951,7 @@ static void create_new_file_or_dir(interactive_state_t *state) {
     printf("> ");
     fflush(stdout);
     
-    // Simple line input in raw mode
-    while (creating) {
-        char c = read_single_char_optimized();
-        
-        switch (c) {
-            case '\n':  // Enter - finish input
-                creating = 0;
-                break;
-                
-            case 127:   // Backspace
-            case '\b':  // Sometimes backspace sends \b
-                if (pos > 0) {
-                    pos--;
-                    name_buf[pos] = '\0';
-                    printf("\b \b");  // Erase character from display
-                    fflush(stdout);
-                }
-                break;
-                
-            case '\033':  // Escape - cancel
-                pos = 0;
-                name_buf[0] = '\0';
-                creating = 0;
-                break;
-                
-            default:
-                // Only accept printable characters and don't overflow buffer
-                if (c >= 32 && c <= 126 && pos < (int)sizeof(name_buf) - 1) {
-                    name_buf[pos++] = c;
-                    name_buf[pos] = '\0';
-                    putchar(c);
-                    fflush(stdout);
-                }
-                break;
-        }
-    }
+    int pos = read_line(name_buf, sizeof(name_buf));
     
     // Process the created name
     if (pos > 0) {
@@ -557,9 +972,9 @@ static void create_new_file_or_dir(interactive_state_t *state) {
             // Create directory with standard permissions
             result = mkdir(full_path, 0755);
             if (result == 0) {
-                printf("\n\033[1;32m✓ Directory '%s' created successfully!\033[0m\n", name_buf);
+                set_status(state, 1, "Directory '%s' created successfully!", name_buf);
             } else {
-                printf("\n\033[1;31m✗ Failed to create directory: %s\033[0m\n", strerror(errno));
+                set_status(state, 0, "Failed to create directory: %s", strerror(errno));
             }
         } else {
             // Create empty file (like touch command)
@@ -567,10 +982,10 @@ static void create_new_file_or_dir(interactive_state_t *state) {
             if (f) {
                 fclose(f);
                 result = 0;
-                printf("\n\033[1;32m✓ File '%s' created successfully!\033[0m\n", name_buf);
+                set_status(state, 1, "File '%s' created successfully!", name_buf);
             } else {
                 result = -1;
-                printf("\n\033[1;31m✗ Failed to create file: %s\033[0m\n", strerror(errno));
+                set_status(state, 0, "Failed to create file: %s", strerror(errno));
             }
         }
         
@@ -581,25 +996,38 @@ static void create_new_file_or_dir(interactive_state_t *state) {
     }
 }
 
-// Delete selected file or directory with confirmation
+// Delete the selected entries (or the one under the cursor) with confirmation
 static void delete_selected_entry(interactive_state_t *state) {
-    if (state->entries.used == 0) return;
+    char **targets;
+    size_t n = collect_targets(state, &targets);
+    if (n == 0) return;
     
-    file_entry_t *entry = &state->entries.arr[state->cursor_pos];
+    file_entry_t *entry = cursor_entry(state);
+    int batch = (count_selected(state) > 0);
     
     // Show confirmation prompt
     clear_screen();
     printf("\033[1;31m=== DELETE CONFIRMATION ===\033[0m\n\n");
     printf("Are you sure you want to delete:\n");
-    printf("Name: %s\n", entry->name);
-    printf("Path: %s\n", entry->path);
-    
-    if (entry->st_valid) {
-        if (S_ISDIR(entry->st.st_mode)) {
-            printf("Type: Directory\n");
-        } else {
-            printf("Type: File\n");
-            printf("Size: %ld bytes\n", (long)entry->st.st_size);
+    if (batch) {
+        // List the first few so a stray selection is easy to spot
+        printf("%zu selected entries in %s\n", n, state->current_path);
+        for (size_t i = 0; i < n && i < 10; i++) {
+            printf("  %s\n", strrchr(targets[i], '/') + 1);
+        }
+        if (n > 10) printf("  ... and %zu more\n", n - 10);
+        printf("Directories are deleted with everything in them.\n");
+    } else {
+        printf("Name: %s\n", entry->name);
+        printf("Path: %s\n", entry->path);
+        
+        if (entry->st_valid) {
+            if (S_ISDIR(entry->st.st_mode)) {
+                printf("Type: Directory (and everything in it)\n");
+            } else {
+                printf("Type: File\n");
+                printf("Size: %ld bytes\n", (long)entry->st.st_size);
+            }
         }
     }
     
@@ -607,230 +1035,1451 @@ static void delete_selected_entry(interactive_state_t *state) {
     printf("\nPress 'y' to confirm, any other key to cancel: ");
     fflush(stdout);
     
-    char confirm = read_single_char_optimized();
-    if (confirm == 'y' || confirm == 'Y') {
-        int result;
-        if (entry->st_valid && S_ISDIR(entry->st.st_mode)) {
-            result = rmdir(entry->path);
-        } else {
-            result = unlink(entry->path);
-        }
-        
-        if (result == 0) {
-            printf("\n\033[1;32m✓ Deleted successfully!\033[0m\n");
+    int confirm = read_key();
+    if (confirm != 'y' && confirm != 'Y') {
+        snprintf(state->status_msg, sizeof(state->status_msg), "Deletion cancelled.");
+        free(targets);
+        return;
+    }
+    
+    if (batch) {
+        // The whole selection goes to the worker as one job
+        job_t *job = jobs_submit(JOB_DELETE, targets, n, NULL);
+        if (job) {
+            set_status(state, 1, "Deleting %zu items in the background (job #%u, X=cancel)", n, job->id);
+            selection_clear(&state->selection);
             state->needs_refresh = 1;
         } else {
-            printf("\n\033[1;31m✗ Failed to delete: %s\033[0m\n", strerror(errno));
+            set_status(state, 0, "Failed to start delete: %s", strerror(errno));
+        }
+        free(targets);
+        return;
+    }
+    free(targets);
+    
+    int result;
+    if (entry->st_valid && S_ISDIR(entry->st.st_mode)) {
+        result = rmdir(entry->path);
+        if (result != 0 && (errno == ENOTEMPTY || errno == EEXIST)) {
+            // Not empty: remove the tree on the background worker
+            job_t *job = jobs_submit(JOB_DELETE, &entry->path, 1, NULL);
+            if (job) {
+                set_status(state, 1, "Deleting '%s' in the background (job #%u, X=cancel)",
+                           entry->name, job->id);
+            } else {
+                set_status(state, 0, "Failed to start delete: %s", strerror(errno));
+            }
+            return;
         }
     } else {
-        printf("\nDeletion cancelled.\n");
+        result = unlink(entry->path);
     }
-}
-
-// Copy file implementation
-static int copy_file(const char *src, const char *dst) {
-    FILE *src_file = fopen(src, "rb");
-    if (!src_file) return -1;
     
-    FILE *dst_file = fopen(dst, "wb");
-    if (!dst_file) {
-        fclose(src_file);
-        return -1;
+    if (result == 0) {
+        set_status(state, 1, "Deleted '%s' successfully!", entry->name);
+        state->needs_refresh = 1;
+    } else {
+        set_status(state, 0, "Failed to delete: %s", strerror(errno));
     }
-    
-    char buffer[8192];
-    size_t bytes;
-    int success = 0;
-    
-    while ((bytes = fread(buffer, 1, sizeof(buffer), src_file)) > 0) {
-        if (fwrite(buffer, 1, bytes, dst_file) != bytes) {
-            success = -1;
-            break;
-        }
+}
+
+// Empty the clipboard
+static void clear_clipboard(interactive_state_t *state) {
+    for (size_t i = 0; i < state->clipboard_count; i++) {
+        free(state->clipboard[i]);
     }
-    
-    fclose(src_file);
-    fclose(dst_file);
-    return success;
+    free(state->clipboard);
+    state->clipboard = NULL;
+    state->clipboard_count = 0;
 }
 
-// Copy directory recursively
-static int copy_directory(const char *src, const char *dst) {
-    // Create destination directory
-    if (mkdir(dst, 0755) != 0) return -1;
-    
-    DIR *dir = opendir(src);
-    if (!dir) return -1;
-    
-    struct dirent *entry;
-    int success = 0;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        char src_path[PATH_MAX];
-        char dst_path[PATH_MAX];
-        snprintf(src_path, sizeof(src_path), "%s/%s", src, entry->d_name);
-        snprintf(dst_path, sizeof(dst_path), "%s/%s", dst, entry->d_name);
-        
-        struct stat st;
-        if (lstat(src_path, &st) != 0) {
-            success = -1;
-            break;
+// Put the selected entries (or the one under the cursor) on the clipboard
+static void clip_selected_entries(interactive_state_t *state, int is_move) {
+    char **targets;
+    size_t n = collect_targets(state, &targets);
+    if (n == 0) return;
+    
+    clear_clipboard(state);
+    state->clipboard = malloc(n * sizeof(char *));
+    if (!state->clipboard) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < n; i++) {
+        state->clipboard[i] = strdup(targets[i]);
+        if (!state->clipboard[i]) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
         }
-        
-        if (S_ISDIR(st.st_mode)) {
-            if (copy_directory(src_path, dst_path) != 0) {
-                success = -1;
-                break;
-            }
-        } else {
-            if (copy_file(src_path, dst_path) != 0) {
-                success = -1;
-                break;
-            }
+    }
+    state->clipboard_count = n;
+    state->clipboard_is_move = is_move;
+    free(targets);
+    
+    // The selection has done its job; don't leave it armed for a delete
+    if (state->selection.count > 0) {
+        selection_clear(&state->selection);
+        for (size_t i = 0; i < state->entries.used; i++) {
+            state->entries.arr[i].is_selected = 0;
         }
     }
     
-    closedir(dir);
-    return success;
+    char what[PATH_MAX + 8];
+    describe_paths(state->clipboard, n, what, sizeof(what));
+    set_status(state, 1, "%s %s to clipboard", is_move ? "Cut" : "Copied", what);
 }
 
-// Copy selected entry to clipboard
+// Copy selected entries to clipboard
 static void copy_selected_entry(interactive_state_t *state) {
-    if (state->entries.used == 0) return;
-    
-    file_entry_t *entry = &state->entries.arr[state->cursor_pos];
-    
-    // Free existing clipboard
-    if (state->clipboard_path) {
-        free(state->clipboard_path);
-    }
+    clip_selected_entries(state, 0);
+}
+
+// Move selected entries to clipboard
+static void move_selected_entry(interactive_state_t *state) {
+    clip_selected_entries(state, 1);
+}
+
+// Paste the clipboard into the current directory as one background job
+static void paste_from_clipboard(interactive_state_t *state) {
+    if (state->clipboard_count == 0) {
+        set_status(state, 0, "Clipboard is empty");
+        return;
+    }
     
-    state->clipboard_path = strdup(entry->path);
-    state->clipboard_is_move = 0;
+    char what[PATH_MAX + 8];
+    describe_paths(state->clipboard, state->clipboard_count, what, sizeof(what));
+    
+    // The worker plans the paste first - name conflicts (nothing is ever
+    // pasted over an existing entry), a parallel pre-scan and a free-space
+    // check - and only then copies. Moves are renames when they can be,
+    // copy + delete across filesystems.
+    int is_move = state->clipboard_is_move;
+    job_t *job = jobs_submit(is_move ? JOB_MOVE : JOB_COPY, state->clipboard,
+                             state->clipboard_count, state->current_path);
+    if (!job) {
+        set_status(state, 0, "Failed to start %s: %s", is_move ? "move" : "copy", strerror(errno));
+        return;
+    }
+    set_status(state, 1, "%s %s in the background (job #%u, X=cancel)",
+               is_move ? "Moving" : "Copying", what, job->id);
+    if (is_move) {
+        clear_clipboard(state);  // The sources won't be there any more
+    }
+}
+
+// Throw away the last search and its results
+static void clear_search(interactive_state_t *state) {
+    search_free(state->search);
+    state->search = NULL;
+    for (size_t i = 0; i < state->hits_used; i++) {
+        search_hit_free(&state->hits[i]);
+    }
+    free(state->hits);
+    state->hits = NULL;
+    state->hits_used = state->hits_cap = 0;
+    free(state->search_root);
+    state->search_root = NULL;
+}
+
+// Show the search results instead of the folder
+static void show_search(interactive_state_t *state) {
+    state->search_view = 1;
+    state->listing_gen++;  // The list area changes completely
+}
+
+// Start a search below the current folder and show its results
+static void run_search(interactive_state_t *state, const char *pattern, search_syntax_t syntax) {
+    search_opts_t opts = { syntax, state->flags.show_all, state->flags.max_search_size };
+    char err[256];
+    search_t *search = search_start(state->current_path, pattern, &opts, events_wakeup,
+                                    err, sizeof(err));
+    if (!search) {
+        set_status(state, 0, "Can't search for '%s': %s", pattern, err);
+        return;
+    }
+    clear_search(state);
+    state->search = search;
+    state->search_root = strdup(state->current_path);
+    snprintf(state->search_pattern, sizeof(state->search_pattern), "%s", pattern);
+    state->search_syntax = syntax;
+    state->search_stopped = 0;
+    state->search_reported = 0;
+    state->hit_cursor = 0;
+    state->hit_scroll = 0;
+    show_search(state);
+}
+
+// Ask for a name pattern and search below the current folder. An empty
+// pattern goes back to the last results.
+static void start_search(interactive_state_t *state) {
+    char pattern[sizeof(state->search_pattern)];
+    int len = 0;
+    search_syntax_t syntax = state->search_syntax == SEARCH_REGEX ? SEARCH_REGEX : SEARCH_GLOB;
+    
+    clear_screen();
+    printf("\033[1;36m=== FIND BY NAME ===\033[0m\n\n");
+    printf("Searching below: %s\n\n", state->current_path);
+    printf("Glob such as *.c or Makefile*, or an extended regex (Tab switches).\n");
+    printf("Lower-case patterns ignore case. Empty shows the last results.\n\n");
+    
+    pattern[0] = '\0';
+    for (;;) {
+        printf("\r\033[K%s> %s", syntax == SEARCH_REGEX ? "regex" : "glob", pattern);
+        fflush(stdout);
+        
+        int key = read_key();
+        if (key == '\t') {
+            syntax = (syntax == SEARCH_REGEX) ? SEARCH_GLOB : SEARCH_REGEX;
+            continue;
+        }
+        int r = line_edit(pattern, sizeof(pattern), &len, key);
+        if (r == LINE_CANCEL) return;
+        if (r == LINE_DONE) break;
+    }
     
-    printf("\n\033[1;32m✓ Copied '%s' to clipboard\033[0m\n", entry->name);
+    if (len == 0) {
+        if (state->search) show_search(state);
+        return;
+    }
+    run_search(state, pattern, syntax);
+}
+
+// Ask for some text and look for it inside the files below the current
+// folder. An empty answer goes back to the last results.
+static void start_grep(interactive_state_t *state) {
+    char text[sizeof(state->search_pattern)];
+    
+    clear_screen();
+    printf("\033[1;36m=== FIND TEXT IN FILES ===\033[0m\n\n");
+    printf("Searching files below: %s\n", state->current_path);
+    if (state->flags.max_search_size) {
+        char size_buf[32];
+        human_size((off_t)state->flags.max_search_size, size_buf, sizeof(size_buf));
+        printf("Skipping files over %s and binary files%s.\n", size_buf,
+               state->flags.show_all ? "" : ", hidden entries");
+    } else {
+        printf("Skipping binary files%s.\n", state->flags.show_all ? "" : " and hidden entries");
+    }
+    printf("\nText to find (lower case ignores case, empty shows the last results):\n");
+    printf("> ");
+    fflush(stdout);
+    
+    if (read_line(text, sizeof(text)) == 0) {
+        if (state->search) show_search(state);
+        return;
+    }
+    run_search(state, text, SEARCH_CONTENT);
+}
+
+// Pick up hits the walkers found since last time
+static void search_update(interactive_state_t *state) {
+    if (!state->search) return;
+    
+    size_t n;
+    search_hit_t *hits = search_collect(state->search, &n, 0);
+    if (hits) {
+        if (state->hits_used + n > state->hits_cap) {
+            size_t cap = state->hits_cap ? state->hits_cap : 256;
+            while (cap < state->hits_used + n) cap *= 2;
+            search_hit_t *grown = realloc(state->hits, cap * sizeof(search_hit_t));
+            if (!grown) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            state->hits = grown;
+            state->hits_cap = cap;
+        }
+        memcpy(state->hits + state->hits_used, hits, n * sizeof(search_hit_t));
+        state->hits_used += n;
+        free(hits);
+    }
+    
+    if (!state->search_reported && !search_running(state->search)) {
+        search_progress_t pr;
+        search_get_progress(state->search, &pr);
+        state->search_reported = 1;
+        if (state->search_syntax == SEARCH_CONTENT) {
+            set_status(state, state->hits_used > 0, "%s: %zu matching line%s for '%s' in %lu files",
+                       state->search_stopped ? "Search stopped" : "Search finished",
+                       state->hits_used, state->hits_used == 1 ? "" : "s",
+                       state->search_pattern, pr.files);
+        } else {
+            set_status(state, state->hits_used > 0, "%s: %zu match%s for '%s' in %lu folders",
+                       state->search_stopped ? "Search stopped" : "Search finished",
+                       state->hits_used, state->hits_used == 1 ? "" : "es",
+                       state->search_pattern, pr.dirs);
+        }
+    }
+}
+
+static void close_viewer(interactive_state_t *state) {
+    if (state->viewer_follow) {
+        events_unwatch_file();
+        state->viewer_follow = 0;
+    }
+    viewer_close(state->viewer);
+    hexview_close(state->hexview);
+    state->viewer = NULL;
+    state->hexview = NULL;
+    state->viewer_prompt = 0;
+    state->listing_gen++;  // Repaint the listing in full
+}
+
+// Open a file as a hex dump with 'offset' in the top row
+static void open_hexview(interactive_state_t *state, const char *path, unsigned long long offset) {
+    char err[128];
+    hexview_t *h = hexview_open(path, err, sizeof(err));
+    if (!h) {
+        set_status(state, 0, "Can't view '%s': %s", path, err);
+        return;
+    }
+    close_viewer(state);
+    state->hexview = h;
+    state->status_msg[0] = '\0';
+    hexview_goto(h, offset);
+}
+
+// Open a file in the built-in viewer, at 'line' (1-based) unless it is
+// 0. Binary files get the hex dump instead.
+static void open_viewer(interactive_state_t *state, const char *path, unsigned long line) {
+    char err[128];
+    viewer_t *v = viewer_open(path, err, sizeof(err));
+    if (!v) {
+        set_status(state, 0, "Can't view '%s': %s", path, err);
+        return;
+    }
+    if (line == 0 && viewer_is_binary(v)) {
+        viewer_close(v);
+        open_hexview(state, path, 0);
+        return;
+    }
+    close_viewer(state);
+    state->viewer = v;
+    state->status_msg[0] = '\0';
+    if (line > 0) viewer_goto_line(v, line);
+}
+
+// Switch between text and hex at the same place in the file
+static void toggle_hex(interactive_state_t *state) {
+    char *path;
+    if (state->hexview) {
+        unsigned long long offset = hexview_offset(state->hexview);
+        path = strdup(hexview_path(state->hexview));
+        if (!path) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        char err[128];
+        viewer_t *v = viewer_open(path, err, sizeof(err));
+        if (!v) {
+            set_status(state, 0, "Can't view '%s': %s", path, err);
+        } else {
+            close_viewer(state);
+            state->viewer = v;
+            viewer_goto_offset(v, (size_t)offset);
+        }
+    } else {
+        path = strdup(viewer_path(state->viewer));
+        if (!path) {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        open_hexview(state, path, viewer_offset(state->viewer));
+    }
+    free(path);
+}
+
+// Rows of text the viewer shows (header, status and footer take the rest)
+static int viewer_rows(void) {
+    int rows = term_rows() - 3;
+    return rows > 0 ? rows : 1;
+}
+
+// F in the viewer: watch the file and keep its end on screen as it grows
+static void toggle_follow(interactive_state_t *state) {
+    if (state->viewer_follow) {
+        events_unwatch_file();
+        state->viewer_follow = 0;
+        set_status(state, 1, "Stopped following");
+        return;
+    }
+    if (events_watch_file(viewer_path(state->viewer)) != 0) {
+        set_status(state, 0, "Can't watch the file: %s", strerror(errno));
+        return;
+    }
+    state->viewer_follow = 1;
+    viewer_reload(state->viewer);  // Anything written since it was opened
+    viewer_bottom(state->viewer, viewer_rows());
+}
+
+// The followed file changed. New lines are shown if the end of the file
+// was on screen; scrolling up to read something keeps the view still.
+static void follow_update(interactive_state_t *state) {
+    if (!state->viewer || !state->viewer_follow) return;
+    viewer_t *v = state->viewer;
+    int at_end = viewer_at_end(v);
+    
+    switch (viewer_reload(v)) {
+        case VIEWER_SAME:
+            return;
+            
+        case VIEWER_GREW:
+            break;
+            
+        case VIEWER_TRUNCATED:
+            set_status(state, 0, "File was truncated - showing it from the start");
+            at_end = 1;
+            break;
+            
+        case VIEWER_REPLACED:
+            // The old watch is on the rotated file; watch the new one
+            events_watch_file(viewer_path(v));
+            set_status(state, 0, "File was replaced (rotated) - following the new one");
+            at_end = 1;
+            break;
+            
+        case VIEWER_FAILED:
+            set_status(state, 0, "Can't read the file any more: %s", strerror(errno));
+            return;
+    }
+    if (at_end) viewer_bottom(v, viewer_rows());
+}
+
+// Scroll whichever view is open
+static void view_scroll(interactive_state_t *state, long rows) {
+    if (state->hexview) {
+        hexview_scroll(state->hexview, rows);
+    } else {
+        viewer_scroll(state->viewer, rows);
+    }
+}
+
+// ':' in the hex view: an offset (0x for hex) or a percentage
+static void hex_goto(interactive_state_t *state, const char *text) {
+    int is_hex = (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'));
+    char *end;
+    unsigned long long n = strtoull(text, &end, is_hex ? 16 : 10);
+    if (end == text || (*end && strcmp(end, "%") != 0) || (is_hex && *end)) {
+        set_status(state, 0, "Type an offset such as 4096 or 0x1000, or a percentage such as 50%%");
+    } else if (*end == '%') {
+        hexview_goto_percent(state->hexview, n > 100 ? 100 : (unsigned)n);
+    } else {
+        hexview_goto(state->hexview, n);
+    }
+}
+
+// '/' or '?' in the hex view: bytes in hex, or "text" in quotes
+static int hex_search(interactive_state_t *state, const char *text, int backward) {
+    char pattern[sizeof(state->viewer_input)];
+    int len = hexview_parse_pattern(text, pattern, sizeof(pattern));
+    if (len < 0) {
+        set_status(state, 0, "Type bytes in hex such as 7f 45 4c 46, or text in quotes");
+        return 1;
+    }
+    return len > 0 ? hexview_search(state->hexview, pattern, (size_t)len, backward)
+                   : hexview_search_next(state->hexview, backward);
+}
+
+// Run what was typed at the viewer's prompt: a search, or ':' with a
+// line number (an offset in hex) or a percentage
+static void viewer_command(interactive_state_t *state) {
+    viewer_t *v = state->viewer;
+    const char *text = state->viewer_input;
+    int backward = (state->viewer_prompt == '?');
+    
+    if (state->hexview) {
+        if (state->viewer_prompt == ':') {
+            hex_goto(state, text);
+        } else if (!hex_search(state, text, backward)) {
+            set_status(state, 0, "Not found%s", backward ? " (searching backward)" : "");
+        }
+        return;
+    }
+    
+    if (state->viewer_prompt == ':') {
+        char *end;
+        unsigned long n = strtoul(text, &end, 10);
+        if (end == text || (*end && strcmp(end, "%") != 0)) {
+            set_status(state, 0, "Type a line number, or a percentage such as 50%%");
+        } else if (*end == '%') {
+            viewer_goto_percent(v, n > 100 ? 100 : (unsigned)n);
+        } else if (viewer_goto_line(v, n) != 0) {
+            set_status(state, 0, "There are fewer than %lu lines", n);
+        }
+        return;
+    }
+    
+    int found = text[0] ? viewer_search(v, text, backward) : viewer_search_next(v, backward);
+    if (!found) {
+        set_status(state, 0, "Not found%s", backward ? " (searching backward)" : "");
+    }
+}
+
+// A key pressed while the viewer (text or hex) is open
+static void viewer_key(interactive_state_t *state, int key) {
+    int page = viewer_rows() - 1;
+    if (page < 1) page = 1;
+    
+    if (state->viewer_prompt) {
+        switch (line_edit(state->viewer_input, sizeof(state->viewer_input),
+                          &state->viewer_input_len, key)) {
+            case LINE_DONE:
+                viewer_command(state);
+                state->viewer_prompt = 0;
+                break;
+                
+            case LINE_CANCEL:
+                state->viewer_prompt = 0;
+                break;
+        }
+        return;
+    }
+    
+    switch (key) {
+        case 'j':
+        case '\n':
+            view_scroll(state, 1);
+            break;
+            
+        case 'k':
+            view_scroll(state, -1);
+            break;
+            
+        case ' ':
+        case 'f':
+            view_scroll(state, page);
+            break;
+            
+        case 'b':
+            view_scroll(state, -page);
+            break;
+            
+        case 'd':
+            view_scroll(state, page / 2 + 1);
+            break;
+            
+        case 'u':
+            view_scroll(state, -(page / 2 + 1));
+            break;
+            
+        case 'g':
+            if (state->hexview) {
+                hexview_goto(state->hexview, 0);
+            } else {
+                viewer_top(state->viewer);
+            }
+            break;
+            
+        case 'G':
+            if (state->hexview) {
+                hexview_bottom(state->hexview, viewer_rows());
+            } else {
+                viewer_bottom(state->viewer, viewer_rows());
+            }
+            break;
+            
+        case 'l':
+            if (state->viewer) viewer_hscroll(state->viewer, 8);
+            break;
+            
+        case 'h':
+            if (state->viewer) viewer_hscroll(state->viewer, -8);
+            break;
+            
+        case 'x':  // Text <-> hex
+            toggle_hex(state);
+            break;
+            
+        case 'F':  // Follow the file as it grows (tail -f)
+            if (state->viewer) toggle_follow(state);
+            break;
+            
+        case '/':
+        case '?':
+        case ':':
+            state->viewer_prompt = key;
+            state->viewer_input[0] = '\0';
+            state->viewer_input_len = 0;
+            break;
+            
+        case 'n':
+        case 'N': {
+            int found = state->hexview ? hexview_search_next(state->hexview, key == 'N')
+                                       : viewer_search_next(state->viewer, key == 'N');
+            if (!found) set_status(state, 0, "No more matches");
+            break;
+        }
+            
+        case 'q':
+        case KEY_ESC:
+            close_viewer(state);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// Draw the viewer in place of the listing
+static void display_viewer(interactive_state_t *state) {
+    int term_height = term_rows();
+    int term_width = term_cols();
+    int rows = viewer_rows();
+    hexview_t *hex = state->hexview;
+    
+    screen_begin(term_height, term_width);
+    ob_printf(screen_row(0), "\033[1;36m=== %s %s ===\033[0m", hex ? "HEX" : "VIEW",
+              hex ? hexview_path(hex) : viewer_path(state->viewer));
+    if (hex) {
+        hexview_draw(hex, 1, rows);
+    } else {
+        viewer_draw(state->viewer, 1, rows, term_width);
+    }
+    
+    outbuf_t *status = screen_row(1 + rows);
+    if (state->viewer_prompt) {
+        const char *what = state->viewer_prompt == ':' ? (hex ? "offset, 0x offset or percentage"
+                                                              : "line number or percentage")
+                         : hex ? "hex bytes or \"text\""
+                         : state->viewer_prompt == '/' ? "search forward" : "search backward";
+        ob_printf(status, "\033[1m%c%s\033[0m_  \033[2m(%s - Enter=go, Esc=cancel)\033[0m",
+                  state->viewer_prompt, state->viewer_input, what);
+    } else {
+        ob_puts(status, "\033[1m");
+        if (hex) {
+            hexview_status(hex, status);
+        } else {
+            viewer_status(state->viewer, status);
+        }
+        ob_puts(status, "\033[0m");
+        if (state->viewer_follow) ob_puts(status, " \033[1;32m[following]\033[0m");
+        if (state->status_msg[0]) ob_printf(status, "  %s", state->status_msg);
+    }
+    ob_puts(screen_row(2 + rows), hex
+            ? "\033[1;33mControls:\033[0m j/k=Row, Space/b=Page, g/G=Start/End, :=Offset or %, /?=Find bytes, n/N=Next/Prev, x=Text, q=Close"
+            : "\033[1;33mControls:\033[0m j/k=Line, Space/b=Page, g/G=Top/End, h/l=Left/Right, /?=Search, n/N=Next/Prev, :=Line or %, F=Follow, x=Hex, q=Close");
+    screen_flush();
+}
+
+// Go into folder 'path', or to the folder a file is in with the cursor on it
+static void go_to_path(interactive_state_t *state, const char *path, int is_dir) {
+    char *target;
+    if (is_dir) {
+        target = strdup(path);
+    } else {
+        const char *slash = strrchr(path, '/');
+        target = strndup(path, slash > path ? (size_t)(slash - path) : 1);
+        free(state->cursor_name);
+        state->cursor_name = strdup(slash + 1);
+    }
+    if (!target) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    
+    history_push(&state->history, state->current_path);
+    free(state->current_path);
+    state->current_path = target;
+    state->needs_refresh = 1;
+}
+
+// Go to a search hit: into it if it is a folder, else to its folder
+// with the cursor on it
+static void open_hit(interactive_state_t *state) {
+    if (state->hits_used == 0) return;
+    const char *hit = state->hits[state->hit_cursor].path;
+    
+    struct stat st;
+    if (lstat(hit, &st) != 0) {
+        set_status(state, 0, "Can't open '%s': %s", hit, strerror(errno));
+        return;
+    }
+    
+    if (state->hits[state->hit_cursor].line > 0) {
+        open_viewer(state, hit, state->hits[state->hit_cursor].line);
+        return;
+    }
+    go_to_path(state, hit, S_ISDIR(st.st_mode));
+    state->search_view = 0;
+}
+
+// A key pressed while the search results are shown. Returns 0 for keys
+// that keep their usual meaning (quit, help).
+static int search_key(interactive_state_t *state, int key) {
+    switch (key) {
+        case 'q':
+        case '?':
+        case KEY_NONE:
+            return 0;
+            
+        case 'j':
+            if (state->hit_cursor < (int)state->hits_used - 1) state->hit_cursor++;
+            break;
+            
+        case 'k':
+            if (state->hit_cursor > 0) state->hit_cursor--;
+            break;
+            
+        case '\n':
+            open_hit(state);
+            break;
+            
+        case 'X':  // Stop the search (a background job if the search is over)
+            if (search_running(state->search)) {
+                search_cancel(state->search);
+                state->search_stopped = 1;
+                set_status(state, 0, "Stopping search...");
+            } else {
+                return 0;
+            }
+            break;
+            
+        case 'F':
+            start_search(state);
+            break;
+            
+        case 'G':
+            start_grep(state);
+            break;
+            
+        case KEY_ESC:
+        case 'b':  // Back to the folder; F then Enter shows the results again
+            state->search_view = 0;
+            state->listing_gen++;
+            break;
+            
+        default:
+            break;  // Folder keys don't apply here
+    }
+    return 1;
+}
+
+// Is 'path' directly inside directory 'dir'?
+static int path_is_in_dir(const char *path, const char *dir) {
+    size_t n = strlen(dir);
+    return strncmp(path, dir, n) == 0 && path[n] == '/' && !strchr(path + n + 1, '/');
+}
+
+// Reload the listing but keep the cursor on the same file if it still exists
+static void reload_keep_cursor(interactive_state_t *state) {
+    file_entry_t *cur = cursor_entry(state);
+    char *keep = cur ? strdup(cur->name) : NULL;
+    int old_cursor = state->cursor_pos;
+    int old_scroll = state->scroll_offset;
+    
+    load_directory(state);
+    
+    if (find_cursor(state, keep)) {
+        state->scroll_offset = old_scroll + (state->cursor_pos - old_cursor);
+        if (state->scroll_offset < 0) state->scroll_offset = 0;
+    }
+    free(keep);
+}
+
+// Collect finished background jobs: report them and refresh the listing
+// if they changed the folder we are looking at
+static void reap_jobs(interactive_state_t *state) {
+    job_t *job;
+    while ((job = jobs_reap()) != NULL) {
+        char name[PATH_MAX + 8];
+        describe_paths(job->src, job->count, name, sizeof(name));
+        
+        const char *done_verb = "Copied", *verb = "copy", *noun = "Copy";
+        const char *cancel_note = "partial copy left behind";
+        if (job->kind == JOB_MOVE) {
+            done_verb = "Moved";
+            verb = "move";
+            noun = "Move";
+            cancel_note = "finished parts were moved, the rest is still at the source";
+        } else if (job->kind == JOB_DELETE) {
+            done_verb = "Deleted";
+            verb = "delete";
+            noun = "Delete";
+            cancel_note = "entries already removed are gone";
+        }
+        
+        switch (atomic_load(&job->state)) {
+            case JOB_DONE:
+                set_status(state, 1, "%s %s successfully! (%lu %s)", done_verb, name,
+                           (unsigned long)atomic_load(&job->progress.files_done),
+                           job->kind == JOB_DELETE ? "entries" : "files");
+                break;
+            case JOB_CANCELLED:
+                set_status(state, 0, "%s of %s cancelled (%s)", noun, name, cancel_note);
+                break;
+            default: {
+                unsigned long errors = atomic_load(&job->progress.errors);
+                fileop_error_t *first = job->progress.err_head;
+                if (!job->planned && job->error == ENOSPC) {
+                    char need[32], have[32];
+                    human_size((off_t)job->space_needed, need, sizeof(need));
+                    human_size((off_t)job->space_free, have, sizeof(have));
+                    set_status(state, 0, "%s of %s not started: needs %s, only %s free here",
+                               noun, name, need, have);
+                } else if (!job->planned && errors > 0 && first) {
+                    // Planning found names that would be overwritten
+                    set_status(state, 0, "%s of %s not started: %lu conflict%s (first: %s: %s)",
+                               noun, name, errors, errors == 1 ? "" : "s", first->path,
+                               strerror(first->err));
+                } else if (errors > 0 && first) {
+                    // Tree operations keep going past failures - summarise them
+                    set_status(state, 0, "%s %s with %lu error%s (first: %s: %s)", done_verb,
+                               name, errors, errors == 1 ? "" : "s", first->path, strerror(first->err));
+                } else {
+                    set_status(state, 0, "Failed to %s %s: %s", verb, name, strerror(job->error));
+                }
+                break;
+            }
+        }
+        
+        // Moves and deletes also change the folder the sources were in
+        if ((job->dst && strcmp(job->dst, state->current_path) == 0) ||
+            (job->kind != JOB_COPY && path_is_in_dir(job->src[0], state->current_path))) {
+            reload_keep_cursor(state);
+        }
+        job_free(job);
+    }
+}
+
+// Format seconds as m:ss or h:mm:ss
+static void format_eta(double secs, char *buf, size_t n) {
+    unsigned long t = secs > 0 ? (unsigned long)(secs + 0.5) : 0;
+    if (t >= 3600) {
+        snprintf(buf, n, "%lu:%02lu:%02lu", t / 3600, (t / 60) % 60, t % 60);
+    } else {
+        snprintf(buf, n, "%lu:%02lu", t / 60, t % 60);
+    }
+}
+
+// One-line progress bar for the running background job
+static void format_job_progress(outbuf_t *ob, job_t *job) {
+    fileop_progress_t *p = &job->progress;
+    char name[PATH_MAX + 8];
+    describe_paths(job->src, job->count, name, sizeof(name));
+    
+    unsigned long files_done = atomic_load(&p->files_done);
+    unsigned long files_total = atomic_load(&p->files_total);
+    
+    // job->started is written before the worker publishes JOB_RUNNING, so
+    // it may only be read once this load has seen that state
+    if (atomic_load_explicit(&job->state, memory_order_acquire) != JOB_RUNNING) {
+        char size_buf[32];
+        human_size((off_t)atomic_load(&p->bytes_total), size_buf, sizeof(size_buf));
+        ob_printf(ob, "\033[1;35mJob #%u %s %s: planning... %lu files, %s\033[0m (X=cancel)",
+                  job->id, job_kind_name(job->kind), name, files_total, size_buf);
+        return;
+    }
+    
+    // Time spent on the operation so far, for rates and ETA
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - job->started.tv_sec) +
+                     (now.tv_nsec - job->started.tv_nsec) / 1e9;
+    
+    if (job->kind == JOB_DELETE) {
+        // Deletes have no pre-scan, so there is no percentage - just a count
+        double rate = elapsed > 0 ? files_done / elapsed : 0;
+        ob_printf(ob, "\033[1;35mJob #%u DELETE %s: %lu removed, %lu found, %.0f entries/s\033[0m (X=cancel)",
+                  job->id, name, files_done, files_total, rate);
+        return;
+    }
+    
+    unsigned long long done = atomic_load(&p->bytes_done);
+    unsigned long long total = atomic_load(&p->bytes_total);
+    double frac = total ? (double)done / (double)total : 0.0;
+    if (frac > 1.0) frac = 1.0;
+    
+    double rate = elapsed > 0 ? done / elapsed : 0;
+    char rate_buf[32], eta_buf[32];
+    human_size((off_t)rate, rate_buf, sizeof(rate_buf));
+    if (rate > 0 && total >= done) {
+        format_eta((total - done) / rate, eta_buf, sizeof(eta_buf));
+    } else {
+        snprintf(eta_buf, sizeof(eta_buf), "--:--");
+    }
+    
+    char bar[21];
+    int filled = (int)(frac * 20);
+    for (int i = 0; i < 20; i++) bar[i] = i < filled ? '#' : '.';
+    bar[20] = '\0';
+    
+    ob_printf(ob, "\033[1;35mJob #%u %s %s [%s] %3d%% %s/s %lu/%lu files ETA %s\033[0m (X=cancel)",
+              job->id, job_kind_name(job->kind), name, bar, (int)(frac * 100), rate_buf,
+              files_done, files_total, eta_buf);
+}
+
+// ---- Checksums ----
+
+// Throw away the last checksum run and its results (cached digests stay)
+static void clear_checksums(interactive_state_t *state) {
+    checksum_free(state->checksum);
+    state->checksum = NULL;
+    for (size_t i = 0; i < state->sums_used; i++) {
+        checksum_result_free(&state->sums[i]);
+    }
+    free(state->sums);
+    state->sums = NULL;
+    state->sums_used = state->sums_cap = 0;
+    free(state->checksum_root);
+    state->checksum_root = NULL;
+}
+
+// Ask for an algorithm and hash the selected entries (or the one under
+// the cursor) in the background, folders with everything in them
+static void start_checksum(interactive_state_t *state) {
+    if (state->checksum && checksum_running(state->checksum)) {
+        set_status(state, 0, "Checksums are still running (X stops them)");
+        return;
+    }
+    char **targets;
+    size_t n = collect_targets(state, &targets);
+    if (n == 0) return;
+    char what[PATH_MAX + 8];
+    describe_paths(targets, n, what, sizeof(what));
+    
+    clear_screen();
+    printf("\033[1;36m=== CHECKSUMS ===\033[0m\n\n");
+    printf("Hash %s in %s (folders with everything in them%s)\n\n", what, state->current_path,
+           state->flags.show_all ? "" : ", hidden entries skipped");
+    printf("  c - CRC32C   (fastest; big files are read in parallel parts)\n");
+    printf("  x - xxHash64 (as xxhsum prints it)\n");
+    printf("  s - SHA-256  (as sha256sum prints it)\n\n");
+    printf("Choose an algorithm, any other key to cancel: ");
+    fflush(stdout);
+    
+    checksum_algo_t algo;
+    switch (read_key()) {
+        case 'c': algo = CHECKSUM_CRC32C; break;
+        case 'x': algo = CHECKSUM_XXH64; break;
+        case 's': algo = CHECKSUM_SHA256; break;
+        default:
+            free(targets);
+            return;
+    }
+    
+    char err[256];
+    checksum_t *run = checksum_start(targets, n, algo, state->flags.show_all, events_wakeup,
+                                     err, sizeof(err));
+    free(targets);
+    if (!run) {
+        set_status(state, 0, "Can't compute checksums: %s", err);
+        return;
+    }
+    clear_checksums(state);
+    state->checksum = run;
+    state->checksum_algo = algo;
+    state->checksum_root = strdup(state->current_path);
+    clock_gettime(CLOCK_MONOTONIC, &state->checksum_started);
+    state->checksum_stopped = 0;
+    state->checksum_reported = 0;
+    set_status(state, 1, "Hashing %s with %s in the background (X=stop)", what,
+               checksum_algo_name(algo));
+}
+
+// Take in what the checksum workers finished; say so when the run is over
+static void checksum_update(interactive_state_t *state) {
+    if (!state->checksum) return;
+    
+    size_t n;
+    checksum_result_t *sums = checksum_collect(state->checksum, &n, 0);
+    if (n > 0) {
+        if (state->sums_used + n > state->sums_cap) {
+            size_t cap = state->sums_cap ? state->sums_cap : 256;
+            while (cap < state->sums_used + n) cap *= 2;
+            checksum_result_t *grown = realloc(state->sums, cap * sizeof(checksum_result_t));
+            if (!grown) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            state->sums = grown;
+            state->sums_cap = cap;
+        }
+        for (size_t i = 0; i < n; i++) {
+            checksum_cache_put(&sums[i], state->checksum_algo);
+        }
+        memcpy(state->sums + state->sums_used, sums, n * sizeof(checksum_result_t));
+        state->sums_used += n;
+    }
+    free(sums);
+    
+    if (!state->checksum_reported && !checksum_running(state->checksum)) {
+        checksum_progress_t pr;
+        checksum_get_progress(state->checksum, &pr);
+        char size_buf[32];
+        human_size((off_t)pr.bytes, size_buf, sizeof(size_buf));
+        state->checksum_reported = 1;
+        set_status(state, !state->checksum_stopped && pr.errors == 0,
+                   "%s: %lu files (%s), %lu unreadable - E exports them",
+                   state->checksum_stopped ? "Checksums stopped" : "Checksums done",
+                   pr.files, size_buf, pr.errors);
+    }
+}
+
+// One-line progress of a running checksum run (shown where a job's would be)
+static void format_checksum_progress(outbuf_t *ob, interactive_state_t *state) {
+    checksum_progress_t pr;
+    checksum_get_progress(state->checksum, &pr);
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - state->checksum_started.tv_sec) +
+                     (now.tv_nsec - state->checksum_started.tv_nsec) / 1e9;
+    double rate = elapsed > 0 ? pr.bytes / elapsed : 0;
+    char size_buf[32], rate_buf[32];
+    human_size((off_t)pr.bytes, size_buf, sizeof(size_buf));
+    human_size((off_t)rate, rate_buf, sizeof(rate_buf));
+    ob_printf(ob, "\033[1;35mChecksums (%s): %lu files, %s, %s/s\033[0m (X=stop)",
+              checksum_algo_name(state->checksum_algo), pr.files, size_buf, rate_buf);
+}
+
+static int cmp_sum_path(const void *a, const void *b) {
+    return strcmp(((const checksum_result_t *)a)->path, ((const checksum_result_t *)b)->path);
+}
+
+// Write the last run's digests to a file, one 'digest  path' line per
+// file with paths relative to where the run started (so sha256sum -c
+// can check them from there)
+static void export_checksums(interactive_state_t *state) {
+    if (!state->checksum) {
+        set_status(state, 0, "No checksums to export (C computes them)");
+        return;
+    }
+    if (checksum_running(state->checksum)) {
+        set_status(state, 0, "Checksums are still running (X stops them)");
+        return;
+    }
+    static const char *const suggested[] = { "CRC32CSUMS", "XXH64SUMS", "SHA256SUMS" };
+    
+    char name[256];
+    clear_screen();
+    printf("\033[1;36m=== EXPORT CHECKSUMS ===\033[0m\n\n");
+    printf("%zu %s digests, written to a file in %s\n\n", state->sums_used,
+           checksum_algo_name(state->checksum_algo), state->checksum_root);
+    printf("Enter a file name such as %s (or leave empty to cancel):\n",
+           suggested[state->checksum_algo]);
+    printf("> ");
+    fflush(stdout);
+    if (read_line(name, sizeof(name)) == 0) return;
+    
+    char path[PATH_MAX];
+    if (name[0] == '/') {
+        snprintf(path, sizeof(path), "%s", name);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s", state->checksum_root, name);
+    }
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        set_status(state, 0, "Can't write '%s': %s", name, strerror(errno));
+        return;
+    }
+    
+    qsort(state->sums, state->sums_used, sizeof(checksum_result_t), cmp_sum_path);
+    size_t root_len = strlen(state->checksum_root);
+    if (root_len > 1) root_len++;  // And the slash after it
+    size_t written = 0;
+    for (size_t i = 0; i < state->sums_used; i++) {
+        const checksum_result_t *r = &state->sums[i];
+        if (r->error) continue;
+        fprintf(out, "%s  %s\n", r->hex, r->path + root_len);
+        written++;
+    }
+    if (fclose(out) != 0) {
+        set_status(state, 0, "Can't write '%s': %s", name, strerror(errno));
+        return;
+    }
+    set_status(state, 1, "Wrote %zu checksums to %s", written, path);
+    state->needs_refresh = 1;
+}
+
+// ---- Duplicate finder ----
+
+// Throw away the last duplicate run and its list
+static void clear_dupes(interactive_state_t *state) {
+    dupes_free(state->dupes);
+    state->dupes = NULL;
+    free(state->dupes_root);
+    state->dupes_root = NULL;
+    free(state->dupe_rows);
+    state->dupe_rows = NULL;
+    state->dupe_rows_used = 0;
+    state->dupes_view = 0;
+}
+
+// Look for duplicate files below the current folder and show the list
+static void start_dupes(interactive_state_t *state) {
+    char err[256];
+    dupes_t *run = dupes_start(state->current_path, state->flags.show_all, events_wakeup,
+                               err, sizeof(err));
+    if (!run) {
+        set_status(state, 0, "Can't look for duplicates: %s", err);
+        return;
+    }
+    clear_dupes(state);
+    state->dupes = run;
+    state->dupes_root = strdup(state->current_path);
+    state->dupes_stopped = 0;
+    state->dupes_reported = 0;
+    state->dupe_cursor = state->dupe_scroll = 0;
+    state->dupes_view = 1;
+    state->search_view = 0;
+}
+
+// Lay out the groups as rows, once the run is over
+static void build_dupe_rows(interactive_state_t *state) {
+    size_t n;
+    const dupes_group_t *groups = dupes_groups(state->dupes, &n);
+    size_t rows = 0;
+    for (size_t g = 0; g < n; g++) rows += 1 + groups[g].count;
+    
+    state->dupe_rows = malloc((rows ? rows : 1) * sizeof(dupe_row_t));
+    if (!state->dupe_rows) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    state->dupe_files = 0;
+    state->dupe_wasted = 0;
+    size_t r = 0;
+    for (size_t g = 0; g < n; g++) {
+        state->dupe_rows[r++] = (dupe_row_t){ g, -1 };
+        for (size_t f = 0; f < groups[g].count; f++) {
+            state->dupe_rows[r++] = (dupe_row_t){ g, (int)f };
+        }
+        state->dupe_files += groups[g].count;
+        state->dupe_wasted += groups[g].size * (groups[g].count - 1);
+    }
+    state->dupe_rows_used = rows;
+    state->dupe_cursor = rows > 0 ? 1 : 0;  // The first file, below its heading
+}
+
+// Say when the duplicate run is over
+static void dupes_update(interactive_state_t *state) {
+    if (!state->dupes || state->dupes_reported || dupes_running(state->dupes)) return;
+    state->dupes_reported = 1;
+    build_dupe_rows(state);
+    
+    size_t n;
+    dupes_groups(state->dupes, &n);
+    if (state->dupes_stopped) {
+        set_status(state, 0, "Duplicate search stopped");
+    } else {
+        char size_buf[32];
+        human_size((off_t)state->dupe_wasted, size_buf, sizeof(size_buf));
+        set_status(state, 1, "Found %zu set%s of duplicates (%lu files, %s could be freed)",
+                   n, n == 1 ? "" : "s", state->dupe_files, size_buf);
+    }
+}
+
+// Move the cursor to the next (dir 1) or previous (-1) file row
+static void dupe_move(interactive_state_t *state, int dir) {
+    for (int r = state->dupe_cursor + dir; r >= 0 && r < (int)state->dupe_rows_used; r += dir) {
+        if (state->dupe_rows[r].file >= 0) {
+            state->dupe_cursor = r;
+            return;
+        }
+    }
+}
+
+// A key pressed while the duplicates are shown. Returns 0 for keys
+// that keep their usual meaning (quit, help).
+static int dupes_key(interactive_state_t *state, int key) {
+    switch (key) {
+        case 'q':
+        case '?':
+        case KEY_NONE:
+            return 0;
+            
+        case 'j':
+            dupe_move(state, 1);
+            break;
+            
+        case 'k':
+            dupe_move(state, -1);
+            break;
+            
+        case '\n':  // Go to the file in its folder
+            if (state->dupe_rows_used > 0) {
+                size_t n;
+                const dupes_group_t *groups = dupes_groups(state->dupes, &n);
+                const dupe_row_t *row = &state->dupe_rows[state->dupe_cursor];
+                go_to_path(state, groups[row->group].paths[row->file], 0);
+                state->dupes_view = 0;
+            }
+            break;
+            
+        case 'X':  // Stop the run (a background job if the run is over)
+            if (dupes_running(state->dupes)) {
+                dupes_cancel(state->dupes);
+                state->dupes_stopped = 1;
+                set_status(state, 0, "Stopping duplicate search...");
+            } else {
+                return 0;
+            }
+            break;
+            
+        case 'U':  // Look again (files may have been removed meanwhile); the
+                   // list is only shown from the folder it was made for
+            start_dupes(state);
+            break;
+            
+        case KEY_ESC:
+        case 'b':  // Back to the folder; U shows the list again
+            state->dupes_view = 0;
+            state->listing_gen++;
+            break;
+            
+        default:
+            break;  // Folder keys don't apply here
+    }
+    return 1;
 }
 
-// Move selected entry to clipboard
-static void move_selected_entry(interactive_state_t *state) {
-    if (state->entries.used == 0) return;
+// Draw the duplicate groups in place of the listing
+static void display_dupes(interactive_state_t *state) {
+    int term_height = term_rows();
+    int row = 0;
+    
+    screen_begin(term_height, term_cols());
+    ob_printf(screen_row(row++), "\033[1;36m=== DUPLICATES under %s ===\033[0m", state->dupes_root);
     
-    file_entry_t *entry = &state->entries.arr[state->cursor_pos];
+    job_t *job = jobs_active();
+    if (job) {
+        format_job_progress(screen_row(row++), job);
+    }
     
-    // Free existing clipboard
-    if (state->clipboard_path) {
-        free(state->clipboard_path);
+    dupes_progress_t pr;
+    dupes_get_progress(state->dupes, &pr);
+    char size_buf[32];
+    human_size((off_t)pr.bytes, size_buf, sizeof(size_buf));
+    outbuf_t *progress = screen_row(row++);
+    switch (pr.phase) {
+        case DUPES_WALKING:
+            ob_printf(progress, "\033[1;35mListing files... %lu files in %lu folders\033[0m (X=stop)",
+                      pr.files, pr.dirs);
+            break;
+        case DUPES_PARTIAL:
+            ob_printf(progress, "\033[1;35mComparing starts and ends: %lu of %lu same-size files (of %lu)\033[0m (X=stop)",
+                      pr.hashed, pr.candidates, pr.files);
+            break;
+        case DUPES_FULL:
+            ob_printf(progress, "\033[1;35mComparing contents: %lu of %lu files, %s read\033[0m (X=stop)",
+                      pr.hashed, pr.candidates, size_buf);
+            break;
+        case DUPES_DONE: {
+            size_t n;
+            dupes_groups(state->dupes, &n);
+            char wasted_buf[32];
+            human_size((off_t)state->dupe_wasted, wasted_buf, sizeof(wasted_buf));
+            ob_printf(progress, "%zu set%s, %lu files, %s wasted (%lu files in %lu folders, %s read)%s",
+                      n, n == 1 ? "" : "s", state->dupe_files, wasted_buf, pr.files, pr.dirs, size_buf,
+                      state->dupes_stopped ? " (stopped)" : "");
+            break;
+        }
+    }
+    row++;
+    
+    // Same layout as the listing: status and footer rows at the bottom
+    int available_lines = term_height - row - 2;
+    if (available_lines < 1) available_lines = 1;
+    if (state->dupe_cursor < state->dupe_scroll + 1) {
+        state->dupe_scroll = state->dupe_cursor > 0 ? state->dupe_cursor - 1 : 0;  // Keep the heading in view
+    } else if (state->dupe_cursor >= state->dupe_scroll + available_lines) {
+        state->dupe_scroll = state->dupe_cursor - available_lines + 1;
     }
     
-    state->clipboard_path = strdup(entry->path);
-    state->clipboard_is_move = 1;
+    // Paths are shown relative to where the run started
+    size_t n;
+    const dupes_group_t *groups = dupes_groups(state->dupes, &n);
+    size_t root_len = strlen(state->dupes_root);
+    if (root_len > 1) root_len++;  // And the slash after it
+    for (int i = 0; i < available_lines; i++) {
+        size_t r = (size_t)(state->dupe_scroll + i);
+        outbuf_t *ob = screen_row(row++);
+        if (r >= state->dupe_rows_used) {
+            ob_puts(ob, "~");
+            continue;
+        }
+        const dupe_row_t *dr = &state->dupe_rows[r];
+        const dupes_group_t *g = &groups[dr->group];
+        if (dr->file < 0) {
+            char each[32], wasted[32];
+            human_size((off_t)g->size, each, sizeof(each));
+            human_size((off_t)(g->size * (g->count - 1)), wasted, sizeof(wasted));
+            ob_printf(ob, "\033[1m%zu files of %s\033[22m \033[2m(%s wasted)\033[22m", g->count, each, wasted);
+            continue;
+        }
+        int is_cursor = (r == (size_t)state->dupe_cursor);
+        if (is_cursor) ob_puts(ob, "\033[7m");
+        ob_printf(ob, "  %s", g->paths[dr->file] + root_len);
+        if (is_cursor) ob_puts(ob, "\033[0m");
+    }
     
-    printf("\n\033[1;32m✓ Cut '%s' to clipboard\033[0m\n", entry->name);
+    ob_puts(screen_row(row++), state->status_msg);
+    ob_puts(screen_row(row++), "\033[1;33mControls:\033[0m j/k=Navigate, Enter=Go to file, X=Stop, U=Look again, Esc/b=Back to folder, q=Quit");
+    screen_flush();
 }
 
-// Paste from clipboard
-static void paste_from_clipboard(interactive_state_t *state) {
-    if (!state->clipboard_path) {
-        printf("\n\033[1;31m✗ Clipboard is empty\033[0m\n");
-        return;
+// Draw the search results in place of the listing
+static void display_search(interactive_state_t *state) {
+    int term_height = term_rows();
+    int row = 0;
+    
+    screen_begin(term_height, term_cols());
+    ob_printf(screen_row(row++), "\033[1;36m=== %s '%s' under %s ===\033[0m",
+              state->search_syntax == SEARCH_CONTENT ? "GREP" :
+              state->search_syntax == SEARCH_REGEX ? "FIND regex" : "FIND glob",
+              state->search_pattern, state->search_root);
+    
+    job_t *job = jobs_active();
+    if (job) {
+        format_job_progress(screen_row(row++), job);
     }
     
-    // Get source name
-    char *src_name = strrchr(state->clipboard_path, '/');
-    if (!src_name) src_name = state->clipboard_path;
-    else src_name++;
-    
-    // Build destination path
-    char dst_path[PATH_MAX];
-    snprintf(dst_path, sizeof(dst_path), "%s/%s", state->current_path, src_name);
-    
-    int result = 0;
-    
-    if (state->clipboard_is_move) {
-        // Move operation
-        result = rename(state->clipboard_path, dst_path);
-        if (result == 0) {
-            printf("\n\033[1;32m✓ Moved '%s' successfully!\033[0m\n", src_name);
-            // Free clipboard after successful move
-            free(state->clipboard_path);
-            state->clipboard_path = NULL;
-        } else {
-            printf("\n\033[1;31m✗ Failed to move: %s\033[0m\n", strerror(errno));
-        }
+    int current_pos = state->hits_used > 0 ? state->hit_cursor + 1 : 0;
+    int running = search_running(state->search);
+    search_progress_t pr;
+    search_get_progress(state->search, &pr);
+    outbuf_t *progress = screen_row(row++);
+    if (running) ob_puts(progress, "\033[1;35mSearching... ");
+    if (state->search_syntax == SEARCH_CONTENT) {
+        char size_buf[32];
+        human_size((off_t)pr.bytes, size_buf, sizeof(size_buf));
+        ob_printf(progress, "%zu lines found in %lu files (%s, %lu binary skipped), %lu folders",
+                  state->hits_used, pr.files, size_buf, pr.binary, pr.dirs);
     } else {
-        // Copy operation
-        struct stat st;
-        if (lstat(state->clipboard_path, &st) != 0) {
-            printf("\n\033[1;31m✗ Failed to access source: %s\033[0m\n", strerror(errno));
-            return;
-        }
-        
-        if (S_ISDIR(st.st_mode)) {
-            result = copy_directory(state->clipboard_path, dst_path);
-        } else {
-            result = copy_file(state->clipboard_path, dst_path);
+        ob_printf(progress, "%zu found in %lu folders", state->hits_used, pr.dirs);
+    }
+    if (running) {
+        ob_puts(progress, "\033[0m (X=stop)");
+    } else if (state->search_stopped) {
+        ob_puts(progress, " (stopped)");
+    }
+    ob_printf(progress, " [Pos:%d/%zu]", current_pos, state->hits_used);
+    row++;
+    
+    // Same layout as the listing: status and footer rows at the bottom
+    int available_lines = term_height - row - 2;
+    if (available_lines < 1) available_lines = 1;
+    if (state->hit_cursor < state->hit_scroll) {
+        state->hit_scroll = state->hit_cursor;
+    } else if (state->hit_cursor >= state->hit_scroll + available_lines) {
+        state->hit_scroll = state->hit_cursor - available_lines + 1;
+    }
+    
+    // Paths are shown relative to where the search started
+    size_t root_len = strlen(state->search_root);
+    if (root_len > 1) root_len++;  // And the slash after it
+    for (int i = 0; i < available_lines; i++) {
+        size_t h = (size_t)(state->hit_scroll + i);
+        outbuf_t *ob = screen_row(row++);
+        if (h >= state->hits_used) {
+            ob_puts(ob, "~");
+            continue;
         }
-        
-        if (result == 0) {
-            printf("\n\033[1;32m✓ Copied '%s' successfully!\033[0m\n", src_name);
+        const search_hit_t *hit = &state->hits[h];
+        int is_cursor = (h == (size_t)state->hit_cursor);
+        if (is_cursor) ob_puts(ob, "\033[7m");
+        if (hit->preview) {
+            // grep style: path:line: text
+            ob_printf(ob, "\033[35m%s\033[39m:\033[32m%lu\033[39m: %s",
+                      hit->path + root_len, hit->line, hit->preview);
         } else {
-            printf("\n\033[1;31m✗ Failed to copy: %s\033[0m\n", strerror(errno));
+            ob_puts(ob, hit->path + root_len);
         }
+        if (is_cursor) ob_puts(ob, "\033[0m");
     }
     
-    if (result == 0) {
-        state->needs_refresh = 1;
-    }
+    ob_puts(screen_row(row++), state->status_msg);
+    ob_puts(screen_row(row++), "\033[1;33mControls:\033[0m j/k=Navigate, Enter=Go to hit, X=Stop search, F/G=New search, Esc/b=Back to folder, q=Quit");
+    screen_flush();
 }
 
-// Draw the entire interactive UI
+// Draw the entire interactive UI. Rows are composed into the shadow
+// frame and only rows that changed since the last frame are sent.
 static void display_interface(interactive_state_t *state) {
-    clear_screen();
+    if (state->viewer || state->hexview) {
+        display_viewer(state);
+        return;
+    }
+    if (state->search_view) {
+        display_search(state);
+        return;
+    }
+    if (state->dupes_view) {
+        display_dupes(state);
+        return;
+    }
     
     // Get terminal dimensions
-    int term_height = get_terminal_height_cached();
-    int term_width = get_terminal_width();
+    int term_height = term_rows();  // Cached - no syscalls while drawing
+    int term_width = term_cols();
+    int row = 0;
+
+    screen_begin(term_height, term_width);
     
     // Header with current location and settings
-    printf("\033[1;36m=== MEXPLORER: %s ===\033[0m\n", state->current_path);
+    ob_printf(screen_row(row++), "\033[1;36m=== MEXPLORER: %s ===\033[0m", state->current_path);
     
     // Show clipboard status
-    if (state->clipboard_path) {
-        char *clip_name = strrchr(state->clipboard_path, '/');
-        if (!clip_name) clip_name = state->clipboard_path;
-        else clip_name++;
-        printf("Clipboard: %s '%s'\n", state->clipboard_is_move ? "MOVE" : "COPY", clip_name);
+    if (state->clipboard_count > 0) {
+        char what[PATH_MAX + 8];
+        describe_paths(state->clipboard, state->clipboard_count, what, sizeof(what));
+        ob_printf(screen_row(row++), "Clipboard: %s %s",
+                  state->clipboard_is_move ? "MOVE" : "COPY", what);
     }
     
-    // Truncate path if too long for terminal
-    char path_display[term_width];
-    snprintf(path_display, sizeof(path_display), "%s", state->current_path);
-    size_t path_len = strlen(path_display);
-    if (path_len > (size_t)(term_width - 20)) {
-        path_display[term_width - 23] = '\0';
-        strcat(path_display, "...");
+    // Progress of the background job, if one is running
+    job_t *job = jobs_active();
+    if (job) {
+        format_job_progress(screen_row(row++), job);
+    } else if (state->checksum && checksum_running(state->checksum)) {
+        format_checksum_progress(screen_row(row++), state);
     }
     
     // Calculate current position (1-based) and total
-    int current_pos = state->entries.used > 0 ? state->cursor_pos + 1 : 0;
-    int total_files = state->entries.used;
-    
-    printf("Settings: [Sort:%s] [Hidden:%s] [Format:%s] [Human:%s] [Filter:%s] [Pos:%d/%d]\n\n",
-           state->flags.sort_mode == SORT_NAME ? "Name" : 
-           state->flags.sort_mode == SORT_SIZE ? "Size" : "Time",
-           state->flags.show_all ? "ON" : "OFF",
-           state->flags.long_format ? "Long" : "Short",
-           state->flags.human_readable ? "ON" : "OFF",
-           state->flags.dirs_only ? "Dirs" : 
-           state->flags.files_only ? "Files" : "All",
-           current_pos, total_files);
-    
-    // Calculate how many files we can show based on terminal size
-    int available_lines = term_height - 6;  // Reserve space for header/footer
+    int current_pos = state->view_used > 0 ? state->cursor_pos + 1 : 0;
+    int total_files = state->view_used;
+    size_t selected = count_selected(state);
+    
+    outbuf_t *settings = screen_row(row++);
+    ob_printf(settings,
+              "Settings: [Sort:%s] [Hidden:%s] [Format:%s] [Human:%s] [Filter:%s] [Pos:%d/%d]",
+              state->flags.sort_mode == SORT_NAME ? "Name" : 
+              state->flags.sort_mode == SORT_SIZE ? "Size" : "Time",
+              state->flags.show_all ? "ON" : "OFF",
+              state->flags.long_format ? "Long" : "Short",
+              state->flags.human_readable ? "ON" : "OFF",
+              state->flags.dirs_only ? "Dirs" : 
+              state->flags.files_only ? "Files" : "All",
+              current_pos, total_files);
+    if (state->flags.du_mode) {
+        if (state->du_waiting > 0) {
+            ob_printf(settings, " [du:%zu left]", state->du_waiting);
+        } else {
+            ob_puts(settings, " [du]");
+        }
+    }
+    if (tree_index) {
+        ob_puts(settings, state->from_index ? " [Index]" : " [Index:disk]");
+    }
+    if (selected > 0) {
+        ob_printf(settings, " \033[1;32m[Selected:%zu]\033[0m", selected);
+    }
+    if (state->filter_len > 0) {
+        ob_printf(settings, " \033[1;33m[/%s: %zu of %zu%s]\033[0m", state->filter,
+                  state->view_used, state->entries.used,
+                  state->filter_mode == MATCH_FUZZY ? ", fuzzy" : "");
+    }
+
+    // Blank separator row doubles as the render stats line in debug mode
+    if (state->flags.debug_stats) {
+        const screen_stats_t *st = screen_stats();
+        ob_printf(screen_row(row), "\033[2m[stats] frame %lu: %zu bytes, %d rows rewritten, %lu size ioctls\033[0m",
+                  st->frames, st->last_bytes, st->last_lines, term_geometry_ioctls());
+    }
+    row++;
+    
+    // Whatever the header rows left, less the status and footer rows
+    int available_lines = term_height - row - 2;
     
     if (available_lines < 1) {
         available_lines = 1;  // Minimum display area
@@ -843,45 +2492,84 @@ static void display_interface(interactive_state_t *state) {
         state->scroll_offset = state->cursor_pos - available_lines + 1;
     }
     
+    // Same listing in the same place, just scrolled? Let the terminal shift
+    // the rows already on screen and only paint the ones that scroll in.
+    int list_top = row;
+    if (state->drawn_gen == state->listing_gen &&
+        state->drawn_list_top == list_top &&
+        state->drawn_list_rows == available_lines) {
+        screen_scroll(list_top, list_top + available_lines - 1,
+                      state->scroll_offset - state->drawn_scroll_offset);
+    }
+    state->drawn_gen = state->listing_gen;
+    state->drawn_scroll_offset = state->scroll_offset;
+    state->drawn_list_top = list_top;
+    state->drawn_list_rows = available_lines;
+    
     // Figure out which slice of files to display (for scrolling)
     size_t start = state->scroll_offset;
     size_t end = start + available_lines;
-    if (end > state->entries.used) {
-        end = state->entries.used;
+    if (end > state->view_used) {
+        end = state->view_used;
     }
     
     // Show the visible files
     for (size_t i = start; i < end; i++) {
+        outbuf_t *ob = screen_row(row++);
+        const file_entry_t *e = view_entry(state, i);
         int is_cursor = (i == (size_t)state->cursor_pos);
+        int is_selected = e->is_selected;
+        if (is_cursor) {
+            ob_puts(ob, "\033[7m");  // Highlight the cursor row with reverse video
+        }
+        if (is_selected) {
+            ob_puts(ob, "\033[1;32m*");  // Multi-selected entries: green with a star
+        }
         if (state->flags.long_format) {
-            print_entry(&state->entries.arr[i], &state->flags, is_cursor);
+            format_entry(ob, e, &state->flags);
         } else {
-            // Simple view - just filenames with highlighting
-            if (is_cursor) {
-                printf("\033[7m%s\033[0m\n", state->entries.arr[i].name);
-            } else {
-                printf("%s\n", state->entries.arr[i].name);
+            ob_puts(ob, e->name);  // Simple view - just filenames (and du sizes)
+            if (e->du_state == DU_DONE) {
+                char size_buf[32];
+                human_size((off_t)e->du_bytes, size_buf, sizeof(size_buf));
+                ob_printf(ob, "  \033[2m[%s]\033[22m", size_buf);
+            } else if (e->du_state == DU_PENDING) {
+                ob_puts(ob, "  \033[2m[...]\033[22m");
             }
         }
+        if (is_cursor || is_selected) {
+            ob_puts(ob, "\033[0m");
+        }
     }
     
     // Fill remaining space if fewer files than available lines
     int lines_used = end - start;
     for (int i = lines_used; i < available_lines; i++) {
-        printf("~\n");
+        ob_puts(screen_row(row++), "~");
     }
     
-    // Footer with quick help
-    printf("\n\033[1;33mControls:\033[0m j/k=Navigate, Enter=Open, b=Back, a=Hidden, l=Long, s=Sort, H=Human, d=Dirs, f=Files, n=New, D=Delete, c=Copy, m=Move, p=Paste, r=Refresh, ?=Help, q=Quit\n");
+    // Result of the last operation (or the filter prompt), then the
+    // footer with quick help
+    if (state->filter_editing) {
+        ob_printf(screen_row(row++), "\033[1m/%s\033[0m_  \033[2m(%s - Tab=%s, Enter=keep, Esc=clear)\033[0m",
+                  state->filter, state->filter_mode == MATCH_FUZZY ? "fuzzy" : "substring",
+                  state->filter_mode == MATCH_FUZZY ? "substring" : "fuzzy");
+    } else {
+        ob_puts(screen_row(row++), state->status_msg);
+    }
+    ob_puts(screen_row(row++), "\033[1;33mControls:\033[0m j/k=Navigate, Enter=Open, i=Info, Space=Select, /=Filter, F=Find, G=Grep, b=Back, a=Hidden, l=Long, s=Sort, H=Human, d=Dirs, f=Files, n=New, D=Delete, c=Copy, m=Move, p=Paste, C=Checksum, E=Export sums, U=Duplicates, X=Cancel job, r=Refresh, ?=Help, q=Quit");
     
-    fflush(stdout);
+    screen_flush();
 }
 
 // Non-interactive directory traversal
 void traverse_directory(const char *path, const explorer_flags_t *flags) {
     entry_list_t entries;
     list_init(&entries);
-    read_dir(path, &entries, flags);
+    if (open_tree_index(flags) != 0) return;
+    if (!read_dir_indexed(path, &entries, flags)) {
+        read_dir(path, &entries, flags);
+    }
     
     // Sort entries
     if (flags->sort_mode == SORT_NAME) {
@@ -895,13 +2583,157 @@ void traverse_directory(const char *path, const explorer_flags_t *flags) {
     // Print all entries
     for (size_t i = 0; i < entries.used; i++) {
         if (flags->long_format) {
-            print_entry(&entries.arr[i], flags, 0);
+            print_entry(&entries.arr[i], flags);
         } else {
             printf("%s\n", entries.arr[i].name);
         }
     }
     
     list_free(&entries);
+    tindex_close(tree_index);
+    tree_index = NULL;
+}
+
+// Batch search (-F / -E names, -G contents): print hits as the workers
+// find them. Returns -1 if the search couldn't start.
+int find_names(const char *path, const explorer_flags_t *flags) {
+    search_opts_t opts = { flags->find_syntax, flags->show_all, flags->max_search_size };
+    char err[256];
+    search_t *search = search_start(path, flags->find_pattern, &opts, NULL, err, sizeof(err));
+    if (!search) {
+        fprintf(stderr, "Can't search for '%s': %s\n", flags->find_pattern, err);
+        return -1;
+    }
+    
+    size_t n;
+    search_hit_t *hits;
+    while ((hits = search_collect(search, &n, 1)) != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            if (hits[i].preview) {
+                printf("%s:%lu:%s\n", hits[i].path, hits[i].line, hits[i].preview);
+            } else {
+                puts(hits[i].path);
+            }
+            search_hit_free(&hits[i]);
+        }
+        free(hits);
+    }
+    search_free(search);
+    return 0;
+}
+
+// Batch duplicate search (-u): print each set of identical files, one
+// path per line and a blank line between sets (like fdupes -r). Returns
+// -1 if the search couldn't start.
+int find_dupes(const char *path, const explorer_flags_t *flags) {
+    char err[256];
+    dupes_t *run = dupes_start(path, flags->show_all, NULL, err, sizeof(err));
+    if (!run) {
+        fprintf(stderr, "Can't look for duplicates: %s\n", err);
+        return -1;
+    }
+    dupes_wait(run);
+    
+    size_t n;
+    const dupes_group_t *groups = dupes_groups(run, &n);
+    for (size_t g = 0; g < n; g++) {
+        if (g > 0) putchar('\n');
+        for (size_t f = 0; f < groups[g].count; f++) {
+            puts(groups[g].paths[f]);
+        }
+    }
+    dupes_free(run);
+    return 0;
+}
+
+// Batch checksums (-C): print 'digest  path' for every file below the
+// folder as the workers finish them, like sha256sum does. Returns -1 if
+// the run couldn't start or a file couldn't be read.
+int checksum_tree(const char *path, const explorer_flags_t *flags) {
+    char *roots[] = { (char *)path };
+    char err[256];
+    checksum_t *run = checksum_start(roots, 1, flags->checksum_algo, flags->show_all, NULL,
+                                     err, sizeof(err));
+    if (!run) {
+        fprintf(stderr, "Can't compute checksums: %s\n", err);
+        return -1;
+    }
+    
+    int result = 0;
+    size_t n;
+    checksum_result_t *sums;
+    while ((sums = checksum_collect(run, &n, 1)) != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            if (sums[i].error) {
+                fprintf(stderr, "%s: %s\n", sums[i].path, strerror(sums[i].error));
+                result = -1;
+            } else {
+                printf("%s  %s\n", sums[i].hex, sums[i].path);
+            }
+            checksum_result_free(&sums[i]);
+        }
+        free(sums);
+    }
+    checksum_free(run);
+    return result;
+}
+
+// Batch index build (-B): snapshot the tree's metadata for -I. Returns -1
+// if the index couldn't be written.
+int build_index(const char *path, const explorer_flags_t *flags) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tindex_stats_t stats;
+    char err[256];
+    if (tindex_build(path, flags->index_build, &stats, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Can't build the index: %s\n", err);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Indexed %lu folders (%lu unchanged since the last build), %lu entries into %s in %.1fs\n",
+           stats.dirs, stats.reused, stats.entries, flags->index_build, elapsed);
+    if (stats.errors > 0) {
+        fprintf(stderr, "%lu folders couldn't be read and were left out\n", stats.errors);
+    }
+    return 0;
+}
+
+// Batch locate (-L): print the indexed paths below the folder whose names
+// contain the text, straight from the index's trigram lists (the tree
+// itself isn't read, so the paths are as of the last -B). Returns -1 if
+// there is no usable index.
+int locate_names(const char *path, const explorer_flags_t *flags) {
+    if (!flags->index_file) {
+        fprintf(stderr, "Error: -L searches an index; give one with -I file (build it with -B file).\n");
+        return -1;
+    }
+    if (open_tree_index(flags) != 0) return -1;
+    char *root = realpath(path, NULL);
+    if (!root) {
+        perror("realpath");
+        tindex_close(tree_index);
+        tree_index = NULL;
+        return -1;
+    }
+    
+    // Below the folder means under "root/" (just "/" for the top)
+    size_t root_len = strlen(root);
+    if (root_len == 1) root_len = 0;
+    size_t count;
+    size_t *ids = tindex_search(tree_index, flags->locate_text, &count);
+    char buf[PATH_MAX];
+    for (size_t i = 0; i < count; i++) {
+        if (tindex_entry_path(tree_index, ids[i], buf, sizeof(buf)) != 0) continue;
+        if (strncmp(buf, root, root_len) != 0 || buf[root_len] != '/') continue;
+        if (!flags->show_all && strstr(buf + root_len, "/.")) continue;  // Hidden, or inside something hidden
+        puts(buf);
+    }
+    free(ids);
+    free(root);
+    tindex_close(tree_index);
+    tree_index = NULL;
+    return 0;
 }
 
 // Proper cleanup function
@@ -909,8 +2741,17 @@ static void restore_terminal_and_exit(interactive_state_t *state) {
     // Switch back to main screen buffer
     printf("\033[?1049l");  // Switch back to main screen
     
-    // Remove signal handlers
-    signal(SIGWINCH, SIG_DFL);
+    // Stop background work, then close the event sources (this also unblocks SIGWINCH)
+    jobs_stop();
+    du_stop();
+    clear_search(state);
+    clear_checksums(state);
+    checksum_cache_clear();
+    clear_dupes(state);
+    tindex_close(tree_index);
+    tree_index = NULL;
+    close_viewer(state);
+    events_free();
     
     setup_terminal(0);  // Restore normal terminal mode
     clear_screen();     // Clear the screen
@@ -919,21 +2760,333 @@ static void restore_terminal_and_exit(interactive_state_t *state) {
     printf("\033[0m");  // Reset colors and attributes
     fflush(stdout);
     
+    free(state->cursor_name);
     list_free(&state->entries);
+    name_pack_free(&state->names);
+    free(state->view);
     history_free(&state->history);
+    screen_free();
     free(state->current_path);
-    if (state->clipboard_path) {
-        free(state->clipboard_path);
-    }
-    
-    // Clear the global state pointer
-    global_state = NULL;
+    clear_clipboard(state);
+    selection_free(&state->selection);
+    free(state->selection_dir);
     
     // Show thank you message
     printf("Thank you for using MExplorer!\n");
     printf("File explorer session ended.\n\n");
 }
 
+// Apply one key press to the state. Returns 0 when the user quits.
+static int handle_key(interactive_state_t *state, int key) {
+    if ((state->viewer || state->hexview) && key != KEY_NONE) {
+        viewer_key(state, key);
+        return 1;
+    }
+    if (state->filter_editing && key != KEY_NONE) {
+        filter_key(state, key);
+        return 1;
+    }
+    if (state->search_view && search_key(state, key)) {
+        return 1;
+    }
+    if (state->dupes_view && dupes_key(state, key)) {
+        return 1;
+    }
+    
+    switch (key) {
+        case 'q':  // Quit
+            if (jobs_busy() && !state->quit_armed) {
+                state->quit_armed = 1;  // Don't kill a copy by accident
+                set_status(state, 0, "A background copy is running - press q again to cancel it and quit");
+                break;
+            }
+            return 0;
+            
+        case KEY_NONE:  // Terminal went away
+            return 0;
+            
+        case 'X':  // Cancel the running background job (or checksum run)
+            if (jobs_active()) {
+                jobs_cancel_active();
+                set_status(state, 0, "Cancelling background job...");
+            } else if (state->checksum && checksum_running(state->checksum)) {
+                checksum_cancel(state->checksum);
+                state->checksum_stopped = 1;
+                set_status(state, 0, "Stopping checksums...");
+            } else {
+                set_status(state, 0, "No background job is running");
+            }
+            break;
+            
+        case 'j':  // Move down (arrow keys are translated by the input parser)
+            if (state->cursor_pos < (int)state->view_used - 1) {
+                state->cursor_pos++;
+            }
+            break;
+            
+        case 'k':  // Move up
+            if (state->cursor_pos > 0) {
+                state->cursor_pos--;
+            }
+            break;
+            
+        case '\n':  // Enter key - open file or directory
+            if (state->view_used > 0) {
+                file_entry_t *entry = cursor_entry(state);
+                if (entry->st_valid && S_ISDIR(entry->st.st_mode)) {
+                    // Save current directory to history before navigating
+                    history_push(&state->history, state->current_path);
+                    
+                    // Navigate into directory
+                    free(state->current_path);
+                    state->current_path = strdup(entry->path);
+                    state->needs_refresh = 1;
+                } else {
+                    open_viewer(state, entry->path, 0);
+                }
+            }
+            break;
+            
+        case 'b':  // Go back to previous directory using history
+            if (!history_is_empty(&state->history)) {
+                char *prev_path = history_pop(&state->history);
+                if (prev_path && strcmp(prev_path, state->current_path) != 0) {
+                    free(state->current_path);
+                    state->current_path = strdup(prev_path);
+                    state->needs_refresh = 1;
+                }
+                free(prev_path);  // Free the popped path
+            } else {
+                // If no history, try to go to parent directory as fallback
+                char *parent = realpath("..", NULL);
+                if (parent && strcmp(parent, state->current_path) != 0) {
+                    free(state->current_path);
+                    state->current_path = parent;
+                    state->needs_refresh = 1;
+                } else {
+                    free(parent);
+                }
+            }
+            break;
+            
+        case 'i':  // Details of the entry under the cursor
+            if (state->view_used > 0) {
+                file_entry_t *entry = cursor_entry(state);
+                clear_screen();
+                printf("File: %s\n", entry->name);
+                printf("Path: %s\n", entry->path);
+                if (entry->st_valid) {
+                    printf("Size: %ld bytes\n", (long)entry->st.st_size);
+                    format_mtime(entry->st.st_mtime, time_buf, sizeof(time_buf));
+                    printf("Modified: %s\n", time_buf);
+                    print_mode(entry->st.st_mode, mode_buf, sizeof(mode_buf));
+                    printf("Permissions: %s\n", mode_buf);
+                }
+                printf("\nPress any key to continue...");
+                fflush(stdout);
+                read_key();
+                state->needs_refresh = 1;
+            }
+            break;
+            
+        // REAL-TIME FLAG TOGGLES 
+        case 'a':  // Toggle hidden files
+            state->flags.show_all = !state->flags.show_all;
+            state->needs_refresh = 1;
+            break;
+            
+        case 'l':  // Toggle long/short view
+            state->flags.long_format = !state->flags.long_format;
+            break;
+            
+        case 's':  // Cycle through sort modes
+            state->flags.sort_mode = (state->flags.sort_mode + 1) % 3;
+            state->needs_refresh = 1;
+            break;
+            
+        case 'H':  // Toggle human-readable sizes (shift+h)
+            state->flags.human_readable = !state->flags.human_readable;
+            break;
+            
+        case 'z':  // Toggle du mode (recursive directory sizes)
+            state->flags.du_mode = !state->flags.du_mode;
+            if (!state->flags.du_mode) du_cancel_pending();
+            du_fill(state);
+            if (state->flags.sort_mode == SORT_SIZE) resort_keep_cursor(state);
+            set_status(state, 1, state->flags.du_mode ? "du mode on: sizing directories in the background"
+                                                      : "du mode off");
+            break;
+            
+        case 'd':  // Show only directories
+            state->flags.dirs_only = !state->flags.dirs_only;
+            if (state->flags.dirs_only) state->flags.files_only = 0;
+            state->needs_refresh = 1;
+            break;
+            
+        case 'f':  // Show only files
+            state->flags.files_only = !state->flags.files_only;
+            if (state->flags.files_only) state->flags.dirs_only = 0;
+            state->needs_refresh = 1;
+            break;
+            
+        case ' ':  // Toggle selection of the entry under the cursor, then move on
+            if (state->view_used > 0) {
+                file_entry_t *e = cursor_entry(state);
+                set_selected(state, e, !e->is_selected);
+                if (state->cursor_pos < (int)state->view_used - 1) {
+                    state->cursor_pos++;
+                }
+            }
+            break;
+            
+        case 'A':  // Select every listed entry (with a filter: every match)
+            for (size_t i = 0; i < state->view_used; i++) {
+                set_selected(state, view_entry(state, i), 1);
+            }
+            break;
+            
+        case 'I':  // Invert the selection of the listed entries
+            for (size_t i = 0; i < state->view_used; i++) {
+                file_entry_t *e = view_entry(state, i);
+                set_selected(state, e, !e->is_selected);
+            }
+            break;
+            
+        case 'g':  // Select entries matching a glob pattern
+            select_by_glob(state);
+            break;
+            
+        case 'u':  // Clear the selection
+            selection_clear(&state->selection);
+            for (size_t i = 0; i < state->entries.used; i++) {
+                state->entries.arr[i].is_selected = 0;
+            }
+            break;
+            
+        case '/':  // Filter the listing as you type
+            state->filter_editing = 1;
+            break;
+            
+        case KEY_ESC:  // Drop the filter
+            if (state->filter_len > 0) {
+                clear_filter(state);
+            }
+            break;
+            
+        case 'F':  // Find names below the current folder
+            start_search(state);
+            break;
+            
+        case 'G':  // Find text in the files below the current folder
+            start_grep(state);
+            break;
+            
+        case 'C':  // Checksums of the selection or the entry under the cursor
+            start_checksum(state);
+            break;
+            
+        case 'E':  // Export the last checksums to a file
+            export_checksums(state);
+            break;
+            
+        case 'U':  // Duplicate files below the current folder
+            if (state->dupes && strcmp(state->dupes_root, state->current_path) == 0) {
+                state->dupes_view = 1;  // Show the last list again
+            } else {
+                start_dupes(state);
+            }
+            break;
+            
+        case 'n':  // Create new file or directory
+            create_new_file_or_dir(state);
+            break;
+            
+        case 'D':  // Delete selected file or directory
+            delete_selected_entry(state);
+            break;
+            
+        case 'c':  // Copy selected file/directory
+            copy_selected_entry(state);
+            break;
+            
+        case 'm':  // Move (cut) selected file/directory
+            move_selected_entry(state);
+            break;
+            
+        case 'p':  // Paste from clipboard
+            paste_from_clipboard(state);
+            break;
+            
+        case 'r':  // Refresh (re-read directory, from disk even if indexed)
+            state->index_bypass = 1;
+            state->needs_refresh = 1;
+            break;
+            
+        case '?':  // Show help
+            clear_screen();
+            printf("\033[1;35mMEXPLORER - INTERACTIVE FILE EXPLORER\033[0m\n\n");
+            printf("\033[1;33mNAVIGATION:\033[0m\n");
+            printf("  j / k or ↓ / ↑  - Move cursor up/down\n");
+            printf("  ENTER           - Open directory, or view file (j/k, Space/b, g/G, h/l;\n");
+            printf("                    / and ? search, n/N repeat, : line or 50%%, F follow (tail -f),\n");
+            printf("                    x hex, q closes;\n");
+            printf("                    binary files open as hex: : offset, / 7f 45 4c 46 or \"text\")\n");
+            printf("  i               - Show file details\n");
+            printf("  b               - Go back to previous directory\n");
+            printf("  /               - Filter the listing as you type (Tab=fuzzy,\n");
+            printf("                    Enter=keep and browse the matches, Esc=clear)\n");
+            printf("  F               - Find names below this folder (glob or regex, Tab switches);\n");
+            printf("                    hits stream in, Enter goes to one, X stops, Esc/b returns\n");
+            printf("  G               - Find text in the files below this folder (skips binaries);\n");
+            printf("                    Enter on a line opens the viewer there\n");
+            printf("  U               - Find duplicate files below this folder (same size, then same\n");
+            printf("                    first/last 4 KiB, then same SHA-256); Enter goes to a file,\n");
+            printf("                    U looks again, Esc/b returns\n\n");
+            printf("\033[1;33mVIEW SETTINGS (toggle on/off):\033[0m\n");
+            printf("  a - Toggle hidden files (show/hide dotfiles)\n");
+            printf("  l - Toggle long format (detailed/simple view)\n");
+            printf("  H - Toggle human-readable file sizes\n");
+            printf("  z - Toggle du mode (recursive directory sizes, computed in the background)\n");
+            printf("  s - Cycle sort order (name → size → time)\n");
+            printf("  d - Toggle directories only filter\n");
+            printf("  f - Toggle files only filter\n");
+            printf("  r - Refresh current directory view (from disk when using an index, -I)\n\n");
+            printf("\033[1;33mSELECTION:\033[0m\n");
+            printf("  SPACE - Select/unselect entry and move down\n");
+            printf("  A     - Select all listed entries\n");
+            printf("  I     - Invert the selection\n");
+            printf("  g     - Select entries matching a pattern (e.g. *.log)\n");
+            printf("  u     - Clear the selection\n");
+            printf("  (c, m and D work on the selection when there is one)\n\n");
+            printf("\033[1;33mCREATION & DELETION:\033[0m\n");
+            printf("  n - Create new file or directory (inline prompt)\n");
+            printf("  D - Delete selected file or directory (with confirmation;\n");
+            printf("      non-empty directories are removed in the background)\n\n");
+            printf("\033[1;33mCOPY/PASTE:\033[0m\n");
+            printf("  c - Copy selected file/directory to clipboard\n");
+            printf("  m - Move (cut) selected file/directory to clipboard\n");
+            printf("  p - Paste from clipboard to current directory (runs in the background)\n");
+            printf("  X - Cancel the running background copy, move or delete\n\n");
+            printf("\033[1;33mCHECKSUMS:\033[0m\n");
+            printf("  C - CRC32C, xxHash64 or SHA-256 of the selection (folders recursively),\n");
+            printf("      in the background; digests show in the long view (l), X stops\n");
+            printf("  E - Export the last checksums to a file (sha256sum -c format)\n\n");
+            printf("\033[1;33mOTHER:\033[0m\n");
+            printf("  q - Quit the explorer\n");
+            printf("  ? - Show this help screen\n\n");
+            printf("Press any key to continue...");
+            fflush(stdout);
+            read_key();
+            state->needs_refresh = 1;
+            break;
+            
+        default:
+            // Ignore unknown keys
+            break;
+    }
+    return 1;
+}
+
 // The main interactive UI loop
 void interactive_explorer(const char *start_path, const explorer_flags_t *flags) {
     interactive_state_t state = {0};
@@ -943,26 +3096,49 @@ void interactive_explorer(const char *start_path, const explorer_flags_t *flags)
         perror("realpath");
         return;
     }
+    if (open_tree_index(flags) != 0) {
+        free(state.current_path);
+        return;
+    }
     state.flags = *flags;  // Copy initial settings
     state.needs_refresh = 1;
     state.terminal_resized = 0;
-    state.clipboard_path = NULL;
+    state.clipboard = NULL;
+    state.clipboard_count = 0;
     state.clipboard_is_move = 0;
-    
-    // Set global state for signal handling
-    global_state = &state;
+    selection_init(&state.selection);
+    name_pack_init(&state.names);
     
     list_init(&state.entries);
     history_init(&state.history);
     
-    // Setup signal handler for terminal resize
-    signal(SIGWINCH, handle_terminal_resize);
+    // One epoll set for keyboard, resize, timer and worker events
+    if (events_init() != 0) {
+        free(state.current_path);
+        return;
+    }
+    
+    // Big files are streamed with page-cache hygiene; -O adds O_DIRECT
+    fileop_config_t copy_config = { FILEOP_STREAM_THRESHOLD, flags->direct_io };
+    fileop_configure(&copy_config);
+    
+    // Worker threads for long file operations and du sizes; they wake us
+    // through the eventfd
+    if (jobs_start(events_wakeup) != 0 || du_start(events_wakeup) != 0) {
+        fprintf(stderr, "Failed to start background worker\n");
+        jobs_stop();
+        events_free();
+        free(state.current_path);
+        return;
+    }
     
     setup_terminal(1);  // Enable raw mode for single-key input
+    term_geometry_refresh();
     
     // Switch to alternate screen buffer (like btop, vim, htop)
     printf("\033[?1049h");  // Switch to alternate screen
     fflush(stdout);
+    term_query_sync();      // Use synchronized frame updates if available
     
     // Load initial directory immediately
     load_directory(&state);
@@ -970,14 +3146,6 @@ void interactive_explorer(const char *start_path, const explorer_flags_t *flags)
     // Main event loop - runs until user quits
     int running = 1;
     while (running) {
-        // Handle terminal resize
-        if (state.terminal_resized) {
-            state.terminal_resized = 0;
-            state.needs_refresh = 1;
-            // Force refresh of terminal size cache
-            get_terminal_height_cached();
-        }
-        
         // Reload directory if needed (after navigation or setting changes)
         if (state.needs_refresh) {
             load_directory(&state);
@@ -987,183 +3155,63 @@ void interactive_explorer(const char *start_path, const explorer_flags_t *flags)
         // Draw the UI
         display_interface(&state);
         
-        // Wait for and process user input
-        char key = read_single_char_optimized();
+        // Tick the progress bar only while something runs in the background
+        int busy = jobs_busy() || (state.search && search_running(state.search)) ||
+                   (state.checksum && checksum_running(state.checksum)) ||
+                   (state.dupes && dupes_running(state.dupes));
+        if (busy != state.timer_armed) {
+            events_set_timer(busy ? 250 : 0);
+            state.timer_armed = busy;
+        }
         
-        switch (key) {
-            case 'q':  // Quit
-                running = 0;
-                break;
-                
-            case 'j':  // Move down
-            case '\033':  // Arrow keys start with escape sequence
-                if (key == '\033') {
-                    // Arrow keys are now handled in read_single_char_optimized
-                    // This case is kept for compatibility
-                    char seq[2];
-                    if (read(STDIN_FILENO, &seq[0], 1) == 1 && read(STDIN_FILENO, &seq[1], 1) == 1) {
-                        if (seq[0] == '[') {
-                            if (seq[1] == 'B') key = 'j';  // Down arrow
-                            else if (seq[1] == 'A') key = 'k';  // Up arrow
-                        }
-                    }
-                }
-                /* fall through */  // Intentional fallthrough to movement handling
-                
-            case 'k':  // Move up
-                if (key == 'j' || key == '\033') {
-                    if (state.cursor_pos < (int)state.entries.used - 1) {
-                        state.cursor_pos++;
-                    }
-                } else if (key == 'k') {
-                    if (state.cursor_pos > 0) {
-                        state.cursor_pos--;
-                    }
-                }
-                break;
-                
-            case '\n':  // Enter key - open file or directory
-                if (state.entries.used > 0) {
-                    file_entry_t *entry = &state.entries.arr[state.cursor_pos];
-                    if (entry->st_valid && S_ISDIR(entry->st.st_mode)) {
-                        // Save current directory to history before navigating
-                        history_push(&state.history, state.current_path);
-                        
-                        // Navigate into directory
-                        free(state.current_path);
-                        state.current_path = strdup(entry->path);
-                        state.needs_refresh = 1;
-                    } else {
-                        // For files, just show a message (could be extended to open files)
-                        clear_screen();
-                        printf("File: %s\n", entry->name);
-                        printf("Path: %s\n", entry->path);
-                        if (entry->st_valid) {
-                            printf("Size: %ld bytes\n", (long)entry->st.st_size);
-                            format_mtime(entry->st.st_mtime, time_buf, sizeof(time_buf));
-                            printf("Modified: %s\n", time_buf);
-                            print_mode(entry->st.st_mode, mode_buf, sizeof(mode_buf));
-                            printf("Permissions: %s\n", mode_buf);
-                        }
-                        printf("\nPress any key to continue...");
-                        fflush(stdout);
-                        read_single_char_optimized();
-                        state.needs_refresh = 1;
-                    }
-                }
-                break;
-                
-            case 'b':  // Go back to previous directory using history
-                if (!history_is_empty(&state.history)) {
-                    char *prev_path = history_pop(&state.history);
-                    if (prev_path && strcmp(prev_path, state.current_path) != 0) {
-                        free(state.current_path);
-                        state.current_path = strdup(prev_path);
-                        state.needs_refresh = 1;
-                    }
-                    free(prev_path);  // Free the popped path
-                } else {
-                    // If no history, try to go to parent directory as fallback
-                    char *parent = realpath("..", NULL);
-                    if (parent && strcmp(parent, state.current_path) != 0) {
-                        free(state.current_path);
-                        state.current_path = parent;
-                        state.needs_refresh = 1;
-                    } else {
-                        free(parent);
-                    }
-                }
-                break;
-                
-            // REAL-TIME FLAG TOGGLES 
-            case 'a':  // Toggle hidden files
-                state.flags.show_all = !state.flags.show_all;
-                state.needs_refresh = 1;
-                break;
-                
-            case 'l':  // Toggle long/short view
-                state.flags.long_format = !state.flags.long_format;
-                break;
-                
-            case 's':  // Cycle through sort modes
-                state.flags.sort_mode = (state.flags.sort_mode + 1) % 3;
-                state.needs_refresh = 1;
-                break;
-                
-            case 'H':  // Toggle human-readable sizes (shift+h)
-                state.flags.human_readable = !state.flags.human_readable;
-                break;
-                
-            case 'd':  // Show only directories
-                state.flags.dirs_only = !state.flags.dirs_only;
-                if (state.flags.dirs_only) state.flags.files_only = 0;
-                state.needs_refresh = 1;
-                break;
-                
-            case 'f':  // Show only files
-                state.flags.files_only = !state.flags.files_only;
-                if (state.flags.files_only) state.flags.dirs_only = 0;
-                state.needs_refresh = 1;
-                break;
-                
-            case 'n':  // Create new file or directory
-                create_new_file_or_dir(&state);
-                break;
-                
-            case 'D':  // Delete selected file or directory
-                delete_selected_entry(&state);
-                break;
-                
-            case 'c':  // Copy selected file/directory
-                copy_selected_entry(&state);
-                break;
-                
-            case 'm':  // Move (cut) selected file/directory
-                move_selected_entry(&state);
-                break;
-                
-            case 'p':  // Paste from clipboard
-                paste_from_clipboard(&state);
-                break;
-                
-            case 'r':  // Refresh (re-read directory)
-                state.needs_refresh = 1;
-                break;
-                
-            case '?':  // Show help
-                clear_screen();
-                printf("\033[1;35mMEXPLORER - INTERACTIVE FILE EXPLORER\033[0m\n\n");
-                printf("\033[1;33mNAVIGATION:\033[0m\n");
-                printf("  j / k or ↓ / ↑  - Move cursor up/down\n");
-                printf("  ENTER           - Open directory or file\n");
-                printf("  b               - Go back to previous directory\n\n");
-                printf("\033[1;33mVIEW SETTINGS (toggle on/off):\033[0m\n");
-                printf("  a - Toggle hidden files (show/hide dotfiles)\n");
-                printf("  l - Toggle long format (detailed/simple view)\n");
-                printf("  H - Toggle human-readable file sizes\n");
-                printf("  s - Cycle sort order (name → size → time)\n");
-                printf("  d - Toggle directories only filter\n");
-                printf("  f - Toggle files only filter\n");
-                printf("  r - Refresh current directory view\n\n");
-                printf("\033[1;33mCREATION & DELETION:\033[0m\n");
-                printf("  n - Create new file or directory (inline prompt)\n");
-                printf("  D - Delete selected file or directory (with confirmation)\n\n");
-                printf("\033[1;33mCOPY/PASTE:\033[0m\n");
-                printf("  c - Copy selected file/directory to clipboard\n");
-                printf("  m - Move (cut) selected file/directory to clipboard\n");
-                printf("  p - Paste from clipboard to current directory\n\n");
-                printf("\033[1;33mOTHER:\033[0m\n");
-                printf("  q - Quit the explorer\n");
-                printf("  ? - Show this help screen\n\n");
-                printf("Press any key to continue...");
-                fflush(stdout);
-                read_single_char_optimized();
-                state.needs_refresh = 1;
-                break;
-                
-            default:
-                // Ignore unknown keys
-                break;
+        // Sleep until something happens - keys, resize or background work
+        int ev = events_wait(-1);
+        
+        // Background jobs finished? Report them and refresh the listing
+        if (ev & EV_WAKEUP) {
+            reap_jobs(&state);
+            du_update(&state);
+            search_update(&state);
+            checksum_update(&state);
+            dupes_update(&state);
+        }
+        
+        // The file followed in the viewer grew, shrank or was replaced
+        if (ev & EV_FILE) {
+            follow_update(&state);
+        }
+        
+        // Handle terminal resize right away, not on the next key press
+        if (ev & EV_RESIZE) {
+            state.terminal_resized = 1;
+        }
+        if (state.terminal_resized) {
+            state.terminal_resized = 0;
+            term_geometry_refresh();  // The only place the size is re-read
+            screen_invalidate();      // Repaint everything at the new size
+        }
+        
+        if (!(ev & EV_INPUT)) {
+            continue;
+        }
+        
+        // Apply every key that is already queued (key repeat, pastes)
+        // before drawing the next frame
+        input_fill(0);
+        int key;
+        while (running && (key = input_next()) != KEY_NONE) {
+            state.status_msg[0] = '\0';  // Messages last until the next key
+            if (key != 'q') state.quit_armed = 0;
+            running = handle_key(&state, key);
+            
+            // Later keys in the batch must see the reloaded listing
+            if (running && state.needs_refresh) {
+                load_directory(&state);
+                state.needs_refresh = 0;
+            }
+        }
+        if (input_eof()) {
+            running = 0;  // Terminal went away
         }
     }
     
@@ -1,6 +1,8 @@
 #ifndef MEXPLORER_H
 #define MEXPLORER_H
 
+#include "search.h"
+#include "checksum.h"
 #include <sys/stat.h>
 #include <stddef.h>
 
@@ -18,8 +20,14 @@ typedef struct {
     struct stat st;     // stat info (permissions, size, timestamps)
     int st_valid;       // 1 if stat() succeeded, 0 otherwise
     int is_selected;    // For interactive selection
+    int du_state;       // du mode: DU_NONE, DU_PENDING or DU_DONE
+    unsigned long long du_bytes;   // du mode: recursive apparent size
+    unsigned long long du_blocks;  // du mode: recursive 512-byte blocks used
 } file_entry_t;
 
+// Recursive size state of a directory entry in du mode
+enum { DU_NONE, DU_PENDING, DU_DONE };
+
 // Configuration flags passed from command line arguments
 typedef struct {
     int show_all;           // -a: show hidden files (starting with .)
@@ -30,10 +38,27 @@ typedef struct {
     int human_readable;     // -h: show sizes in human-readable format
     sort_mode_t sort_mode;  // Sorting method (name, size, time)
     int interactive;        // Whether to run in interactive mode
+    int debug_stats;        // -D: show bytes written per frame
+    int direct_io;          // -O: large copies bypass the page cache (O_DIRECT)
+    int du_mode;            // -z: show recursive directory sizes
+    const char *find_pattern; // -F/-E/-G: print what matches below the folder and exit
+    search_syntax_t find_syntax; // How find_pattern is read (glob, regex or file contents)
+    unsigned long long max_search_size; // -x: content search skips bigger files (0 = no limit)
+    int checksum;           // -C: print checksums of the files below the folder and exit
+    checksum_algo_t checksum_algo; // Which one (-C crc32c, xxh64 or sha256)
+    int find_dupes;         // -u: print sets of duplicate files below the folder and exit
+    const char *index_build; // -B: write a metadata index of the tree below the folder and exit
+    const char *index_file; // -I: list folders from this index while they are unchanged
+    const char *locate_text; // -L: print indexed paths below the folder whose names contain this
 } explorer_flags_t;
 
 // Function declarations
 void traverse_directory(const char *path, const explorer_flags_t *flags);
 void interactive_explorer(const char *start_path, const explorer_flags_t *flags);
+int find_names(const char *path, const explorer_flags_t *flags);
+int checksum_tree(const char *path, const explorer_flags_t *flags);
+int find_dupes(const char *path, const explorer_flags_t *flags);
+int build_index(const char *path, const explorer_flags_t *flags);
+int locate_names(const char *path, const explorer_flags_t *flags);
 
 #endif
@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// One queued unit of work
+typedef struct {
+    pool_fn_t fn;
+    void *arg;
+} pool_task_t;
+
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;   // Workers wait here for tasks
+    pthread_cond_t not_full;    // Producers wait here for queue space
+    pthread_cond_t idle;        // pool_wait() waits here for quiescence
+    pool_task_t *tasks;         // Ring buffer of queued tasks
+    size_t depth;               // Ring capacity
+    size_t head, count;
+    size_t busy;                // Tasks currently executing
+    int stopping;
+    int nthreads;
+    pthread_t *threads;
+};
+
+// Worker: run tasks until the pool is destroyed
+static void *pool_worker(void *arg) {
+    pool_t *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->count == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        if (pool->count == 0 && pool->stopping) break;
+
+        pool_task_t task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->depth;
+        pool->count--;
+        pool->busy++;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        task.fn(task.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->busy--;
+        if (pool->count == 0 && pool->busy == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start 'nthreads' workers sharing a queue of at most 'queue_depth' tasks
+pool_t *pool_create(int nthreads, size_t queue_depth) {
+    if (nthreads < 1) nthreads = 1;
+    if (queue_depth < 1) queue_depth = 1;
+
+    pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->tasks = calloc(queue_depth, sizeof(pool_task_t));
+    pool->threads = calloc((size_t)nthreads, sizeof(pthread_t));
+    if (!pool->tasks || !pool->threads) {
+        free(pool->tasks);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pool->depth = queue_depth;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            break;
+        }
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Queue a task, waiting for space if the queue is full
+int pool_submit(pool_t *pool, pool_fn_t fn, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == pool->depth && !pool->stopping) {
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+    }
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    pool->tasks[(pool->head + pool->count) % pool->depth] = (pool_task_t){ fn, arg };
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+// Block until every submitted task has finished
+void pool_wait(pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->busy > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Finish queued tasks, stop the workers and free the pool
+void pool_destroy(pool_t *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->tasks);
+    free(pool->threads);
+    free(pool);
+}
+
+// Workers actually started (pool_create() may get fewer than asked for)
+int pool_threads(const pool_t *pool) {
+    return pool->nthreads;
+}
+
+// Workers for I/O-bound jobs: two per CPU so requests overlap on
+// high-latency storage, within sane bounds
+int pool_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long n = cpus > 0 ? cpus * 2 : 4;
+    if (n < 4) n = 4;
+    if (n > 32) n = 32;
+    return (int)n;
+}
@@ -0,0 +1,19 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Fixed-size thread pool with a bounded task queue. pool_submit() blocks
+// while the queue is full, so a fast producer (a directory walker) can't
+// run ahead of the workers and pile up unbounded memory.
+typedef struct pool pool_t;
+typedef void (*pool_fn_t)(void *arg);
+
+pool_t *pool_create(int nthreads, size_t queue_depth);
+int pool_submit(pool_t *pool, pool_fn_t fn, void *arg);
+void pool_wait(pool_t *pool);
+void pool_destroy(pool_t *pool);
+int pool_threads(const pool_t *pool);
+int pool_default_threads(void);
+
+#endif
@@ -0,0 +1,407 @@
+#define _GNU_SOURCE  // FNM_CASEFOLD, memrchr()
+
+#include "search.h"
+#include "memscan.h"
+#include "walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Content search: files up to this size are read(); bigger ones are
+// mapped, where the cost of setting up the mapping pays for itself
+#define SMALL_FILE_MAX (64u << 10)
+
+// Content search: at most this many matching lines are reported per file
+#define MAX_LINES_PER_FILE 1000
+
+// Content search: longest line preview, and how much of the line before
+// the match is kept when the match is far along a long line
+#define PREVIEW_MAX 200
+#define PREVIEW_LEAD 40
+
+// What a walk item is: a folder to read, or (content search) a file to search
+enum { ITEM_DIR, ITEM_FILE };
+
+struct search {
+    pthread_mutex_t lock;       // Guards the hits
+    pthread_cond_t hits_cond;   // search_collect(): hits arrived or the walk ended
+    walk_t *walk;
+    atomic_int cancel;
+    atomic_ulong dirs, files, binary;
+    atomic_ullong bytes;
+    search_hit_t *hits;         // Found since the last search_collect()
+    size_t hits_used, hits_cap;
+
+    char *pattern;              // Content search: lower-cased when ignoring case
+    size_t pattern_len;
+    search_opts_t opts;
+    int ignore_case;
+    int fnm_flags, re_flags;
+    void (*notify)(void);
+};
+
+// Hits of one work item, handed over in one go
+typedef struct {
+    search_hit_t *arr;
+    size_t used, cap;
+} hit_list_t;
+
+static void add_hit(hit_list_t *l, const char *path, unsigned long line, char *preview) {
+    if (l->used == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 16;
+        l->arr = realloc(l->arr, l->cap * sizeof(search_hit_t));
+        if (!l->arr) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    l->arr[l->used++] = (search_hit_t){ xstrdup(path), line, preview };
+}
+
+// Hand a batch of hits to the UI
+static void publish_hits(search_t *s, hit_list_t *l) {
+    if (l->used == 0) return;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->hits_used + l->used > s->hits_cap) {
+        size_t cap = s->hits_cap ? s->hits_cap : 256;
+        while (cap < s->hits_used + l->used) cap *= 2;
+        search_hit_t *hits = realloc(s->hits, cap * sizeof(search_hit_t));
+        if (!hits) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        s->hits = hits;
+        s->hits_cap = cap;
+    }
+    memcpy(s->hits + s->hits_used, l->arr, l->used * sizeof(search_hit_t));
+    s->hits_used += l->used;
+    pthread_cond_broadcast(&s->hits_cond);
+    pthread_mutex_unlock(&s->lock);
+    l->used = 0;
+    if (s->notify) s->notify();
+}
+
+static int cancelled(search_t *s) {
+    return atomic_load_explicit(&s->cancel, memory_order_relaxed);
+}
+
+// Read one folder: match names (or queue files for a content search) and
+// queue subfolders. d_type spares a stat() per entry where it is filled in.
+static void search_dir(search_t *s, const char *path, const regex_t *re, hit_list_t *found) {
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    int content = (s->opts.syntax == SEARCH_CONTENT);
+    const char *sep = path[strlen(path) - 1] == '/' ? "" : "/";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && !cancelled(s)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (!s->opts.include_hidden || name[1] == '\0' ||
+                               (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        int hit = 0;
+        if (!content) {
+            hit = re ? regexec(re, name, 0, NULL, 0) == 0
+                     : fnmatch(s->pattern, name, s->fnm_flags) == 0;
+        }
+        if (!hit && type != DT_DIR && !(content && type == DT_REG)) continue;
+
+        char child[PATH_MAX];
+        if ((size_t)snprintf(child, sizeof(child), "%s%s%s", path, sep, name) >= sizeof(child)) {
+            continue;
+        }
+        if (hit) add_hit(found, child, 0, NULL);
+        if (type == DT_DIR || (content && type == DT_REG)) {
+            walk_push(s->walk, type == DT_DIR ? ITEM_DIR : ITEM_FILE, child, NULL, 0);
+        }
+    }
+    closedir(dir);
+    atomic_fetch_add_explicit(&s->dirs, 1, memory_order_relaxed);
+}
+
+// The line around a match, made safe to print: control bytes become
+// spaces, and a long line is cut to a window that starts a little
+// before the match
+static char *make_preview(const char *line, const char *match, const char *end) {
+    int lead = 0;
+    if (match - line > PREVIEW_MAX - PREVIEW_LEAD) {
+        line = match - PREVIEW_LEAD;
+        lead = 1;
+    }
+    size_t n = (size_t)(end - line);
+    if (n > PREVIEW_MAX) n = PREVIEW_MAX;
+    if (n > 0 && line[n - 1] == '\r') n--;
+
+    char *out = malloc(n + 4);
+    if (!out) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t k = 0;
+    if (lead) {
+        memcpy(out, "...", 3);
+        k = 3;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)line[i];
+        out[k++] = (c < 32 || c == 127) ? ' ' : (char)c;
+    }
+    out[k] = '\0';
+    return out;
+}
+
+// Search one file's contents. Small files are read into the worker's
+// buffer; big ones are mapped and read sequentially. Binary files (a NUL
+// in the first 8 KiB) are skipped like grep does.
+static void grep_file(search_t *s, const char *path, char *small_buf, hit_list_t *found) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (s->opts.max_size && (unsigned long long)st.st_size > s->opts.max_size)) {
+        close(fd);
+        return;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const char *data;
+    void *map = NULL;
+    if (size <= SMALL_FILE_MAX) {
+        size_t got = 0;
+        while (got < size) {
+            ssize_t r = read(fd, small_buf + got, size - got);
+            if (r <= 0) break;
+            got += (size_t)r;
+        }
+        size = got;
+        data = small_buf;
+    } else {
+        // A file truncated while we scan it would SIGBUS; grep and ripgrep
+        // accept the same risk for the speed of mapping
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = map;
+    }
+    close(fd);
+
+    if (mem_looks_binary(data, size)) {
+        atomic_fetch_add_explicit(&s->binary, 1, memory_order_relaxed);
+    } else {
+        const char *end = data + size, *p = data, *counted = data;
+        unsigned long line = 1;
+        int reported = 0;
+        const char *match;
+        while (reported < MAX_LINES_PER_FILE && !cancelled(s) &&
+               (match = mem_find(p, (size_t)(end - p), s->pattern, s->pattern_len,
+                                 s->ignore_case)) != NULL) {
+            line += mem_count_byte(counted, (size_t)(match - counted), '\n');
+            counted = match;
+
+            const char *line_start = memrchr(data, '\n', (size_t)(match - data));
+            line_start = line_start ? line_start + 1 : data;
+            const char *line_end = memchr(match, '\n', (size_t)(end - match));
+            if (!line_end) line_end = end;
+
+            add_hit(found, path, line, make_preview(line_start, match, line_end));
+            reported++;
+            p = line_end < end ? line_end + 1 : end;  // One hit per line
+        }
+        atomic_fetch_add_explicit(&s->files, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->bytes, size, memory_order_relaxed);
+    }
+    if (map) munmap(map, (size_t)st.st_size);
+}
+
+// Per-worker state. glibc serializes regexec() on a shared regex_t, so
+// each worker compiles its own copy.
+typedef struct {
+    regex_t re;
+    int have_re;
+    int can_search;
+    char *small_buf;            // Content search: small files are read into it
+    hit_list_t found;
+} search_worker_t;
+
+static void *search_worker_init(void *ctx) {
+    search_t *s = ctx;
+    search_worker_t *sw = calloc(1, sizeof(*sw));
+    if (!sw) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    sw->have_re = (s->opts.syntax == SEARCH_REGEX && regcomp(&sw->re, s->pattern, s->re_flags) == 0);
+    sw->can_search = (s->opts.syntax != SEARCH_REGEX || sw->have_re);
+    if (s->opts.syntax == SEARCH_CONTENT) {
+        sw->small_buf = malloc(SMALL_FILE_MAX);
+        if (!sw->small_buf) sw->can_search = 0;
+    }
+    return sw;
+}
+
+static void search_visit(void *ctx, void *state, const walk_item_t *item) {
+    search_t *s = ctx;
+    search_worker_t *sw = state;
+    if (!sw->can_search || cancelled(s)) return;
+    if (item->kind == ITEM_FILE) {
+        grep_file(s, item->path, sw->small_buf, &sw->found);
+    } else {
+        search_dir(s, item->path, sw->have_re ? &sw->re : NULL, &sw->found);
+    }
+    publish_hits(s, &sw->found);
+}
+
+static void search_worker_done(void *ctx, void *state) {
+    (void)ctx;
+    search_worker_t *sw = state;
+    free(sw->found.arr);
+    free(sw->small_buf);
+    if (sw->have_re) regfree(&sw->re);
+    free(sw);
+}
+
+// The walk is over: wake a waiting search_collect() and the UI
+static void search_finished(void *ctx) {
+    search_t *s = ctx;
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->hits_cond);
+    pthread_mutex_unlock(&s->lock);
+    if (s->notify) s->notify();
+}
+
+static const walk_ops_t search_ops = {
+    .worker_init = search_worker_init,
+    .visit = search_visit,
+    .worker_done = search_worker_done,
+    .finished = search_finished,
+};
+
+// Start searching below 'root'
+search_t *search_start(const char *root, const char *pattern, const search_opts_t *opts,
+                       void (*notify)(void), char *err, size_t errsz) {
+    if (opts->syntax == SEARCH_CONTENT && pattern[0] == '\0') {
+        snprintf(err, errsz, "nothing to look for");
+        return NULL;
+    }
+
+    // Smart case, as in the '/' filter
+    int ignore_case = 1;
+    for (const char *c = pattern; *c; c++) {
+        if (isupper((unsigned char)*c)) ignore_case = 0;
+    }
+
+    search_t *s = calloc(1, sizeof(*s));
+    if (!s || !(s->pattern = strdup(pattern))) {
+        free(s);
+        snprintf(err, errsz, "out of memory");
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->hits_cond, NULL);
+    s->pattern_len = strlen(pattern);
+    s->opts = *opts;
+    s->ignore_case = ignore_case;
+    s->fnm_flags = ignore_case ? FNM_CASEFOLD : 0;
+    s->re_flags = REG_EXTENDED | REG_NOSUB | (ignore_case ? REG_ICASE : 0);
+    s->notify = notify;
+
+    // Compile once here so a bad regex is reported before anything starts
+    if (opts->syntax == SEARCH_REGEX) {
+        regex_t re;
+        int rc = regcomp(&re, pattern, s->re_flags);
+        if (rc != 0) {
+            regerror(rc, &re, err, errsz);
+            search_free(s);
+            return NULL;
+        }
+        regfree(&re);
+    }
+
+    s->walk = walk_create(walk_threads(), &search_ops, s);
+    walk_push(s->walk, ITEM_DIR, root, NULL, 0);
+    if (walk_start(s->walk) != 0) {
+        snprintf(err, errsz, "can't start search threads");
+        search_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// Take the hits found since the last call (NULL if none). With 'wait'
+// set, blocks until there are some or the walk is over. The caller owns
+// the array and frees each hit with search_hit_free().
+search_hit_t *search_collect(search_t *s, size_t *count, int wait) {
+    pthread_mutex_lock(&s->lock);
+    while (wait && s->hits_used == 0 && walk_running(s->walk)) {
+        pthread_cond_wait(&s->hits_cond, &s->lock);
+    }
+    search_hit_t *hits = s->hits;
+    *count = s->hits_used;
+    s->hits = NULL;
+    s->hits_used = s->hits_cap = 0;
+    pthread_mutex_unlock(&s->lock);
+    return hits;
+}
+
+void search_hit_free(search_hit_t *hit) {
+    free(hit->path);
+    free(hit->preview);
+}
+
+// Is the walk still going?
+int search_running(search_t *s) {
+    return walk_running(s->walk);
+}
+
+// Totals so far (for progress)
+void search_get_progress(search_t *s, search_progress_t *out) {
+    out->dirs = atomic_load_explicit(&s->dirs, memory_order_relaxed);
+    out->files = atomic_load_explicit(&s->files, memory_order_relaxed);
+    out->binary = atomic_load_explicit(&s->binary, memory_order_relaxed);
+    out->bytes = atomic_load_explicit(&s->bytes, memory_order_relaxed);
+}
+
+// Stop the walk; hits found so far can still be collected
+void search_cancel(search_t *s) {
+    atomic_store(&s->cancel, 1);
+}
+
+// Stop the walk, wait for the workers and free everything
+void search_free(search_t *s) {
+    if (!s) return;
+    search_cancel(s);
+    walk_free(s->walk);
+    for (size_t i = 0; i < s->hits_used; i++) {
+        search_hit_free(&s->hits[i]);
+    }
+    free(s->hits);
+    free(s->pattern);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->hits_cond);
+    free(s);
+}
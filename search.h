@@ -0,0 +1,51 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+// How a search pattern is read
+typedef enum {
+    SEARCH_GLOB,        // Shell pattern matched against each name (like find -name)
+    SEARCH_REGEX,       // POSIX extended regex found anywhere in each name
+    SEARCH_CONTENT      // Literal text looked for inside files (like grep -rF)
+} search_syntax_t;
+
+typedef struct {
+    search_syntax_t syntax;
+    int include_hidden;             // Also look below dotfiles and dot folders
+    unsigned long long max_size;    // Content search: skip bigger files (0 = no limit)
+} search_opts_t;
+
+// One result
+typedef struct {
+    char *path;             // Entry whose name matched, or file whose contents did
+    unsigned long line;     // Content search: 1-based line number (0 for name hits)
+    char *preview;          // Content search: the matching line, ready to print
+} search_hit_t;
+
+// Running totals
+typedef struct {
+    unsigned long dirs;             // Folders read
+    unsigned long files;            // Files searched (content search)
+    unsigned long binary;           // Files skipped as binary
+    unsigned long long bytes;       // Bytes searched
+} search_progress_t;
+
+typedef struct search search_t;
+
+// Search everything below a folder with several worker threads. Hits
+// stream out through search_collect() while the walk goes on; 'notify'
+// (e.g. events_wakeup, or NULL) is called from a worker whenever new hits
+// or the end of the walk are ready. A pattern with capitals matches case-
+// sensitively, one without ignores case. Returns NULL with a message in
+// 'err' if the pattern is invalid or no thread could be started.
+search_t *search_start(const char *root, const char *pattern, const search_opts_t *opts,
+                       void (*notify)(void), char *err, size_t errsz);
+search_hit_t *search_collect(search_t *s, size_t *count, int wait);
+void search_hit_free(search_hit_t *hit);
+int search_running(search_t *s);
+void search_get_progress(search_t *s, search_progress_t *out);
+void search_cancel(search_t *s);
+void search_free(search_t *s);
+
+#endif
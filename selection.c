@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "selection.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// FNV-1a: short and good enough for file names
+static size_t hash_name(const char *name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+// Slot holding 'name', or the empty slot where it would go
+static size_t find_slot(const selection_t *s, const char *name) {
+    size_t mask = s->cap - 1;
+    size_t i = hash_name(name) & mask;
+    while (s->slots[i] && strcmp(s->slots[i], name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Double the table once it is half full so probe runs stay short
+static void grow(selection_t *s) {
+    size_t old_cap = s->cap;
+    char **old = s->slots;
+
+    s->cap = old_cap ? old_cap * 2 : 64;
+    s->slots = calloc(s->cap, sizeof(char *));
+    if (!s->slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i]) s->slots[find_slot(s, old[i])] = old[i];
+    }
+    free(old);
+}
+
+void selection_init(selection_t *s) {
+    s->slots = NULL;
+    s->cap = 0;
+    s->count = 0;
+}
+
+// Forget every name (keeps the table for reuse)
+void selection_clear(selection_t *s) {
+    for (size_t i = 0; i < s->cap; i++) {
+        free(s->slots[i]);
+        s->slots[i] = NULL;
+    }
+    s->count = 0;
+}
+
+void selection_free(selection_t *s) {
+    selection_clear(s);
+    free(s->slots);
+    selection_init(s);
+}
+
+int selection_contains(const selection_t *s, const char *name) {
+    return s->count > 0 && s->slots[find_slot(s, name)] != NULL;
+}
+
+// Add a name. Returns 1 if it was added, 0 if it was already there.
+int selection_add(selection_t *s, const char *name) {
+    if ((s->count + 1) * 2 > s->cap) grow(s);
+
+    size_t i = find_slot(s, name);
+    if (s->slots[i]) return 0;
+    s->slots[i] = strdup(name);
+    if (!s->slots[i]) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    s->count++;
+    return 1;
+}
+
+// Remove a name, re-inserting the rest of its probe run so later
+// lookups don't stop at the hole
+void selection_remove(selection_t *s, const char *name) {
+    if (s->count == 0) return;
+
+    size_t mask = s->cap - 1;
+    size_t i = find_slot(s, name);
+    if (!s->slots[i]) return;
+    free(s->slots[i]);
+    s->slots[i] = NULL;
+    s->count--;
+
+    for (i = (i + 1) & mask; s->slots[i]; i = (i + 1) & mask) {
+        char *moved = s->slots[i];
+        s->slots[i] = NULL;
+        s->slots[find_slot(s, moved)] = moved;
+    }
+}
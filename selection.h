@@ -0,0 +1,23 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <stddef.h>
+
+// Set of entry names: the multi-selection of a folder, or the names a
+// paste checks for conflicts. Keyed by name rather than by position so a
+// selection survives re-reading and re-sorting the listing; lookups are
+// O(1) so marking thousands of entries stays cheap.
+typedef struct {
+    char **slots;       // Open-addressing table of owned names (NULL = empty)
+    size_t cap;         // Table size (power of two)
+    size_t count;       // Names in the set
+} selection_t;
+
+void selection_init(selection_t *s);
+void selection_free(selection_t *s);
+void selection_clear(selection_t *s);
+int selection_contains(const selection_t *s, const char *name);
+int selection_add(selection_t *s, const char *name);
+void selection_remove(selection_t *s, const char *name);
+
+#endif
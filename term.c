@@ -0,0 +1,560 @@
+#define _XOPEN_SOURCE 700  // wcwidth(), newlocale()
+
+#include "term.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <locale.h>
+#include <wchar.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+// What we composed this frame and what the terminal is showing right now
+typedef struct {
+    outbuf_t *rows;         // Rows composed for the current frame
+    outbuf_t *shadow;       // Rows as last written to the terminal
+    int nrows;              // Number of rows in both arrays
+    int cols;               // Terminal width the shadow was painted at
+    int shadow_valid;       // 0 forces a full repaint on the next flush
+    outbuf_t scroll;        // Scroll-region commands queued for the next flush
+    outbuf_t out;           // Escape sequences + text sent in one write()
+    screen_stats_t stats;   // Counters for debug stats mode
+    int sync_output;        // Terminal supports synchronized updates (?2026)
+    locale_t utf8;          // Character widths are measured in this (0 = none)
+    int utf8_tried;
+} screen_t;
+
+// Parsed keys waiting to be handled, plus bytes of an unfinished sequence
+#define KEY_QUEUE_SIZE 1024
+typedef struct {
+    int keys[KEY_QUEUE_SIZE];   // Ring buffer of parsed keys
+    size_t head, count;
+    unsigned char raw[64];      // Start of an escape sequence split across reads
+    size_t raw_len;
+    int eof;                    // stdin is closed
+} input_t;
+
+// Terminal dimensions as of the last SIGWINCH
+typedef struct {
+    int rows, cols;
+    unsigned long ioctls;   // TIOCGWINSZ calls made (debug stats)
+} geometry_t;
+
+static screen_t scr;
+static input_t in;
+static geometry_t geom = { 24, 80, 0 };
+
+// Re-read the terminal size. Called once at startup and on SIGWINCH only,
+// so drawing a frame never needs a syscall to know the size.
+void term_geometry_refresh(void) {
+    struct winsize w;
+    geom.ioctls++;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_row > 0 && w.ws_col > 0) {
+        geom.rows = w.ws_row;
+        geom.cols = w.ws_col;
+    } else {
+        geom.rows = 24;  // Safe defaults if we can't detect
+        geom.cols = 80;
+    }
+}
+
+int term_rows(void) {
+    return geom.rows;
+}
+
+int term_cols(void) {
+    return geom.cols;
+}
+
+unsigned long term_geometry_ioctls(void) {
+    return geom.ioctls;
+}
+
+// Start with an empty buffer
+void ob_init(outbuf_t *ob) {
+    ob->data = NULL;
+    ob->len = 0;
+    ob->cap = 0;
+}
+
+// Free the buffer memory
+void ob_free(outbuf_t *ob) {
+    free(ob->data);
+    ob_init(ob);
+}
+
+// Forget the contents but keep the allocation for reuse
+void ob_reset(outbuf_t *ob) {
+    ob->len = 0;
+    if (ob->data) ob->data[0] = '\0';
+}
+
+// Make room for 'extra' more bytes plus the terminator
+static void ob_reserve(outbuf_t *ob, size_t extra) {
+    if (ob->len + extra + 1 <= ob->cap) return;
+    size_t newcap = ob->cap ? ob->cap : 128;
+    while (newcap < ob->len + extra + 1) newcap *= 2;
+    char *tmp = realloc(ob->data, newcap);
+    if (!tmp) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    ob->data = tmp;
+    ob->cap = newcap;
+}
+
+// Append raw bytes, growing the buffer geometrically
+void ob_append(outbuf_t *ob, const char *s, size_t n) {
+    ob_reserve(ob, n);
+    if (n) memcpy(ob->data + ob->len, s, n);
+    ob->len += n;
+    ob->data[ob->len] = '\0';
+}
+
+void ob_puts(outbuf_t *ob, const char *s) {
+    ob_append(ob, s, strlen(s));
+}
+
+// printf() into the buffer
+void ob_printf(outbuf_t *ob, const char *fmt, ...) {
+    char small[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    if ((size_t)n < sizeof(small)) {
+        ob_append(ob, small, (size_t)n);
+        return;
+    }
+
+    // Didn't fit in the stack buffer - format straight into the tail
+    ob_reserve(ob, (size_t)n);
+    va_start(ap, fmt);
+    vsnprintf(ob->data + ob->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    ob->len += (size_t)n;
+}
+
+// Bytes and terminal columns of the character starting at s[0..n): a
+// CJK character or emoji takes two columns and a combining accent none.
+// Bytes that don't decode count as one column with their continuation bytes.
+static size_t char_cols(const char *s, size_t n, int *width) {
+    *width = 1;
+    if ((unsigned char)s[0] < 0x80) return 1;
+
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));
+    wchar_t wc;
+    size_t len = mbrtowc(&wc, s, n, &state);
+    if (len == 0 || len == (size_t)-1 || len == (size_t)-2) {
+        len = 1;
+        while (len < n && ((unsigned char)s[len] & 0xC0) == 0x80) len++;
+        return len;
+    }
+    int w = wcwidth(wc);
+    if (w >= 0) *width = w;
+    return len;
+}
+
+// Find how many bytes of a row fit in 'cols' terminal columns.
+// Escape sequences take no space.
+static size_t clip_row(const char *s, size_t n, int cols,
+                       int *visible, int *has_esc, int *clipped) {
+    size_t i = 0;
+    int vis = 0;
+    *has_esc = 0;
+    *clipped = 0;
+
+    while (i < n) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '\033') {
+            *has_esc = 1;
+            i++;
+            if (i < n && s[i] == '[') {
+                i++;
+                // CSI: parameters until a final byte in 0x40-0x7E
+                while (i < n && !((unsigned char)s[i] >= 0x40 && (unsigned char)s[i] <= 0x7E)) i++;
+            }
+            if (i < n) i++;
+            continue;
+        }
+        int w;
+        size_t len = 1;
+        if (c == '\t') {
+            w = 8 - (vis % 8);
+        } else {
+            len = char_cols(s + i, n - i, &w);
+        }
+        if (vis + w > cols) {
+            *clipped = 1;
+            break;
+        }
+        vis += w;
+        i += len;
+    }
+    *visible = vis;
+    return i;
+}
+
+// Write the whole buffer, retrying on partial writes
+static void write_all(const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+// Prepare a new frame of 'rows' x 'cols'; a size change forces a repaint
+void screen_begin(int rows, int cols) {
+    if (rows < 1) rows = 1;
+    if (cols < 1) cols = 1;
+
+    if (rows != scr.nrows) {
+        for (int i = rows; i < scr.nrows; i++) {
+            ob_free(&scr.rows[i]);
+            ob_free(&scr.shadow[i]);
+        }
+        outbuf_t *r = realloc(scr.rows, rows * sizeof(outbuf_t));
+        outbuf_t *s = realloc(scr.shadow, rows * sizeof(outbuf_t));
+        if (!r || !s) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = scr.nrows; i < rows; i++) {
+            ob_init(&r[i]);
+            ob_init(&s[i]);
+        }
+        scr.rows = r;
+        scr.shadow = s;
+        scr.nrows = rows;
+        scr.shadow_valid = 0;
+    }
+    if (cols != scr.cols) {
+        scr.cols = cols;
+        scr.shadow_valid = 0;
+    }
+
+    for (int i = 0; i < scr.nrows; i++) {
+        ob_reset(&scr.rows[i]);
+    }
+}
+
+// Buffer to compose row 'row' (0-based) of the current frame into
+outbuf_t *screen_row(int row) {
+    static outbuf_t discard;  // Rows outside the screen go nowhere
+    if (row < 0 || row >= scr.nrows) {
+        ob_reset(&discard);
+        return &discard;
+    }
+    return &scr.rows[row];
+}
+
+// Shift rows top..bottom (0-based, inclusive) of the terminal by 'delta'
+// using a scroll region: positive moves content up (CSI S), negative
+// down (CSI T). The shadow is shifted the same way, so the next flush
+// only paints the rows that scrolled into view.
+void screen_scroll(int top, int bottom, int delta) {
+    int height = bottom - top + 1;
+    if (!scr.shadow_valid || delta == 0 || top < 0 || bottom >= scr.nrows ||
+        height < 2 || delta >= height || -delta >= height) {
+        return;  // Nothing on screen to reuse - a normal flush handles it
+    }
+
+    // DECSTBM sets the region, then scroll it and restore the full screen
+    ob_printf(&scr.scroll, "\033[%d;%dr\033[%d%c\033[r", top + 1, bottom + 1,
+              delta > 0 ? delta : -delta, delta > 0 ? 'S' : 'T');
+
+    // Rotate the shadow rows; rows that scrolled in are blank on screen
+    outbuf_t tmp;
+    if (delta > 0) {
+        for (int i = top; i + delta <= bottom; i++) {
+            tmp = scr.shadow[i];
+            scr.shadow[i] = scr.shadow[i + delta];
+            scr.shadow[i + delta] = tmp;
+        }
+        for (int i = bottom - delta + 1; i <= bottom; i++) ob_reset(&scr.shadow[i]);
+    } else {
+        for (int i = bottom; i + delta >= top; i--) {
+            tmp = scr.shadow[i];
+            scr.shadow[i] = scr.shadow[i + delta];
+            scr.shadow[i + delta] = tmp;
+        }
+        for (int i = top; i < top - delta; i++) ob_reset(&scr.shadow[i]);
+    }
+}
+
+// Forget what is on screen (someone else drew over it)
+void screen_invalidate(void) {
+    scr.shadow_valid = 0;
+    ob_reset(&scr.scroll);
+}
+
+// Send only the rows that differ from the shadow frame. Returns bytes written.
+size_t screen_flush(void) {
+    int lines = 0;
+    ob_reset(&scr.out);
+
+    // Terminals that support it show the whole frame at once (no tearing)
+    if (scr.sync_output) {
+        ob_puts(&scr.out, "\033[?2026h");
+    }
+    size_t sync_len = scr.out.len;
+
+    if (scr.shadow_valid) {
+        ob_append(&scr.out, scr.scroll.data, scr.scroll.len);
+    } else {
+        // Start from a blank screen so empty rows need no output
+        ob_puts(&scr.out, "\033[H\033[2J");
+        for (int i = 0; i < scr.nrows; i++) {
+            ob_reset(&scr.shadow[i]);
+        }
+        scr.shadow_valid = 1;
+    }
+
+    // Rows are UTF-8 whatever the program's locale; measure them as such
+    if (!scr.utf8_tried) {
+        scr.utf8 = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t)0);
+        scr.utf8_tried = 1;
+    }
+    locale_t saved_locale = scr.utf8 ? uselocale(scr.utf8) : (locale_t)0;
+
+    for (int i = 0; i < scr.nrows; i++) {
+        outbuf_t *row = &scr.rows[i];
+        outbuf_t *shadow = &scr.shadow[i];
+        int visible, has_esc, clipped;
+        size_t n = clip_row(row->data ? row->data : "", row->len, scr.cols,
+                            &visible, &has_esc, &clipped);
+
+        if (n == shadow->len && (n == 0 || memcmp(row->data, shadow->data, n) == 0)) {
+            continue;  // Terminal already shows this row
+        }
+
+        // Skip the unchanged plain-text start of the row, so a counter
+        // changing at the end of a line costs a few bytes. Every row ends
+        // with attributes reset, so the prefix is always in default colors.
+        size_t skip = 0;
+        size_t common = n < shadow->len ? n : shadow->len;
+        while (skip < common && row->data[skip] == shadow->data[skip] &&
+               row->data[skip] != '\033' && row->data[skip] != '\t') {
+            skip++;
+        }
+        while (skip > 0 && ((unsigned char)row->data[skip] & 0xC0) == 0x80) {
+            skip--;  // Don't split a UTF-8 character
+        }
+
+        int col = 0;
+        for (size_t j = 0; j < skip;) {
+            int w;
+            j += char_cols(row->data + j, skip - j, &w);
+            col += w;
+        }
+        ob_printf(&scr.out, "\033[%d;%dH", i + 1, col + 1);
+        ob_append(&scr.out, row->data + skip, n - skip);
+        if (clipped && has_esc) {
+            ob_puts(&scr.out, "\033[0m");  // Don't leak colors cut off mid-row
+        }
+        if (visible < scr.cols) {
+            ob_puts(&scr.out, "\033[K");  // Erase leftovers of the old row
+        }
+
+        ob_reset(shadow);
+        ob_append(shadow, row->data ? row->data : "", n);
+        lines++;
+    }
+    if (saved_locale) uselocale(saved_locale);
+
+    if (scr.out.len == sync_len) {
+        ob_reset(&scr.out);  // Nothing changed - send nothing at all
+    } else if (scr.sync_output) {
+        ob_puts(&scr.out, "\033[?2026l");
+    }
+
+    ob_reset(&scr.scroll);
+    fflush(stdout);  // Anything printf'd earlier must land first
+    write_all(scr.out.data ? scr.out.data : "", scr.out.len);
+
+    scr.stats.frames++;
+    scr.stats.last_bytes = scr.out.len;
+    scr.stats.last_lines = lines;
+    return scr.out.len;
+}
+
+const screen_stats_t *screen_stats(void) {
+    return &scr.stats;
+}
+
+// Release all frame memory
+void screen_free(void) {
+    for (int i = 0; i < scr.nrows; i++) {
+        ob_free(&scr.rows[i]);
+        ob_free(&scr.shadow[i]);
+    }
+    free(scr.rows);
+    free(scr.shadow);
+    ob_free(&scr.scroll);
+    ob_free(&scr.out);
+    if (scr.utf8) freelocale(scr.utf8);
+    memset(&scr, 0, sizeof(scr));
+}
+
+// Queue a parsed key
+static void push_key(int key) {
+    in.keys[(in.head + in.count) % KEY_QUEUE_SIZE] = key;
+    in.count++;
+}
+
+// Handle a complete CSI/SS3 sequence. Arrow keys become the vi keys the
+// explorer already uses; terminal replies are consumed; anything else
+// is swallowed so its bytes don't turn into stray commands.
+static void handle_sequence(const unsigned char *seq, size_t len) {
+    unsigned char final = seq[len - 1];
+
+    if (len == 3) {
+        switch (final) {
+            case 'A': push_key('k'); return;  // Up arrow
+            case 'B': push_key('j'); return;  // Down arrow
+            case 'C': push_key('l'); return;  // Right arrow
+            case 'D': push_key('h'); return;  // Left arrow
+        }
+    }
+
+    // DECRQM reply: ESC [ ? 2026 ; Ps $ y  (Ps 1/2/3 = mode is known)
+    if (final == 'y' && len >= 11 && memcmp(seq + 2, "?2026;", 6) == 0) {
+        char ps = (char)seq[8];
+        scr.sync_output = (ps == '1' || ps == '2' || ps == '3');
+    }
+}
+
+// Split raw bytes into keys. Returns how many bytes were used; a trailing
+// escape sequence that isn't complete yet is left for the next read.
+static size_t parse_input(const unsigned char *buf, size_t n, int at_end) {
+    size_t i = 0;
+    while (i < n && in.count < KEY_QUEUE_SIZE) {
+        if (buf[i] != '\033') {
+            push_key(buf[i++]);
+            continue;
+        }
+
+        // Escape: lone key, or the start of a CSI (ESC [) / SS3 (ESC O) sequence
+        if (i + 1 >= n) {
+            if (!at_end) return i;
+            push_key(KEY_ESC);
+            i++;
+            continue;
+        }
+        if (buf[i + 1] != '[' && buf[i + 1] != 'O') {
+            push_key(KEY_ESC);  // Escape followed by an ordinary key
+            i++;
+            continue;
+        }
+
+        size_t j = i + 2;
+        if (buf[i + 1] == '[') {
+            // Parameter and intermediate bytes, then a final byte
+            while (j < n && buf[j] >= 0x20 && buf[j] <= 0x3F) j++;
+            while (j < n && buf[j] >= 0x20 && buf[j] <= 0x2F) j++;
+        }
+        if (j >= n) {
+            if (!at_end && n - i < sizeof(in.raw)) return i;
+            push_key(KEY_ESC);  // Never completed - treat as Escape + text
+            i++;
+            continue;
+        }
+        handle_sequence(buf + i, j - i + 1);
+        i = j + 1;
+    }
+    return i;
+}
+
+// Wait up to 'ms' milliseconds for stdin to become readable
+static int stdin_ready(int ms) {
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    int r;
+    do {
+        r = poll(&pfd, 1, ms);
+    } while (r < 0 && errno == EINTR);
+    return r > 0;
+}
+
+// Parse a held-back partial sequence as-is (no more bytes are coming)
+static void flush_raw(void) {
+    size_t used = parse_input(in.raw, in.raw_len, 1);
+    in.raw_len -= used;
+    memmove(in.raw, in.raw + used, in.raw_len);
+}
+
+// Read whatever input is available and parse it into the key queue.
+// With 'wait' set, blocks until at least one byte arrives. Returns the
+// number of queued keys.
+int input_fill(int wait) {
+    unsigned char buf[4096];
+
+    while (in.count < KEY_QUEUE_SIZE && !in.eof) {
+        int ready = stdin_ready(wait && in.count == 0 && in.raw_len == 0 ? -1 : 0);
+        if (!ready && in.raw_len > 0) {
+            ready = stdin_ready(25);  // Give a split sequence a moment to finish
+        }
+        if (!ready) {
+            if (in.raw_len > 0) flush_raw();
+            break;
+        }
+
+        // Each byte makes at most one key, so never read more than fits
+        size_t room = KEY_QUEUE_SIZE - in.count;
+        size_t want = sizeof(buf) - in.raw_len;
+        if (want > room) want = room;
+        memcpy(buf, in.raw, in.raw_len);
+        ssize_t r = read(STDIN_FILENO, buf + in.raw_len, want);
+        if (r < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (r <= 0) {
+            in.eof = 1;
+            if (in.raw_len > 0) flush_raw();
+            break;
+        }
+
+        size_t total = in.raw_len + (size_t)r;
+        size_t used = parse_input(buf, total, 0);
+        in.raw_len = total - used;
+        memmove(in.raw, buf + used, in.raw_len);
+    }
+    return (int)in.count;
+}
+
+// Next queued key, or KEY_NONE if nothing is waiting
+int input_next(void) {
+    if (in.count == 0) return KEY_NONE;
+    int key = in.keys[in.head];
+    in.head = (in.head + 1) % KEY_QUEUE_SIZE;
+    in.count--;
+    return key;
+}
+
+// Has stdin been closed?
+int input_eof(void) {
+    return in.eof && in.count == 0;
+}
+
+// Block until a key is available and return it
+int read_key(void) {
+    while (in.count == 0 && !in.eof) {
+        input_fill(1);
+    }
+    return input_next();  // KEY_NONE once stdin is gone
+}
+
+// Ask the terminal whether it supports synchronized output (mode 2026).
+// The reply, if any, arrives on stdin and is picked up by the parser.
+void term_query_sync(void) {
+    static const char q[] = "\033[?2026$p";
+    write_all(q, sizeof(q) - 1);
+}
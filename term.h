@@ -0,0 +1,55 @@
+#ifndef TERM_H
+#define TERM_H
+
+#include <stddef.h>
+
+// Growable byte buffer used to compose terminal output before writing it
+typedef struct {
+    char *data;     // Bytes composed so far (always NUL terminated)
+    size_t len;     // Number of bytes used
+    size_t cap;     // Allocated size
+} outbuf_t;
+
+// Per-frame rendering statistics (shown in debug stats mode)
+typedef struct {
+    unsigned long frames;   // Frames flushed so far
+    size_t last_bytes;      // Bytes written by the last frame
+    int last_lines;         // Rows rewritten by the last frame
+} screen_stats_t;
+
+void ob_init(outbuf_t *ob);
+void ob_free(outbuf_t *ob);
+void ob_reset(outbuf_t *ob);
+void ob_append(outbuf_t *ob, const char *s, size_t n);
+void ob_puts(outbuf_t *ob, const char *s);
+void ob_printf(outbuf_t *ob, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Special key codes produced by the input parser
+#define KEY_NONE  (-1)  // Nothing queued
+#define KEY_ESC   27    // A lone Escape press
+
+// Terminal size, cached until SIGWINCH says it changed
+void term_geometry_refresh(void);
+int term_rows(void);
+int term_cols(void);
+unsigned long term_geometry_ioctls(void);
+
+// Shadow-framed screen: compose rows, then flush only what changed
+void screen_begin(int rows, int cols);
+outbuf_t *screen_row(int row);
+void screen_scroll(int top, int bottom, int delta);
+void screen_invalidate(void);
+size_t screen_flush(void);
+const screen_stats_t *screen_stats(void);
+void screen_free(void);
+
+// Keyboard input: every byte read is parsed into a key queue so that
+// bursts (key repeat, paste) are handled in one go without losing keys
+int input_fill(int wait);
+int input_next(void);
+int input_eof(void);
+int read_key(void);
+void term_query_sync(void);
+
+#endif
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Drive the explorer through at least 1000 frames, resizing the terminal a
+# few times along the way, and check the size is only asked for at startup
+# and once per resize: the -D stats line must show at most 1 + resizes
+# TIOCGWINSZ calls. Needs script(1) from util-linux and GNU stty.
+set -eu
+
+bin=$(cd "$(dirname "${1:-./mexplorer}")" && pwd)/$(basename "${1:-./mexplorer}")
+dir=$(mktemp -d "${TMPDIR:-/tmp}/mexplorer-ioctls.XXXXXX")
+trap 'rm -rf "$dir"' EXIT INT TERM
+mkdir "$dir/list"
+touch "$dir/list/a" "$dir/list/b" "$dir/list/c"
+
+frames=1000
+resize_every=200
+out="$dir/typescript"
+
+# Last "[stats] frame N: ..., K size ioctls" drawn so far, as "N K"
+last_stats() {
+    grep -ao 'frame [0-9]*: [0-9]* bytes, [0-9]* rows rewritten, [0-9]* size ioctls' "$out" 2>/dev/null |
+        tail -n 1 | sed 's/frame \([0-9]*\):.*, \([0-9]*\) size ioctls/\1 \2/'
+}
+
+# Each j or k moves the cursor, so each key is a frame; every
+# $resize_every frames the pty is resized from outside (the kernel sends
+# SIGWINCH). Only the rows change: stty sets rows and cols with separate
+# calls, which would be two resizes. Keys go one at a time until the stats
+# line shows enough frames.
+{
+    while [ ! -s "$dir/tty" ]; do sleep 0.1; done
+    pty=$(cat "$dir/tty")
+    sleep 0.5
+    resizes=0 drawn=0 key=j tries=0
+    while [ "$drawn" -lt "$frames" ] && [ $tries -lt 20000 ]; do
+        printf $key
+        if [ $key = j ]; then key=k; else key=j; fi
+        tries=$((tries + 1))
+        if [ $((tries % 50)) -eq 0 ]; then
+            sleep 0.05
+            set -- $(last_stats) 0 0
+            drawn=$1
+            if [ "$drawn" -ge $(((resizes + 1) * resize_every)) ] && [ $resizes -lt $((frames / resize_every)) ]; then
+                resizes=$((resizes + 1))
+                stty -F "$pty" rows $((30 + resizes))
+                sleep 0.1
+            fi
+        fi
+    done
+    echo $resizes > "$dir/resizes"
+    sleep 0.3
+    printf q; sleep 0.5
+} | script -qefc "sh -c 'tty > \"$dir/tty\"; stty rows 30 cols 100; exec \"$bin\" -D \"$dir/list\"'" "$out" >/dev/null 2>&1 || true
+
+set -- $(last_stats) 0 0
+drawn=$1 ioctls=$2
+resizes=$(cat "$dir/resizes" 2>/dev/null || echo 0)
+if [ "$drawn" -lt "$frames" ]; then
+    echo "render_ioctls: FAIL (only $drawn frames drawn)"
+    exit 1
+fi
+if [ "$ioctls" -gt $((1 + resizes)) ]; then
+    echo "render_ioctls: FAIL ($ioctls size ioctls over $drawn frames with $resizes resizes)"
+    exit 1
+fi
+echo "render_ioctls: ok ($ioctls size ioctls over $drawn frames with $resizes resizes)"
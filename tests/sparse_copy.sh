@@ -0,0 +1,88 @@
+#!/bin/sh
+# Copy sparse files with the explorer (c, then p in another folder) and
+# check the copies keep their holes: same contents, same allocated blocks.
+# A second file is bigger than the free space but holds little data: its
+# paste must not be refused for lack of space.
+# Needs script(1) from util-linux to give the explorer a terminal.
+set -eu
+
+bin=$(cd "$(dirname "${1:-./mexplorer}")" && pwd)/$(basename "${1:-./mexplorer}")
+dir=$(mktemp -d "${TMPDIR:-/tmp}/mexplorer-sparse.XXXXXX")
+trap 'rm -rf "$dir"' EXIT INT TERM
+
+# Run the explorer in folder $1, whose listing is "out", "sparse.img":
+# copy the file, go into out, paste, and quit once the copy has as many
+# blocks as the source (or after ten seconds)
+paste_into_out() {
+    {
+        sleep 1
+        printf j; sleep 0.3
+        printf c; sleep 0.3
+        printf k; sleep 0.3
+        printf '\r'; sleep 0.5
+        printf p
+        tries=0
+        while [ "$(stat -c %s.%b "$1/out/sparse.img" 2>/dev/null)" != "$(stat -c %s.%b "$1/sparse.img")" ] &&
+              [ $tries -lt 100 ]; do
+            sleep 0.1
+            tries=$((tries + 1))
+        done
+        sleep 0.5
+        printf q; sleep 0.5
+    } | script -qec "$bin '$1'" /dev/null >/dev/null 2>&1 || true
+}
+
+# 64 MiB with four 1 MiB extents of data, the first one after a hole
+mkdir "$dir/small" "$dir/small/out"
+truncate -s 64M "$dir/small/sparse.img"
+for mb in 3 10 33 63; do
+    dd if=/dev/urandom of="$dir/small/sparse.img" bs=1M count=1 seek=$mb conv=notrunc status=none
+done
+
+# Skip where holes aren't kept or SEEK_DATA isn't supported (the copy
+# would rightly come out dense there)
+if [ "$(stat -c %b "$dir/small/sparse.img")" -ge $((64 * 2048)) ]; then
+    echo "sparse_copy: SKIP (no holes on this filesystem)"
+    exit 0
+fi
+if command -v python3 >/dev/null 2>&1 &&
+   ! python3 -c 'import os, sys; fd = os.open(sys.argv[1], os.O_RDONLY); sys.exit(os.lseek(fd, 0, os.SEEK_DATA) == 0)' "$dir/small/sparse.img" 2>/dev/null; then
+    echo "sparse_copy: SKIP (no SEEK_DATA on this filesystem)"
+    exit 0
+fi
+
+paste_into_out "$dir/small"
+if ! cmp "$dir/small/sparse.img" "$dir/small/out/sparse.img"; then
+    echo "sparse_copy: FAIL (copy missing or different)"
+    exit 1
+fi
+src_blocks=$(stat -c %b "$dir/small/sparse.img")
+dst_blocks=$(stat -c %b "$dir/small/out/sparse.img")
+if [ "$src_blocks" -ne "$dst_blocks" ]; then
+    echo "sparse_copy: FAIL (source has $src_blocks blocks, copy $dst_blocks)"
+    exit 1
+fi
+echo "sparse_copy: ok ($dst_blocks blocks of $((64 * 2048)))"
+
+# 1 GiB more than is free, with 1 MiB of data at the start. Comparing it
+# whole would read all the zeros, so the size, blocks and data are checked.
+mkdir "$dir/big" "$dir/big/out"
+free=$(df -P -k "$dir" | awk 'NR == 2 { print $4 }')
+size=$(( (free + 1048576) * 1024 ))
+if ! truncate -s "$size" "$dir/big/sparse.img" 2>/dev/null; then
+    echo "sparse_copy: SKIP (can't make a file bigger than the free space)"
+    exit 0
+fi
+dd if=/dev/urandom of="$dir/big/sparse.img" bs=1M count=1 conv=notrunc status=none
+
+paste_into_out "$dir/big"
+if [ ! -e "$dir/big/out/sparse.img" ]; then
+    echo "sparse_copy: FAIL (paste bigger than the free space was refused)"
+    exit 1
+fi
+if [ "$(stat -c %s.%b "$dir/big/out/sparse.img")" != "$(stat -c %s.%b "$dir/big/sparse.img")" ] ||
+   ! cmp -n 1048576 "$dir/big/sparse.img" "$dir/big/out/sparse.img"; then
+    echo "sparse_copy: FAIL (copy of the big sparse file differs)"
+    exit 1
+fi
+echo "sparse_copy: ok ($((size >> 30)) GiB apparent with $((free >> 20)) GiB free)"
@@ -0,0 +1,955 @@
+#define _GNU_SOURCE  // O_DIRECTORY, O_NOFOLLOW, madvise()
+
+#include "treeindex.h"
+#include "walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+// ---- File format ----
+//
+// header | folder table (sorted by path) | one array per column |
+// trigram table | posting lists | names
+//
+// Every section starts on an 8-byte boundary. Strings are NUL-terminated
+// and referred to by their offset in the names. Numbers are stored in the
+// byte order of the machine that built the index; an index from another
+// one is refused.
+//
+// Entries are numbered in file order (folder by folder). For every three
+// bytes that occur in some entry's name, the trigram table holds where the
+// list of those entries starts in the posting lists and how long it is.
+// A list is the ascending entry numbers as varints (7 bits per byte, low
+// bits first), the first one as is and the others as the gap to the one
+// before, so most take a byte or two.
+
+#define TINDEX_MAGIC "MXTIDX\0\0"
+#define TINDEX_VERSION 2
+#define TINDEX_BYTE_ORDER 0x01020304u
+
+enum {
+    COL_NAME,           // uint64_t: offset of the name
+    COL_SIZE,           // int64_t
+    COL_MTIME,          // int64_t seconds...
+    COL_INO,            // uint64_t
+    COL_DEV,            // uint64_t
+    COL_BLOCKS,         // int64_t
+    COL_MODE,           // uint32_t (0: couldn't stat)
+    COL_UID,            // uint32_t
+    COL_GID,            // uint32_t
+    COL_NLINK,          // uint32_t
+    COL_MTIME_NSEC,     // uint32_t ...and nanoseconds
+    COLUMNS
+};
+
+static const unsigned char col_width[COLUMNS] = { 8, 8, 8, 8, 8, 8, 4, 4, 4, 4, 4 };
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    int64_t built;              // time() of the build
+    uint64_t root;              // Offset of the root path in the names
+    uint64_t ndirs, nentries;
+    uint64_t dirs;              // Offsets of the sections
+    uint64_t columns[COLUMNS];
+    uint64_t trigrams, ntrigrams;
+    uint64_t postings, postings_size;
+    uint64_t names, names_size;
+} disk_header_t;
+
+typedef struct {
+    uint64_t path;
+    uint64_t dev, ino;
+    int64_t mtime;
+    uint32_t mtime_nsec;
+    uint32_t unused;
+    uint64_t first, count;
+} disk_dir_t;
+
+typedef struct {
+    uint32_t trigram;           // The three bytes, first one highest
+    uint32_t count;             // Entries in the list
+    uint64_t offset;            // In the posting lists
+} disk_trigram_t;
+
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+// The distinct trigrams of a name (or of search text), sorted. 'out'
+// needs room for len - 2 of them.
+static size_t name_trigrams(const char *name, size_t len, uint32_t *out) {
+    size_t n = 0;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const unsigned char *p = (const unsigned char *)name + i;
+        uint32_t t = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        // Insertion sort: names are short
+        size_t j = n;
+        while (j > 0 && out[j - 1] > t) j--;
+        if (j > 0 && out[j - 1] == t) continue;
+        memmove(out + j + 1, out + j, (n - j) * sizeof(*out));
+        out[j] = t;
+        n++;
+    }
+    return n;
+}
+
+static size_t varint_len(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// ---- Building ----
+
+// One entry while the tree is walked
+typedef struct {
+    uint64_t name;              // Offset in the folder's names
+    uint64_t ino, dev;
+    int64_t size, mtime, blocks;
+    uint32_t mode, uid, gid, nlink, mtime_nsec;
+} node_entry_t;
+
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    node_entry_t *ents;
+    size_t used, cap;
+    char *names;                // The entries' names back to back
+    size_t names_used, names_cap;
+} node_t;
+
+typedef struct {
+    node_t *arr;
+    size_t used, cap;
+} node_list_t;
+
+typedef struct {
+    pthread_mutex_t lock;       // Guards what the workers hand over
+    walk_t *walk;
+    dev_t root_dev;
+    const tindex_t *old;        // The index being replaced, if it could be read
+    node_list_t nodes;          // Every folder read, once the workers are done
+    unsigned long errors, reused;
+} builder_t;
+
+// What one worker has read so far
+typedef struct {
+    node_list_t done;
+    unsigned long errors, reused;
+} build_worker_t;
+
+static void *grow(void *arr, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) return arr;
+    size_t cap2 = *cap ? *cap : 16;
+    while (cap2 < need) cap2 *= 2;
+    arr = realloc(arr, cap2 * size);
+    if (!arr) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    *cap = cap2;
+    return arr;
+}
+
+static void entry_from_stat(const struct stat *st, node_entry_t *e) {
+    e->ino = st->st_ino;
+    e->dev = st->st_dev;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim.tv_sec;
+    e->mtime_nsec = (uint32_t)st->st_mtim.tv_nsec;
+    e->blocks = st->st_blocks;
+    e->mode = st->st_mode;
+    e->uid = st->st_uid;
+    e->gid = st->st_gid;
+    e->nlink = (uint32_t)st->st_nlink;
+}
+
+// Add an entry to the node, and queue it if it is a subfolder on this
+// filesystem
+static void add_entry(builder_t *b, node_t *node, const char *name, node_entry_t *e) {
+    size_t len = strlen(name) + 1;
+    node->names = grow(node->names, &node->names_cap, node->names_used + len, 1);
+    memcpy(node->names + node->names_used, name, len);
+    e->name = node->names_used;
+    node->names_used += len;
+    node->ents = grow(node->ents, &node->cap, node->used + 1, sizeof(node_entry_t));
+    node->ents[node->used++] = *e;
+
+    if (S_ISDIR(e->mode) && (dev_t)e->dev == b->root_dev) {
+        const char *sep = node->path[strlen(node->path) - 1] == '/' ? "" : "/";
+        char child[PATH_MAX];
+        if ((size_t)snprintf(child, sizeof(child), "%s%s%s", node->path, sep, name) < sizeof(child)) {
+            walk_push(b->walk, 0, child, NULL, 0);
+        }
+    }
+}
+
+static void start_node(node_t *node, const char *path, const struct stat *dst) {
+    memset(node, 0, sizeof(*node));
+    node->path = xstrdup(path);
+    node->dev = dst->st_dev;
+    node->ino = dst->st_ino;
+    node->mtime = dst->st_mtim;
+}
+
+// A folder whose mtime is the same as in the old index has the same
+// entries, so take them from there instead of reading it again. Returns 0
+// if the folder has to be read.
+static int reuse_folder(builder_t *b, const char *path, node_t *node) {
+    tindex_dir_t od;
+    struct stat dst;
+    if (!b->old || lstat(path, &dst) != 0 || !tindex_find(b->old, path, &od) ||
+        !tindex_dir_current(&od, &dst)) {
+        return 0;
+    }
+    start_node(node, path, &dst);
+    for (size_t i = od.first; i < od.first + od.count; i++) {
+        struct stat st;
+        node_entry_t e = {0};
+        tindex_stat(b->old, i, &st);
+        entry_from_stat(&st, &e);
+        add_entry(b, node, tindex_name(b->old, i), &e);
+    }
+    return 1;
+}
+
+// Read one folder into a node: every entry with its stat, and its
+// subfolders on this filesystem onto the stack
+static int read_folder(builder_t *b, const char *path, node_t *node) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (fd < 0) return -1;
+    struct stat dst;
+    DIR *dir = fstat(fd, &dst) == 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        close(fd);
+        return -1;
+    }
+
+    start_node(node, path, &dst);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        // Entries that can't be stat()ed are kept (the listing shows them
+        // too), with a mode of 0
+        struct stat st;
+        node_entry_t e = {0};
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            entry_from_stat(&st, &e);
+        }
+        add_entry(b, node, name, &e);
+    }
+    closedir(dir);
+    return 0;
+}
+
+static void *build_worker_init(void *ctx) {
+    (void)ctx;
+    build_worker_t *bw = calloc(1, sizeof(*bw));
+    if (!bw) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    return bw;
+}
+
+static void build_visit(void *ctx, void *state, const walk_item_t *item) {
+    builder_t *b = ctx;
+    build_worker_t *bw = state;
+    node_t node;
+    if (reuse_folder(b, item->path, &node)) {
+        bw->reused++;
+    } else if (read_folder(b, item->path, &node) != 0) {
+        bw->errors++;
+        return;
+    }
+    bw->done.arr = grow(bw->done.arr, &bw->done.cap, bw->done.used + 1, sizeof(node_t));
+    bw->done.arr[bw->done.used++] = node;
+}
+
+// Hand over the nodes read
+static void build_worker_done(void *ctx, void *state) {
+    builder_t *b = ctx;
+    build_worker_t *bw = state;
+    pthread_mutex_lock(&b->lock);
+    b->nodes.arr = grow(b->nodes.arr, &b->nodes.cap, b->nodes.used + bw->done.used, sizeof(node_t));
+    memcpy(b->nodes.arr + b->nodes.used, bw->done.arr, bw->done.used * sizeof(node_t));
+    b->nodes.used += bw->done.used;
+    b->errors += bw->errors;
+    b->reused += bw->reused;
+    pthread_mutex_unlock(&b->lock);
+    free(bw->done.arr);
+    free(bw);
+}
+
+static const walk_ops_t build_ops = {
+    .worker_init = build_worker_init,
+    .visit = build_visit,
+    .worker_done = build_worker_done,
+};
+
+static int cmp_node_path(const void *a, const void *b) {
+    return strcmp(((const node_t *)a)->path, ((const node_t *)b)->path);
+}
+
+// ---- Trigram posting lists ----
+
+#define TRIGRAM_SPACE (1u << 24)
+
+typedef struct {
+    disk_trigram_t *table;      // Trigrams that occur, ascending
+    size_t ntable;
+    unsigned char *lists;
+    uint64_t size;
+} postings_t;
+
+// Call fn(arg, entry number, trigrams) for every entry, in file order
+static void each_name(const node_list_t *nodes,
+                      void (*fn)(void *arg, uint32_t id, const uint32_t *tri, size_t n), void *arg) {
+    uint32_t tri[NAME_MAX];
+    uint32_t id = 0;
+    for (size_t i = 0; i < nodes->used; i++) {
+        const node_t *node = &nodes->arr[i];
+        for (size_t j = 0; j < node->used; j++, id++) {
+            const char *name = node->names + node->ents[j].name;
+            size_t len = strnlen(name, NAME_MAX);
+            fn(arg, id, tri, name_trigrams(name, len, tri));
+        }
+    }
+}
+
+// Per-trigram state while the lists are sized and then filled in. The
+// arrays span every possible trigram but only the pages of trigrams that
+// occur are ever touched.
+typedef struct {
+    uint32_t *count;
+    uint32_t *last;             // Entry number + 1 of the list's last entry (0: none yet)
+    uint64_t *pos;              // Bytes the list takes, then where it is written next
+    unsigned char *lists;
+} trigram_pass_t;
+
+static void size_lists(void *arg, uint32_t id, const uint32_t *tri, size_t n) {
+    trigram_pass_t *tp = arg;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t t = tri[i];
+        tp->pos[t] += varint_len(tp->last[t] ? id - (tp->last[t] - 1) : id);
+        tp->count[t]++;
+        tp->last[t] = id + 1;
+    }
+}
+
+static void fill_lists(void *arg, uint32_t id, const uint32_t *tri, size_t n) {
+    trigram_pass_t *tp = arg;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t t = tri[i];
+        uint64_t v = tp->last[t] ? id - (tp->last[t] - 1) : id;
+        unsigned char *p = tp->lists + tp->pos[t];
+        while (v >= 0x80) {
+            *p++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (unsigned char)v;
+        tp->pos[t] = (uint64_t)(p - tp->lists);
+        tp->last[t] = id + 1;
+    }
+}
+
+// Two passes over the names: the first sizes every list, the second
+// writes the lists into one buffer, each at its final place
+static void build_postings(const node_list_t *nodes, postings_t *out) {
+    trigram_pass_t tp;
+    tp.count = calloc(TRIGRAM_SPACE, sizeof(uint32_t));
+    tp.last = calloc(TRIGRAM_SPACE, sizeof(uint32_t));
+    tp.pos = calloc(TRIGRAM_SPACE, sizeof(uint64_t));
+    if (!tp.count || !tp.last || !tp.pos) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    each_name(nodes, size_lists, &tp);
+
+    size_t cap = 0;
+    out->table = NULL;
+    out->ntable = 0;
+    out->size = 0;
+    for (uint32_t t = 0; t < TRIGRAM_SPACE; t++) {
+        if (!tp.count[t]) continue;
+        out->table = grow(out->table, &cap, out->ntable + 1, sizeof(disk_trigram_t));
+        out->table[out->ntable++] = (disk_trigram_t){ t, tp.count[t], out->size };
+        out->size += tp.pos[t];
+        tp.pos[t] = out->size - tp.pos[t];
+        tp.last[t] = 0;
+    }
+
+    out->lists = malloc(out->size ? out->size : 1);
+    if (!out->lists) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    tp.lists = out->lists;
+    each_name(nodes, fill_lists, &tp);
+    free(tp.count);
+    free(tp.last);
+    free(tp.pos);
+}
+
+// Buffered writer that remembers the first error
+typedef struct {
+    int fd;
+    int error;
+    size_t used;
+    char buf[1 << 20];
+} writer_t;
+
+static void w_flush(writer_t *w) {
+    size_t off = 0;
+    while (off < w->used && !w->error) {
+        ssize_t n = write(w->fd, w->buf + off, w->used - off);
+        if (n < 0) {
+            if (errno != EINTR) w->error = errno;
+            continue;
+        }
+        off += (size_t)n;
+    }
+    w->used = 0;
+}
+
+static void w_put(writer_t *w, const void *data, size_t n) {
+    const char *p = data;
+    while (n > 0) {
+        if (w->used == sizeof(w->buf)) w_flush(w);
+        size_t chunk = sizeof(w->buf) - w->used;
+        if (chunk > n) chunk = n;
+        memcpy(w->buf + w->used, p, chunk);
+        w->used += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+static void w_pad8(writer_t *w, uint64_t written) {
+    static const char zeros[8];
+    w_put(w, zeros, align8(written) - written);
+}
+
+// One column of every entry, folder by folder
+static void write_column(writer_t *w, const node_list_t *nodes, int col, uint64_t name_base) {
+    uint64_t written = 0;
+    for (size_t i = 0; i < nodes->used; i++) {
+        const node_t *n = &nodes->arr[i];
+        for (size_t j = 0; j < n->used; j++) {
+            const node_entry_t *e = &n->ents[j];
+            uint64_t v64 = 0;
+            uint32_t v32 = 0;
+            switch (col) {
+                case COL_NAME:       v64 = name_base + e->name; break;
+                case COL_SIZE:       v64 = (uint64_t)e->size; break;
+                case COL_MTIME:      v64 = (uint64_t)e->mtime; break;
+                case COL_INO:        v64 = e->ino; break;
+                case COL_DEV:        v64 = e->dev; break;
+                case COL_BLOCKS:     v64 = (uint64_t)e->blocks; break;
+                case COL_MODE:       v32 = e->mode; break;
+                case COL_UID:        v32 = e->uid; break;
+                case COL_GID:        v32 = e->gid; break;
+                case COL_NLINK:      v32 = e->nlink; break;
+                case COL_MTIME_NSEC: v32 = e->mtime_nsec; break;
+            }
+            if (col_width[col] == 8) {
+                w_put(w, &v64, 8);
+            } else {
+                w_put(w, &v32, 4);
+            }
+            written += col_width[col];
+        }
+        name_base += n->names_used;
+    }
+    w_pad8(w, written);
+}
+
+// Lay the sorted nodes out as described above
+static int write_index(int fd, const char *root, const node_list_t *nodes) {
+    disk_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TINDEX_MAGIC, sizeof(h.magic));
+    h.version = TINDEX_VERSION;
+    h.byte_order = TINDEX_BYTE_ORDER;
+    h.built = (int64_t)time(NULL);
+    h.ndirs = nodes->used;
+    for (size_t i = 0; i < nodes->used; i++) h.nentries += nodes->arr[i].used;
+
+    // Names: the root, every folder path, then every entry name
+    uint64_t names_size = strlen(root) + 1;
+    for (size_t i = 0; i < nodes->used; i++) names_size += strlen(nodes->arr[i].path) + 1;
+    uint64_t entry_names = names_size;
+    for (size_t i = 0; i < nodes->used; i++) names_size += nodes->arr[i].names_used;
+
+    uint64_t off = align8(sizeof(h));
+    h.dirs = off;
+    off += h.ndirs * sizeof(disk_dir_t);
+    for (int c = 0; c < COLUMNS; c++) {
+        h.columns[c] = off;
+        off = align8(off + h.nentries * col_width[c]);
+    }
+    postings_t post;
+    build_postings(nodes, &post);
+    h.trigrams = off;
+    h.ntrigrams = post.ntable;
+    off += post.ntable * sizeof(disk_trigram_t);
+    h.postings = off;
+    h.postings_size = post.size;
+    off = align8(off + post.size);
+    h.names = off;
+    h.names_size = names_size;
+    h.file_size = align8(off + names_size);
+
+    writer_t *w = malloc(sizeof(*w));
+    if (!w) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    w->fd = fd;
+    w->error = 0;
+    w->used = 0;
+    w_put(w, &h, sizeof(h));
+    w_pad8(w, sizeof(h));
+
+    uint64_t path_off = strlen(root) + 1, first = 0;
+    for (size_t i = 0; i < nodes->used; i++) {
+        const node_t *n = &nodes->arr[i];
+        disk_dir_t d = {
+            .path = path_off, .dev = n->dev, .ino = n->ino,
+            .mtime = n->mtime.tv_sec, .mtime_nsec = (uint32_t)n->mtime.tv_nsec,
+            .first = first, .count = n->used,
+        };
+        w_put(w, &d, sizeof(d));
+        path_off += strlen(n->path) + 1;
+        first += n->used;
+    }
+    for (int c = 0; c < COLUMNS; c++) {
+        write_column(w, nodes, c, entry_names);
+    }
+    w_put(w, post.table, post.ntable * sizeof(disk_trigram_t));
+    w_put(w, post.lists, post.size);
+    w_pad8(w, post.size);
+    free(post.table);
+    free(post.lists);
+
+    w_put(w, root, strlen(root) + 1);
+    for (size_t i = 0; i < nodes->used; i++) {
+        w_put(w, nodes->arr[i].path, strlen(nodes->arr[i].path) + 1);
+    }
+    for (size_t i = 0; i < nodes->used; i++) {
+        w_put(w, nodes->arr[i].names, nodes->arr[i].names_used);
+    }
+    w_pad8(w, names_size);
+    w_flush(w);
+
+    int error = w->error;
+    free(w);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int tindex_build(const char *root, const char *file, tindex_stats_t *stats,
+                 char *err, size_t errsz) {
+    char *real = realpath(root, NULL);
+    struct stat st;
+    if (!real || stat(real, &st) != 0) {
+        snprintf(err, errsz, "%s: %s", root, strerror(errno));
+        free(real);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        snprintf(err, errsz, "%s: not a folder", root);
+        free(real);
+        return -1;
+    }
+
+    builder_t b;
+    memset(&b, 0, sizeof(b));
+    pthread_mutex_init(&b.lock, NULL);
+    b.root_dev = st.st_dev;
+    b.old = tindex_open(file, err, errsz);  // A full walk if there is none
+    b.walk = walk_create(walk_threads(), &build_ops, &b);
+    walk_push(b.walk, 0, real, NULL, 0);
+    walk_run(b.walk);
+    walk_free(b.walk);
+    pthread_mutex_destroy(&b.lock);
+
+    qsort(b.nodes.arr, b.nodes.used, sizeof(node_t), cmp_node_path);
+
+    // Write next to the old index and swap it in
+    int rc = -1;
+    size_t tmplen = strlen(file) + 16;
+    char *tmp = malloc(tmplen);
+    if (!tmp) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(tmp, tmplen, "%s.tmpXXXXXX", file);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        snprintf(err, errsz, "%s: %s", file, strerror(errno));
+    } else if (write_index(fd, real, &b.nodes) != 0 || fsync(fd) != 0) {
+        snprintf(err, errsz, "%s: %s", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+    } else if (close(fd) != 0 || rename(tmp, file) != 0) {
+        snprintf(err, errsz, "%s: %s", file, strerror(errno));
+        unlink(tmp);
+    } else {
+        rc = 0;
+    }
+    free(tmp);
+
+    if (stats) {
+        stats->dirs = b.nodes.used;
+        stats->entries = 0;
+        for (size_t i = 0; i < b.nodes.used; i++) stats->entries += b.nodes.arr[i].used;
+        stats->errors = b.errors;
+        stats->reused = b.reused;
+    }
+    tindex_close((tindex_t *)b.old);
+    for (size_t i = 0; i < b.nodes.used; i++) {
+        free(b.nodes.arr[i].path);
+        free(b.nodes.arr[i].ents);
+        free(b.nodes.arr[i].names);
+    }
+    free(b.nodes.arr);
+    free(real);
+    return rc;
+}
+
+// ---- Reading ----
+
+struct tindex {
+    const unsigned char *map;
+    size_t size;
+    const disk_header_t *h;
+    const disk_dir_t *dirs;
+    const void *col[COLUMNS];
+    const disk_trigram_t *trigrams;
+    const unsigned char *postings;
+    const char *names;
+};
+
+// Does [off, off + count * width) fit in the file?
+static int fits(uint64_t off, uint64_t count, uint64_t width, uint64_t size) {
+    return off <= size && off % 8 == 0 && count <= (size - off) / width;
+}
+
+tindex_t *tindex_open(const char *file, char *err, size_t errsz) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        snprintf(err, errsz, "%s: %s", file, strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(disk_header_t)) {
+        snprintf(err, errsz, "%s: not an index", file);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(err, errsz, "%s: %s", file, strerror(errno));
+        return NULL;
+    }
+    // Lookups jump around the file; don't read ahead around each one
+    madvise(map, (size_t)st.st_size, MADV_RANDOM);
+
+    tindex_t *idx = calloc(1, sizeof(*idx));
+    if (!idx) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    idx->map = map;
+    idx->size = (size_t)st.st_size;
+    idx->h = map;
+
+    // Check the header once so lookups can trust the section bounds
+    const disk_header_t *h = idx->h;
+    uint64_t size = idx->size;
+    int ok = memcmp(h->magic, TINDEX_MAGIC, sizeof(h->magic)) == 0 &&
+             h->version == TINDEX_VERSION && h->byte_order == TINDEX_BYTE_ORDER &&
+             h->file_size == size &&
+             fits(h->dirs, h->ndirs, sizeof(disk_dir_t), size) &&
+             fits(h->trigrams, h->ntrigrams, sizeof(disk_trigram_t), size) &&
+             fits(h->postings, h->postings_size, 1, size) &&
+             fits(h->names, h->names_size, 1, size) && h->names_size > 0 &&
+             idx->map[h->names + h->names_size - 1] == '\0' && h->root < h->names_size;
+    for (int c = 0; ok && c < COLUMNS; c++) {
+        ok = fits(h->columns[c], h->nentries, col_width[c], size);
+    }
+    if (!ok) {
+        snprintf(err, errsz, "%s: not an index, or from another version", file);
+        tindex_close(idx);
+        return NULL;
+    }
+    idx->dirs = (const disk_dir_t *)(idx->map + h->dirs);
+    for (int c = 0; c < COLUMNS; c++) idx->col[c] = idx->map + h->columns[c];
+    idx->trigrams = (const disk_trigram_t *)(idx->map + h->trigrams);
+    idx->postings = idx->map + h->postings;
+    idx->names = (const char *)idx->map + h->names;
+    return idx;
+}
+
+void tindex_close(tindex_t *idx) {
+    if (!idx) return;
+    munmap((void *)idx->map, idx->size);
+    free(idx);
+}
+
+static const char *name_at(const tindex_t *idx, uint64_t off) {
+    return off < idx->h->names_size ? idx->names + off : "";
+}
+
+const char *tindex_root(const tindex_t *idx) {
+    return name_at(idx, idx->h->root);
+}
+
+time_t tindex_built(const tindex_t *idx) {
+    return (time_t)idx->h->built;
+}
+
+size_t tindex_dir_count(const tindex_t *idx) {
+    return idx->h->ndirs;
+}
+
+size_t tindex_entry_count(const tindex_t *idx) {
+    return idx->h->nentries;
+}
+
+void tindex_get_dir(const tindex_t *idx, size_t i, tindex_dir_t *out) {
+    const disk_dir_t *d = &idx->dirs[i];
+    out->path = name_at(idx, d->path);
+    out->dev = (dev_t)d->dev;
+    out->ino = (ino_t)d->ino;
+    out->mtime.tv_sec = (time_t)d->mtime;
+    out->mtime.tv_nsec = d->mtime_nsec;
+    // A damaged table can't point past the columns
+    int ok = d->first <= idx->h->nentries && d->count <= idx->h->nentries - d->first;
+    out->first = ok ? d->first : 0;
+    out->count = ok ? d->count : 0;
+}
+
+int tindex_find(const tindex_t *idx, const char *path, tindex_dir_t *out) {
+    // The paths are stored as realpath() writes them
+    char key[PATH_MAX];
+    size_t len = 0;
+    for (const char *p = path; *p && len < sizeof(key) - 1; p++) {
+        if (*p == '/' && len > 0 && key[len - 1] == '/') continue;
+        key[len++] = *p;
+    }
+    if (len > 1 && key[len - 1] == '/') len--;
+    key[len] = '\0';
+
+    size_t lo = 0, hi = idx->h->ndirs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(name_at(idx, idx->dirs[mid].path), key);
+        if (c == 0) {
+            tindex_get_dir(idx, mid, out);
+            return 1;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+int tindex_dir_current(const tindex_dir_t *dir, const struct stat *live) {
+    return live->st_dev == dir->dev && live->st_ino == dir->ino &&
+           live->st_mtim.tv_sec == dir->mtime.tv_sec &&
+           live->st_mtim.tv_nsec == dir->mtime.tv_nsec;
+}
+
+const char *tindex_name(const tindex_t *idx, size_t entry) {
+    return name_at(idx, ((const uint64_t *)idx->col[COL_NAME])[entry]);
+}
+
+void tindex_stat(const tindex_t *idx, size_t entry, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_size = (off_t)((const int64_t *)idx->col[COL_SIZE])[entry];
+    st->st_mtim.tv_sec = (time_t)((const int64_t *)idx->col[COL_MTIME])[entry];
+    st->st_mtim.tv_nsec = ((const uint32_t *)idx->col[COL_MTIME_NSEC])[entry];
+    st->st_ino = (ino_t)((const uint64_t *)idx->col[COL_INO])[entry];
+    st->st_dev = (dev_t)((const uint64_t *)idx->col[COL_DEV])[entry];
+    st->st_blocks = (blkcnt_t)((const int64_t *)idx->col[COL_BLOCKS])[entry];
+    st->st_mode = ((const uint32_t *)idx->col[COL_MODE])[entry];
+    st->st_uid = ((const uint32_t *)idx->col[COL_UID])[entry];
+    st->st_gid = ((const uint32_t *)idx->col[COL_GID])[entry];
+    st->st_nlink = ((const uint32_t *)idx->col[COL_NLINK])[entry];
+}
+
+int tindex_entry_path(const tindex_t *idx, size_t entry, char *buf, size_t bufsz) {
+    // The folders' entry ranges follow each other in table order: find
+    // the last folder starting at or before the entry
+    size_t lo = 0, hi = idx->h->ndirs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->dirs[mid].first <= entry) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return -1;
+    tindex_dir_t dir;
+    tindex_get_dir(idx, lo - 1, &dir);
+    if (entry < dir.first || entry - dir.first >= dir.count) return -1;
+
+    const char *sep = dir.path[0] && dir.path[strlen(dir.path) - 1] == '/' ? "" : "/";
+    int n = snprintf(buf, bufsz, "%s%s%s", dir.path, sep, tindex_name(idx, entry));
+    return n >= 0 && (size_t)n < bufsz ? 0 : -1;
+}
+
+// A posting list being read
+typedef struct {
+    const unsigned char *p, *end;
+    uint32_t left;
+    uint64_t id;
+    int started;
+} list_cursor_t;
+
+static int list_open(const tindex_t *idx, const disk_trigram_t *t, list_cursor_t *c) {
+    if (t->offset > idx->h->postings_size) return -1;
+    c->p = idx->postings + t->offset;
+    c->end = idx->postings + idx->h->postings_size;
+    c->left = t->count;
+    c->id = 0;
+    c->started = 0;
+    return 0;
+}
+
+// Next entry number in the list; 0 at its end (or where it is damaged)
+static int list_next(list_cursor_t *c, uint64_t *id) {
+    if (c->left == 0) return 0;
+    uint64_t v = 0;
+    int shift = 0;
+    for (;;) {
+        if (c->p == c->end || shift > 63) return 0;
+        unsigned char b = *c->p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+    c->id = c->started ? c->id + v : v;
+    c->started = 1;
+    c->left--;
+    *id = c->id;
+    return 1;
+}
+
+static const disk_trigram_t *find_trigram(const tindex_t *idx, uint32_t t) {
+    size_t lo = 0, hi = idx->h->ntrigrams;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->trigrams[mid].trigram == t) return &idx->trigrams[mid];
+        if (idx->trigrams[mid].trigram < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_list_len(const void *a, const void *b) {
+    uint32_t x = (*(const disk_trigram_t *const *)a)->count;
+    uint32_t y = (*(const disk_trigram_t *const *)b)->count;
+    return x < y ? -1 : x > y;
+}
+
+static void add_id(size_t **arr, size_t *used, size_t *cap, size_t id) {
+    *arr = grow(*arr, cap, *used + 1, sizeof(size_t));
+    (*arr)[(*used)++] = id;
+}
+
+size_t *tindex_search(const tindex_t *idx, const char *text, size_t *count) {
+    size_t len = strlen(text), used = 0, cap = 0;
+    size_t *ids = NULL;
+    *count = 0;
+    if (len > NAME_MAX) return NULL;
+
+    // Too short for a trigram: every name is a candidate
+    if (len < 3) {
+        for (size_t i = 0; i < idx->h->nentries; i++) {
+            if (strstr(tindex_name(idx, i), text)) add_id(&ids, &used, &cap, i);
+        }
+        *count = used;
+        return ids;
+    }
+
+    // Every trigram of the text must be in a matching name. Start from the
+    // shortest list and keep only what each longer list also holds.
+    uint32_t tri[NAME_MAX];
+    const disk_trigram_t *lists[NAME_MAX];
+    size_t n = name_trigrams(text, len, tri);
+    for (size_t i = 0; i < n; i++) {
+        if (!(lists[i] = find_trigram(idx, tri[i]))) return NULL;
+    }
+    qsort(lists, n, sizeof(lists[0]), cmp_list_len);
+
+    list_cursor_t c;
+    uint64_t id;
+    if (list_open(idx, lists[0], &c) != 0) return NULL;
+    while (list_next(&c, &id)) {
+        if (id < idx->h->nentries) add_id(&ids, &used, &cap, (size_t)id);
+    }
+    for (size_t i = 1; i < n && used > 0; i++) {
+        if (list_open(idx, lists[i], &c) != 0) {
+            used = 0;
+            break;
+        }
+        size_t kept = 0, j = 0;
+        int more = list_next(&c, &id);
+        while (more && j < used) {
+            if (id < ids[j]) {
+                more = list_next(&c, &id);
+            } else {
+                if (id == ids[j]) ids[kept++] = ids[j];
+                j++;
+            }
+        }
+        used = kept;
+    }
+
+    // Sharing the trigrams doesn't mean holding the text: check the names
+    size_t kept = 0;
+    for (size_t i = 0; i < used; i++) {
+        if (strstr(tindex_name(idx, ids[i]), text)) ids[kept++] = ids[i];
+    }
+    *count = kept;
+    if (kept == 0) {
+        free(ids);
+        return NULL;
+    }
+    return ids;
+}
@@ -0,0 +1,76 @@
+#ifndef TREEINDEX_H
+#define TREEINDEX_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// A saved snapshot of a tree's metadata: for every folder its identity and
+// mtime, and for every entry in it the name and the stat fields the
+// listing shows. The file is laid out as columns (all sizes together, all
+// mtimes together, ...) plus a folder table sorted by path and trigram
+// posting lists of the names, so it is used straight from mmap() without
+// reading or parsing it first.
+typedef struct tindex tindex_t;
+
+// One folder as it was when the index was built
+typedef struct {
+    const char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;      // Changes when entries are added, removed or renamed
+    size_t first, count;        // Its entries: first .. first + count - 1
+} tindex_dir_t;
+
+typedef struct {
+    unsigned long dirs;         // Folders indexed
+    unsigned long entries;      // Entries in them
+    unsigned long errors;       // Folders that couldn't be read (left out)
+    unsigned long reused;       // Folders taken unchanged from the previous index
+} tindex_stats_t;
+
+// Walk the tree below 'root' with several worker threads, staying on its
+// filesystem, and write the index to 'file' (through a temporary file that
+// replaces it at the end, so a running explorer keeps its old copy).
+// Hidden entries are always indexed. If 'file' already holds an index,
+// folders whose mtime hasn't changed since are taken from it instead of
+// being read again (entries of a folder that changed are stat()ed afresh).
+// Returns -1 with a message in 'err'.
+int tindex_build(const char *root, const char *file, tindex_stats_t *stats,
+                 char *err, size_t errsz);
+
+// Map an index. Returns NULL with a message in 'err' if it can't be read
+// or isn't an index.
+tindex_t *tindex_open(const char *file, char *err, size_t errsz);
+void tindex_close(tindex_t *idx);
+const char *tindex_root(const tindex_t *idx);
+time_t tindex_built(const tindex_t *idx);
+size_t tindex_dir_count(const tindex_t *idx);
+size_t tindex_entry_count(const tindex_t *idx);
+
+// Look a folder up by its absolute path (repeated and trailing slashes are
+// ignored). Returns 1 and fills 'out' if it is in the index.
+int tindex_find(const tindex_t *idx, const char *path, tindex_dir_t *out);
+void tindex_get_dir(const tindex_t *idx, size_t i, tindex_dir_t *out);
+
+// Is the folder still as indexed? 'live' is a fresh stat() of it.
+int tindex_dir_current(const tindex_dir_t *dir, const struct stat *live);
+
+// An entry's name, and its stat fields as indexed (mode, size, times,
+// owner, links, inode, device and blocks; the rest is zero). st_mode is 0
+// for entries that couldn't be stat()ed.
+const char *tindex_name(const tindex_t *idx, size_t entry);
+void tindex_stat(const tindex_t *idx, size_t entry, struct stat *st);
+
+// Full path of an entry. Returns -1 if it doesn't fit in 'buf'.
+int tindex_entry_path(const tindex_t *idx, size_t entry, char *buf, size_t bufsz);
+
+// Entries whose name contains 'text' (case matters), in index order, or
+// NULL if there are none. Only names holding every trigram of the text
+// are compared, found by intersecting their posting lists, so a search
+// over tens of millions of names reads a few lists instead of all of
+// them. Text shorter than three bytes compares every name. Free the
+// array with free().
+size_t *tindex_search(const tindex_t *idx, const char *text, size_t *count);
+
+#endif
@@ -0,0 +1,470 @@
+#define _GNU_SOURCE  // memrchr(), mremap()
+
+#include "viewer.h"
+#include "memscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Lines between two marks of the line index
+#define LINE_STEP 1024
+
+// Bytes indexed or searched per step. Pages behind a step are released
+// from the mapping (they stay in the page cache), so walking through a
+// huge file doesn't grow our memory.
+#define INDEX_CHUNK (16u << 20)
+#define SEARCH_CHUNK (64u << 20)
+
+// Scrolling keeps the index up with the view when the view is within
+// this distance of the indexed part; a jump further out leaves the line
+// number unknown rather than reading everything in between
+#define INDEX_REACH (64u << 20)
+
+struct viewer {
+    char *path;
+    int fd;                     // Kept open to map the file again as it grows
+    dev_t dev;                  // Which file 'path' named when it was opened,
+    ino_t ino;                  // to notice it being replaced
+    const char *data;           // The whole file, mapped (NULL when empty)
+    size_t size;
+    size_t *marks;              // marks[k] = start of line k * LINE_STEP
+    size_t nmarks, marks_cap;
+    size_t scanned;             // Bytes indexed so far...
+    unsigned long lines_seen;   // ...and the newlines among them
+    size_t top;                 // Start of the first line shown
+    int left;                   // Columns scrolled off to the left
+    int end_shown;              // The last line was on screen
+    char *needle;               // Last search (lower case when ignoring case)
+    size_t needle_len;
+    int ignore_case;
+};
+
+static void add_mark(viewer_t *v, size_t off) {
+    if (v->nmarks == v->marks_cap) {
+        v->marks_cap = v->marks_cap ? v->marks_cap * 2 : 256;
+        v->marks = realloc(v->marks, v->marks_cap * sizeof(size_t));
+        if (!v->marks) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    v->marks[v->nmarks++] = off;
+}
+
+// Map the first 'size' bytes of the file in place of the old mapping.
+// Growth keeps the mapping where possible. Returns -1 with errno set on failure.
+static int map_file(viewer_t *v, size_t size) {
+    void *map = NULL;
+    if (size > 0 && v->data) {
+        map = mremap((void *)v->data, v->size, size, MREMAP_MAYMOVE);
+    } else {
+        if (v->data) munmap((void *)v->data, v->size);
+        if (size > 0) map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, v->fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        if (v->data) munmap((void *)v->data, v->size);
+        v->data = NULL;
+        v->size = 0;
+        return -1;
+    }
+    v->data = map;
+    v->size = size;
+    return 0;
+}
+
+// Forget the line index (after the file shrank or was replaced)
+static void reset_index(viewer_t *v) {
+    v->nmarks = 1;
+    v->scanned = 0;
+    v->lines_seen = 0;
+    v->top = 0;
+}
+
+// Open 'path' for viewing. Returns NULL with a message in 'err' on failure.
+viewer_t *viewer_open(const char *path, char *err, size_t errsz) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        snprintf(err, errsz, "%s", strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        snprintf(err, errsz, "%s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        snprintf(err, errsz, "not a regular file");
+        close(fd);
+        return NULL;
+    }
+
+    viewer_t *v = calloc(1, sizeof(*v));
+    if (!v || !(v->path = strdup(path))) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    v->fd = fd;
+    v->dev = st.st_dev;
+    v->ino = st.st_ino;
+    if (map_file(v, (size_t)st.st_size) != 0) {
+        snprintf(err, errsz, "%s", strerror(errno));
+        close(fd);
+        free(v->path);
+        free(v);
+        return NULL;
+    }
+    add_mark(v, 0);
+    return v;
+}
+
+// Catch up with changes to the file (follow mode). Only bytes added
+// since the last call are indexed later on; a file that shrank, or a
+// new file under the same name (log rotation), is indexed from scratch.
+viewer_change_t viewer_reload(viewer_t *v) {
+    struct stat st;
+    if (stat(v->path, &st) == 0 && S_ISREG(st.st_mode) &&
+        (st.st_dev != v->dev || st.st_ino != v->ino)) {
+        int fd = open(v->path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+        if (fd >= 0 && fstat(fd, &st) == 0) {
+            map_file(v, 0);
+            close(v->fd);
+            v->fd = fd;
+            v->dev = st.st_dev;
+            v->ino = st.st_ino;
+            reset_index(v);
+            return map_file(v, (size_t)st.st_size) == 0 ? VIEWER_REPLACED : VIEWER_FAILED;
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    // Still the same file (or its name is gone for now): check its size
+    if (fstat(v->fd, &st) != 0) return VIEWER_FAILED;
+    size_t size = (size_t)st.st_size;
+    if (size == v->size) return VIEWER_SAME;
+    if (size < v->size) {
+        reset_index(v);
+        map_file(v, 0);
+        return map_file(v, size) == 0 ? VIEWER_TRUNCATED : VIEWER_FAILED;
+    }
+    return map_file(v, size) == 0 ? VIEWER_GREW : VIEWER_FAILED;
+}
+
+void viewer_close(viewer_t *v) {
+    if (!v) return;
+    if (v->data) munmap((void *)v->data, v->size);
+    close(v->fd);
+    free(v->marks);
+    free(v->needle);
+    free(v->path);
+    free(v);
+}
+
+const char *viewer_path(const viewer_t *v) {
+    return v->path;
+}
+
+// Does the file look like binary data (a NUL near the start)?
+int viewer_is_binary(const viewer_t *v) {
+    return v->size > 0 && mem_looks_binary(v->data, v->size);
+}
+
+// Byte offset of the top line, e.g. to open the hex view at the same place
+size_t viewer_offset(const viewer_t *v) {
+    return v->top;
+}
+
+// Drop the pages of [from, to) from the mapping once we are done with them
+static void release(viewer_t *v, size_t from, size_t to) {
+    if (v->size < INDEX_CHUNK) return;  // Small files: not worth the syscalls
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t a = (from + page - 1) / page * page, b = to / page * page;
+    if (b > a) madvise((char *)v->data + a, b - a, MADV_DONTNEED);
+}
+
+// Index the next chunk of the file
+static void index_chunk(viewer_t *v) {
+    size_t end = v->scanned + INDEX_CHUNK;
+    if (end > v->size) end = v->size;
+
+    const char *p = v->data + v->scanned, *stop = v->data + end;
+    while ((p = memchr(p, '\n', (size_t)(stop - p))) != NULL) {
+        p++;
+        if (++v->lines_seen % LINE_STEP == 0) add_mark(v, (size_t)(p - v->data));
+    }
+    release(v, v->scanned, end);
+    v->scanned = end;
+}
+
+// Start of line k (0-based); the index must already reach it
+static size_t line_start(viewer_t *v, unsigned long k) {
+    size_t off = v->marks[k / LINE_STEP];
+    for (unsigned long i = k / LINE_STEP * LINE_STEP; i < k; i++) {
+        const char *nl = memchr(v->data + off, '\n', v->size - off);
+        off = (size_t)(nl - v->data) + 1;
+    }
+    return off;
+}
+
+// 0-based number of the line starting at 'off' (off <= v->scanned)
+static unsigned long line_number(viewer_t *v, size_t off) {
+    size_t lo = 0, hi = v->nmarks;  // Last mark at or before 'off'
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (v->marks[mid] <= off) lo = mid; else hi = mid;
+    }
+    return (unsigned long)lo * LINE_STEP +
+           (unsigned long)mem_count_byte(v->data + v->marks[lo], off - v->marks[lo], '\n');
+}
+
+// Start of the line that byte 'off' is in
+static size_t line_start_at(viewer_t *v, size_t off) {
+    const char *nl = off > 0 ? memrchr(v->data, '\n', off) : NULL;
+    return nl ? (size_t)(nl - v->data) + 1 : 0;
+}
+
+// Start of the line after the one at 'off', or 'size' if there is none
+static size_t next_line(viewer_t *v, size_t off) {
+    const char *nl = memchr(v->data + off, '\n', v->size - off);
+    return nl ? (size_t)(nl - v->data) + 1 : v->size;
+}
+
+// Move down (positive) or up by whole lines
+void viewer_scroll(viewer_t *v, long lines) {
+    if (v->size == 0) return;
+    for (; lines > 0; lines--) {
+        size_t next = next_line(v, v->top);
+        if (next >= v->size) break;  // Already on the last line
+        v->top = next;
+    }
+    for (; lines < 0 && v->top > 0; lines++) {
+        v->top = line_start_at(v, v->top - 1);
+    }
+}
+
+void viewer_hscroll(viewer_t *v, int cols) {
+    v->left += cols;
+    if (v->left < 0) v->left = 0;
+}
+
+void viewer_top(viewer_t *v) {
+    v->top = 0;
+}
+
+// Was the end of the file on screen when it was last drawn? (Asked
+// before viewer_reload(), when the mapping may be past the end of a
+// truncated file and must not be read.)
+int viewer_at_end(const viewer_t *v) {
+    return v->end_shown;
+}
+
+// Show the last screenful. No indexing needed: we walk back from the end.
+void viewer_bottom(viewer_t *v, int rows) {
+    v->top = v->size;
+    viewer_scroll(v, -(long)rows);
+}
+
+// Go to line 'line' (1-based), indexing as far as needed. Past the end,
+// goes to the last line and returns -1.
+int viewer_goto_line(viewer_t *v, unsigned long line) {
+    unsigned long k = line > 0 ? line - 1 : 0;
+    while (v->lines_seen < k && v->scanned < v->size) {
+        index_chunk(v);
+    }
+    int result = 0;
+    if (k > v->lines_seen) {
+        k = v->lines_seen;
+        result = -1;
+    }
+    v->top = line_start(v, k);
+    if (v->top >= v->size && v->size > 0) {
+        v->top = line_start_at(v, v->size - 1);  // Nothing after the final newline
+        result = -1;
+    }
+    return result;
+}
+
+// Go to the line at 'percent' of the file's bytes
+void viewer_goto_percent(viewer_t *v, unsigned percent) {
+    if (v->size == 0) return;
+    if (percent > 100) percent = 100;
+    size_t off = (size_t)((unsigned long long)v->size * percent / 100);
+    if (off >= v->size) off = v->size - 1;
+    v->top = line_start_at(v, off);
+}
+
+// Show the line holding byte 'offset' at the top
+void viewer_goto_offset(viewer_t *v, size_t offset) {
+    if (v->size == 0) return;
+    v->top = line_start_at(v, offset < v->size ? offset : v->size - 1);
+}
+
+// First match at or after 'from', or NULL
+static const char *find_forward(viewer_t *v, size_t from) {
+    while (from < v->size) {
+        size_t end = from + SEARCH_CHUNK;
+        if (end > v->size) end = v->size;
+        size_t span = end + v->needle_len - 1;  // Matches may run into the next chunk
+        if (span > v->size) span = v->size;
+
+        const char *hit = mem_find(v->data + from, span - from, v->needle, v->needle_len,
+                                   v->ignore_case);
+        release(v, from, end);
+        if (hit) return hit;
+        from = end;
+    }
+    return NULL;
+}
+
+// Last match that starts before 'before', or NULL
+static const char *find_backward(viewer_t *v, size_t before) {
+    size_t end = before;
+    while (end > 0) {
+        size_t start = end > SEARCH_CHUNK ? end - SEARCH_CHUNK : 0;
+        size_t span = end + v->needle_len - 1;
+        if (span > v->size) span = v->size;
+
+        const char *last = NULL, *p = v->data + start;
+        while ((p = mem_find(p, (size_t)(v->data + span - p), v->needle, v->needle_len,
+                             v->ignore_case)) != NULL && p < v->data + end) {
+            last = p++;
+        }
+        release(v, start, end);
+        if (last) return last;
+        end = start;
+    }
+    return NULL;
+}
+
+// Look for 'text' after the top line (or before it, backward). Smart
+// case as elsewhere. Returns 1 and moves to the match if there is one.
+int viewer_search(viewer_t *v, const char *text, int backward) {
+    free(v->needle);
+    v->needle = NULL;
+    if (!text[0]) return 0;
+    if (!(v->needle = strdup(text))) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    v->needle_len = strlen(text);
+    v->ignore_case = 1;
+    for (const char *c = text; *c; c++) {
+        if (isupper((unsigned char)*c)) v->ignore_case = 0;
+    }
+    return viewer_search_next(v, backward);
+}
+
+// Repeat the last search
+int viewer_search_next(viewer_t *v, int backward) {
+    if (!v->needle || v->size == 0) return 0;
+    const char *hit = backward ? find_backward(v, v->top)
+                               : find_forward(v, next_line(v, v->top));
+    if (!hit) return 0;
+    v->top = line_start_at(v, (size_t)(hit - v->data));
+    return 1;
+}
+
+// One line, cut to the columns on screen: tabs expanded, control bytes
+// shown as '.', matches of the last search in reverse video
+static void draw_line(viewer_t *v, outbuf_t *ob, const char *s, const char *end, int cols) {
+    int col = 0, limit = v->left + cols;
+    int shown = 0;  // Was the last character on screen (for UTF-8 continuation bytes)
+
+    // A visible column takes at most 4 bytes, so matches further out can't show
+    const char *scan_end = end;
+    if ((size_t)(end - s) > (size_t)limit * 4 + v->needle_len) scan_end = s + (size_t)limit * 4 + v->needle_len;
+    const char *match = v->needle ? mem_find(s, (size_t)(scan_end - s), v->needle, v->needle_len,
+                                             v->ignore_case) : NULL;
+    const char *match_end = NULL;
+
+    for (const char *p = s; p < end && col < limit; p++) {
+        if (p == match_end) {
+            ob_puts(ob, "\033[27m");
+            match_end = NULL;
+            match = mem_find(p, (size_t)(scan_end - p), v->needle, v->needle_len, v->ignore_case);
+        }
+        if (p == match) {
+            ob_puts(ob, "\033[7m");
+            match_end = match + v->needle_len;
+        }
+
+        unsigned char c = (unsigned char)*p;
+        if (c == '\t') {
+            int w = 8 - col % 8;
+            for (int i = 0; i < w && col < limit; i++, col++) {
+                if (col >= v->left) ob_append(ob, " ", 1);
+            }
+            shown = 0;
+        } else if ((c & 0xC0) == 0x80) {
+            if (shown) ob_append(ob, p, 1);
+        } else if (c == '\r' && p + 1 == end) {
+            // CRLF line ending
+        } else {
+            shown = (col >= v->left);
+            if (shown) ob_append(ob, (c < 32 || c == 127) ? "." : p, 1);
+            col++;
+        }
+    }
+    if (match_end) ob_puts(ob, "\033[27m");
+}
+
+// Draw 'rows' lines of the file from screen row 'first_row'
+void viewer_draw(viewer_t *v, int first_row, int rows, int cols) {
+    // Touching pages past the end of a file that shrank would raise
+    // SIGBUS, so check the size once per frame
+    struct stat st;
+    if (fstat(v->fd, &st) == 0 && (size_t)st.st_size < v->size) {
+        reset_index(v);
+        map_file(v, 0);
+        map_file(v, (size_t)st.st_size);
+    }
+
+    // Keep the index up with the view while scrolling through the file,
+    // and finish it once the end is close (so the line count shows)
+    if (v->top <= v->scanned + INDEX_REACH) {
+        size_t goal = v->size - v->scanned <= INDEX_REACH ? v->size : v->top + 1;
+        while (v->scanned < goal) {
+            index_chunk(v);
+        }
+    }
+
+    size_t off = v->top;
+    for (int r = 0; r < rows; r++) {
+        outbuf_t *ob = screen_row(first_row + r);
+        if (off >= v->size) {
+            ob_puts(ob, "~");
+            continue;
+        }
+        // Past INDEX_REACH without a newline, leave the rest of the line
+        // (and the screen) alone rather than reading on to its end
+        const char *line = v->data + off;
+        size_t span = v->size - off < INDEX_REACH ? v->size - off : INDEX_REACH;
+        const char *nl = memchr(line, '\n', span);
+        draw_line(v, ob, line, nl ? nl : line + span, cols);
+        off = nl ? (size_t)(nl - v->data) + 1 : v->size;
+    }
+    v->end_shown = (off >= v->size);
+}
+
+// Position summary: line (when the index reaches it), total lines (once
+// the whole file is indexed) and how far into the file we are
+void viewer_status(viewer_t *v, outbuf_t *ob) {
+    char line[32] = "?", total[32] = "?";
+    if (v->top <= v->scanned) {
+        snprintf(line, sizeof(line), "%lu", line_number(v, v->top) + 1);
+    }
+    if (v->scanned == v->size) {
+        unsigned long lines = v->lines_seen + (v->size > 0 && v->data[v->size - 1] != '\n');
+        snprintf(total, sizeof(total), "%lu", lines);
+    }
+    unsigned percent = v->size ? (unsigned)((unsigned long long)v->top * 100 / v->size) : 100;
+    ob_printf(ob, "line %s of %s (%u%%, byte %zu of %zu)", line, total, percent, v->top, v->size);
+    if (v->left > 0) ob_printf(ob, " col %d", v->left + 1);
+}
@@ -0,0 +1,43 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include "term.h"
+#include <stddef.h>
+
+// Built-in pager over a mapped file. Nothing is read up front: the line
+// index is built in chunks as far as scrolling or a jump needs it, and
+// keeps one mark per 1024 lines, so even a huge log opens at once and
+// costs little memory.
+typedef struct viewer viewer_t;
+
+// What viewer_reload() found
+typedef enum {
+    VIEWER_SAME,        // Nothing changed
+    VIEWER_GREW,        // Bytes were appended
+    VIEWER_TRUNCATED,   // The file got shorter (e.g. truncated by logrotate's copytruncate)
+    VIEWER_REPLACED,    // The name now points at a new file (log rotation)
+    VIEWER_FAILED       // The file could not be mapped again
+} viewer_change_t;
+
+viewer_t *viewer_open(const char *path, char *err, size_t errsz);
+void viewer_close(viewer_t *v);
+const char *viewer_path(const viewer_t *v);
+int viewer_is_binary(const viewer_t *v);
+size_t viewer_offset(const viewer_t *v);
+void viewer_goto_offset(viewer_t *v, size_t offset);
+viewer_change_t viewer_reload(viewer_t *v);
+int viewer_at_end(const viewer_t *v);
+
+void viewer_scroll(viewer_t *v, long lines);
+void viewer_hscroll(viewer_t *v, int cols);
+void viewer_top(viewer_t *v);
+void viewer_bottom(viewer_t *v, int rows);
+int viewer_goto_line(viewer_t *v, unsigned long line);
+void viewer_goto_percent(viewer_t *v, unsigned percent);
+int viewer_search(viewer_t *v, const char *text, int backward);
+int viewer_search_next(viewer_t *v, int backward);
+
+void viewer_draw(viewer_t *v, int first_row, int rows, int cols);
+void viewer_status(viewer_t *v, outbuf_t *ob);
+
+#endif
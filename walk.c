@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "walk.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Most worker threads a walk gets: more mostly adds seeking on spinning disks
+#define WALK_MAX_THREADS 8
+
+struct walk {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // Items were pushed, or a worker finished one
+    walk_item_t *stack;         // Items still to visit
+    int busy;                   // Workers on an item (or refilling the stack) right now
+    int running;                // Workers that haven't left
+    int over;                   // Out of items for good
+    unsigned long pushed;       // Items pushed so far
+    pool_t *pool;               // NULL if no thread could be started
+    walk_ops_t ops;
+    void *ctx;
+};
+
+int walk_threads(void) {
+    int n = pool_default_threads();
+    return n > WALK_MAX_THREADS ? WALK_MAX_THREADS : n;
+}
+
+char *xstrdup(const char *s) {
+    char *p = strdup(s);
+    if (!p) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+walk_t *walk_create(int nthreads, const walk_ops_t *ops, void *ctx) {
+    walk_t *w = calloc(1, sizeof(*w));
+    if (!w) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->ops = *ops;
+    w->ctx = ctx;
+    // The workers stay on their task for the whole walk, so the queue
+    // only ever holds one task per thread
+    w->pool = pool_create(nthreads, nthreads > 0 ? (size_t)nthreads : 1);
+    return w;
+}
+
+void walk_push(walk_t *w, int kind, const char *path, void *data, size_t n) {
+    size_t len = path ? strlen(path) + 1 : 1;
+    walk_item_t *item = malloc(sizeof(*item) + len);
+    if (!item) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    item->kind = kind;
+    item->data = data;
+    item->n = n;
+    memcpy(item->path, path ? path : "", len);
+
+    pthread_mutex_lock(&w->lock);
+    item->next = w->stack;
+    w->stack = item;
+    w->pushed++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Pool task: visit items until the walk is over
+static void walk_worker(void *arg) {
+    walk_t *w = arg;
+    void *state = w->ops.worker_init ? w->ops.worker_init(w->ctx) : NULL;
+    int idled = 0;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        if (!w->stack && !w->over) {
+            if (w->ops.idle && !idled) {
+                pthread_mutex_unlock(&w->lock);
+                w->ops.idle(w->ctx, state);
+                pthread_mutex_lock(&w->lock);
+                idled = 1;
+            } else if (w->busy > 0) {
+                pthread_cond_wait(&w->cond, &w->lock);
+            } else {
+                // Nobody can add to the stack any more: the caller may
+                // start another round while the other workers wait (they
+                // may even finish it before this one is back)
+                unsigned long pushed = w->pushed;
+                if (w->ops.drained) {
+                    w->busy++;
+                    pthread_mutex_unlock(&w->lock);
+                    w->ops.drained(w->ctx);
+                    pthread_mutex_lock(&w->lock);
+                    w->busy--;
+                }
+                if (w->pushed == pushed) {
+                    w->over = 1;
+                    pthread_cond_broadcast(&w->cond);
+                }
+            }
+            continue;
+        }
+        if (!w->stack) break;
+
+        walk_item_t *item = w->stack;
+        w->stack = item->next;
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        w->ops.visit(w->ctx, state, item);
+        free(item);
+        idled = 0;
+
+        pthread_mutex_lock(&w->lock);
+        w->busy--;
+        if (w->busy == 0 && !w->stack) pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (w->ops.worker_done) w->ops.worker_done(w->ctx, state);
+    pthread_mutex_lock(&w->lock);
+    int last = (--w->running == 0);
+    pthread_mutex_unlock(&w->lock);
+    if (last && w->ops.finished) w->ops.finished(w->ctx);
+}
+
+int walk_start(walk_t *w) {
+    if (!w->pool) return -1;
+    int n = pool_threads(w->pool);
+    pthread_mutex_lock(&w->lock);
+    w->running = n;
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < n; i++) {
+        pool_submit(w->pool, walk_worker, w);  // Never waits: one task per thread
+    }
+    return 0;
+}
+
+void walk_run(walk_t *w) {
+    if (walk_start(w) == 0) {
+        pool_wait(w->pool);
+        return;
+    }
+    w->running = 1;
+    walk_worker(w);  // No threads to be had: walk on this one
+}
+
+int walk_workers(const walk_t *w) {
+    return w->pool ? pool_threads(w->pool) : 1;
+}
+
+// Is a worker still on the walk?
+int walk_running(walk_t *w) {
+    pthread_mutex_lock(&w->lock);
+    int running = w->running > 0;
+    pthread_mutex_unlock(&w->lock);
+    return running;
+}
+
+void walk_free(walk_t *w) {
+    if (!w) return;
+    pool_destroy(w->pool);
+    while (w->stack) {
+        walk_item_t *next = w->stack->next;
+        free(w->stack);
+        w->stack = next;
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w);
+}
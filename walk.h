@@ -0,0 +1,58 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stddef.h>
+
+// Parallel tree walks. Workers on a pool.c pool take items (folders,
+// files, parts of files: whatever the caller makes of 'kind') off a
+// shared stack and visit them; a visit may push more items. The walk is
+// over once the stack is empty and no worker is on an item that could
+// still add to it. Newest items are taken first, so a deep tree is
+// walked depth-first and the stack stays small.
+typedef struct walk walk_t;
+
+typedef struct walk_item {
+    struct walk_item *next;
+    int kind;                   // The caller's
+    void *data;                 // The caller's
+    size_t n;                   // The caller's
+    char path[];                // "" if pushed without one
+} walk_item_t;
+
+// What the caller does at each step. Only 'visit' is required; all of
+// them run on worker threads, and get back the 'ctx' given to walk_create().
+typedef struct {
+    void *(*worker_init)(void *ctx);               // Per-worker state (buffers, batches)
+    void (*visit)(void *ctx, void *state, const walk_item_t *item);
+    void (*idle)(void *ctx, void *state);          // Out of items for now: hand over batches
+    void (*worker_done)(void *ctx, void *state);   // The worker leaves: free its state
+    void (*drained)(void *ctx);                    // Out of items for good, every worker waiting:
+                                                   // push more to go on, or the walk ends
+    void (*finished)(void *ctx);                   // The last worker has left
+} walk_ops_t;
+
+// Threads for a walk over the disk: the pool default, within a cap
+int walk_threads(void);
+
+// Make a walk with up to 'nthreads' workers. Push the starting items,
+// then run it in the background (walk_start) or on this thread (walk_run).
+walk_t *walk_create(int nthreads, const walk_ops_t *ops, void *ctx);
+void walk_push(walk_t *w, int kind, const char *path, void *data, size_t n);
+
+// Start the workers. Returns -1 if no thread could be had.
+int walk_start(walk_t *w);
+
+// Walk and wait for the end (on this thread alone if no others can be had)
+void walk_run(walk_t *w);
+
+int walk_workers(const walk_t *w);
+int walk_running(walk_t *w);
+
+// Wait for the workers and free the walk. Make the visits return quickly
+// first (e.g. with a cancel flag): the workers still empty the stack.
+void walk_free(walk_t *w);
+
+// strdup() that exits when out of memory, for paths found on a walk
+char *xstrdup(const char *s);
+
+#endif